@@ -0,0 +1,61 @@
+//===----------------------- AnalyticalEvaluation.h -----------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the AnalyticalEvaluation class, which
+/// contains an evaluator of the transformed code that estimates its execution
+/// time with a roofline model of the tiled loop nests instead of lowering and
+/// running it
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_ANALYTICAL_EVALUATION_H_
+#define MLSCEDULER_ANALYTICAL_EVALUATION_H_
+
+#include "EvaluationByExecution.h"
+
+#include <string>
+
+using namespace mlir;
+class AnalyticalEvaluation : public EvaluationByExecution {
+    public:
+        /// Work and traffic of a transformed module and the time the model
+        /// gives them.
+        struct Estimate {
+            /// Operations of the linalg payloads not vectorized.
+            double scalarFlops = 0;
+            /// Operations on vectors.
+            double vectorFlops = 0;
+            /// Bytes moved from memory, the tiles that do not fit in the
+            /// cache of a core are read again.
+            double bytes = 0;
+            /// Smallest number of parallel iterations of a parallel loop nest,
+            /// 1 when the code is not parallelized.
+            double parallelIterations = 1;
+            double seconds = 0;
+        };
+
+        AnalyticalEvaluation(std::string LogsFileName);
+
+        /// Walks the loop nests of the module: trip counts of the scf.forall
+        /// and scf.for loops, extents of the tiled linalg operations, vector
+        /// shapes and footprints of the tiles. Each operation takes the longest
+        /// of its compute time and of its memory time, on the cores its
+        /// parallel loops keep busy. The machine is described by
+        /// AS_CORE_GFLOPS (32, vector peak of one core), AS_VECTOR_BITS (256),
+        /// AS_CORE_BANDWIDTH_GBS (10), AS_BANDWIDTH_GBS (40), AS_CACHE_BYTES
+        /// (the L2 cache) and AS_CORES (OMP_NUM_THREADS or all the cores).
+        static Estimate estimate(mlir::Operation *module);
+
+        /// Keeps the AS_ANALYTICAL_SCREEN fraction of the nodes (at least one)
+        /// with the lowest estimates, the other nodes are given the failed
+        /// evaluation. Returns the nodes unchanged when AS_ANALYTICAL_SCREEN is
+        /// not set.
+        static llvm::SmallVector<Node *, 2> screen(llvm::ArrayRef<Node *> nodes);
+
+        /// Returns the estimated time as the evaluation of the node, no code
+        /// is lowered or run.
+        std::string evaluateTransformation(Node *node) override;
+};
+
+#endif // MLSCEDULER_ANALYTICAL_EVALUATION_H_
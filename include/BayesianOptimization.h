@@ -0,0 +1,85 @@
+//===----------------------- BayesianOptimization.h -----------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the BayesianOptimization class,
+/// which contains a definition of a search method of the tile sizes guided
+/// by a Gaussian process fitted on the measured schedules, it finds good tile
+/// sizes in a few tens of evaluations where the tile spaces have thousands
+/// of combinations
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_BAYESIAN_OPTIMIZATION_H_
+#define MLSCEDULER_BAYESIAN_OPTIMIZATION_H_
+
+#include "SearchMethod.h"
+#include "SearchSpace.h"
+#include "Node.h"
+#include "EvaluationByExecution.h"
+
+#include <random>
+#include <set>
+
+using namespace mlir;
+class BayesianOptimization : public SearchMethod{
+    private:
+        using Genome = SearchSpace::Genome;
+
+        mlir::MLIRContext *context;
+        std::string functionName;
+        SearchSpace space;
+        int numEvaluations;
+        int batchSize;
+        int numThreads;
+        std::mt19937 generator;
+
+        /// Schedule whose tile sizes are tuned, its genes have the extents of
+        /// the loops they tile.
+        Genome schedule;
+        /// Gene and loop of each tile size of the schedule, the features of a
+        /// genome are the log2 of these tile sizes.
+        std::vector<std::pair<size_t, size_t>> layout;
+        /// Measured genomes, their features and log times (infinite when
+        /// the candidate failed).
+        std::vector<Genome> observed;
+        std::vector<std::vector<double>> features;
+        std::vector<double> logTimes;
+        std::set<std::vector<double>> visited;
+        SmallVector<Node *, 2> evaluatedNodes;
+
+        /// True when the genome has the steps and the number of tile sizes
+        /// of the schedule, its features are then comparable.
+        bool hasLayout(const Genome &genome);
+        std::vector<double> getFeatures(const Genome &genome);
+        /// Schedule with random tile sizes.
+        Genome getRandomGenome();
+        /// Candidates of the acquisition: random genomes and neighbours of
+        /// the fastest measured ones, the measured genomes are left out.
+        std::vector<Genome> getCandidates();
+        /// Picks the next count candidates by expected improvement. After
+        /// each pick the Gaussian process is refitted as if the candidate had
+        /// been measured at its predicted time, so that the batch spreads.
+        std::vector<Genome> acquire(int count);
+        /// Decodes the genomes on numThreads threads, evaluates them as one
+        /// batch and records the repaired genomes, returns the fastest node
+        /// (the root when none could be decoded).
+        Node *evaluate(Node *root, std::vector<Genome> &genomes, EvaluationByExecution *evaluator);
+
+    public:
+        /// Creates a search of numEvaluations schedules measured by batches
+        /// of batchSize. The tuned schedule goes through the depth steps of
+        /// the SearchSpace, the genomes are decoded by numThreads threads (0
+        /// for one per core).
+        BayesianOptimization(mlir::MLIRContext *context, std::string functionName, int numEvaluations, int batchSize = 8,
+                             int depth = 3, int numThreads = 0);
+
+        /// Runs the search from a root already evaluated and returns the
+        /// fastest node. The structure of the schedule (its steps and
+        /// interchanges) is drawn once, then its tile sizes are tuned: a first
+        /// batch is drawn at random and the next ones are acquired from the
+        /// Gaussian process fitted on all the measurements.
+        Node * runSearchMethod(Node * root) override;
+};
+
+#endif // MLSCEDULER_BAYESIAN_OPTIMIZATION_H_
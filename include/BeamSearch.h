@@ -11,6 +11,7 @@
 #define MLSCEDULER_BEAM_SEARCH_H_
 
 #include "SearchMethod.h"
+#include "SearchSpace.h"
 #include "Node.h"
 #include "EvaluationByExecution.h"
 #include "TilingTransformation.h"
@@ -18,6 +19,8 @@
 #include "ParallelizationTransformation.h"
 #include "VectorizationTransformation.h"
 
+#include "llvm/ADT/DenseMap.h"
+
 #include <queue>
 
 using namespace mlir;
@@ -26,11 +29,22 @@ class BeamSearch : public SearchMethod{
         int beamSize;
         mlir::MLIRContext *context;
         std::string functionName;
+        SearchSpace space;
+        /// Children of the nodes expanded so far, a parent kept in the beam
+        /// is expanded again at the next level and keeps its first children.
+        llvm::DenseMap<Node *, SmallVector<Node *, 2>> childrenNodes;
 
     public:
         /// Constructor for the BeamSearch class, initializing beam size, MLIR context, and the function name.
-        BeamSearch(int beamSize, mlir::MLIRContext *context, std::string functionName);
+        /// The search goes through the depth steps of the SearchSpace.
+        BeamSearch(int beamSize, mlir::MLIRContext *context, std::string functionName, int depth = 3);
         /// Runs the beam search algorithm starting from a given root node
+        /// already evaluated. At each level, the children of all the nodes of
+        /// the beam are evaluated as one batch (measured concurrently by the
+        /// runner pool, the evaluator when AS_EVALUATOR is not set), the
+        /// parents stay candidates so that a
+        /// step may be skipped, and the beamSize fastest nodes form the next
+        /// beam. Returns the fastest node found.
         Node * runSearchMethod(Node * root) override;
 
 };
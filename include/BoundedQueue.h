@@ -0,0 +1,77 @@
+//===----------------------- BoundedQueue.h -------------------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the BoundedQueue class, which
+/// contains a blocking queue of limited capacity used to hand work from one
+/// stage of the evaluation to the next one
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_BOUNDED_QUEUE_H_
+#define MLSCEDULER_BOUNDED_QUEUE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+template <typename T>
+class BoundedQueue {
+    private:
+        std::deque<T> items;
+        size_t capacity;
+        bool closed;
+        std::mutex mutex;
+        std::condition_variable notEmpty;
+        std::condition_variable notFull;
+
+    public:
+        BoundedQueue(size_t capacity) : capacity(capacity > 0 ? capacity : 1), closed(false)
+        {
+        }
+
+        /// Adds an item, blocks while the queue is full. Returns false if the
+        /// queue was closed.
+        bool push(T item)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            notFull.wait(lock, [&]()
+                         { return closed || items.size() < capacity; });
+            if (closed)
+                return false;
+            items.push_back(std::move(item));
+            lock.unlock();
+            notEmpty.notify_one();
+            return true;
+        }
+
+        /// Removes the oldest item, blocks while the queue is empty. Returns
+        /// false once the queue is closed and all its items were removed.
+        bool pop(T &item)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            notEmpty.wait(lock, [&]()
+                          { return closed || !items.empty(); });
+            if (items.empty())
+                return false;
+            item = std::move(items.front());
+            items.pop_front();
+            lock.unlock();
+            notFull.notify_one();
+            return true;
+        }
+
+        /// Wakes up the blocked consumers once the producers are done, the items
+        /// already in the queue can still be removed.
+        void close()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                closed = true;
+            }
+            notEmpty.notify_all();
+            notFull.notify_all();
+        }
+};
+
+#endif // MLSCEDULER_BOUNDED_QUEUE_H_
@@ -0,0 +1,95 @@
+//===----------------------- CostModel.h ----------------------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the CostModel class, which contains
+/// a small multilayer perceptron trained during the tuning on the measured
+/// candidates, it ranks the next candidates so that only the most promising
+/// ones are executed
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_COST_MODEL_H_
+#define MLSCEDULER_COST_MODEL_H_
+
+#include "Node.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace mlir;
+class CostModel {
+    private:
+        int numFeatures;
+        int numHidden;
+        /// Weights of the hidden layer (numHidden rows of numFeatures), of
+        /// the output and their biases.
+        std::vector<float> hiddenWeights;
+        std::vector<float> hiddenBiases;
+        std::vector<float> outputWeights;
+        float outputBias;
+
+        /// Normalization of the features and of the log times, computed on
+        /// the training samples.
+        std::vector<float> featureMeans;
+        std::vector<float> featureScales;
+        float targetMean;
+        float targetScale;
+
+        /// Training samples, the oldest are replaced once the buffer is full.
+        std::vector<std::vector<float>> samples;
+        std::vector<float> targets;
+        size_t nextSample;
+        std::mt19937 generator;
+
+        /// Predictions of the candidates selected in the last step, compared
+        /// with their measurements by update.
+        llvm::DenseMap<Node *, float> predictions;
+        std::vector<double> correlations;
+        int numSkipped;
+
+        CostModel();
+
+        /// Features of the transformed module of the node (see
+        /// FeatureExtractor).
+        static std::vector<float> getFeatures(Node *node);
+        float predictNormalized(const std::vector<float> &features, std::vector<float> *hidden = nullptr);
+        void train();
+
+    public:
+        /// Returns the cost model, or nullptr unless AS_COST_MODEL is 1.
+        static CostModel *get();
+
+        /// Predicted log time of the node.
+        float predict(Node *node);
+
+        /// True once AS_COST_MODEL_WARMUP (32) candidates were measured, the
+        /// predictions are not used before.
+        bool isWarm();
+
+        /// Returns the AS_COST_MODEL_TOPK (8 by default) nodes with the lowest
+        /// predicted times, the other nodes are given the failed evaluation.
+        /// All the nodes are kept until AS_COST_MODEL_WARMUP (32) candidates
+        /// were measured.
+        llvm::SmallVector<Node *, 2> select(llvm::ArrayRef<Node *> nodes);
+
+        /// Adds the measured nodes to the training samples, trains the model
+        /// on them and prints the Spearman rank correlation between the
+        /// predictions and the measurements of the step.
+        void update(llvm::ArrayRef<Node *> nodes);
+
+        /// Samples, skipped candidates and mean rank correlation for the
+        /// tuning report.
+        std::string summary();
+
+        /// Spearman rank correlation of the two series, 0 when it is not
+        /// defined.
+        static double getRankCorrelation(const std::vector<double> &a, const std::vector<double> &b);
+};
+
+#endif // MLSCEDULER_COST_MODEL_H_
@@ -4,9 +4,14 @@
 
 #include "mlir/Pass/Pass.h"
 
+#include <chrono>
+
 namespace mlir {
 
 std::unique_ptr<Pass> createForEachThreadLowering();
+/// Creates a pass that fails when the steady clock is past the deadline, the
+/// deadline is read at each run so that the pipeline can be reused.
+std::unique_ptr<Pass> createLoweringDeadline(const std::chrono::steady_clock::time_point *deadline);
 
 
 } // namespace mlir
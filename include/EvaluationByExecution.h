@@ -12,6 +12,7 @@
 #define MLSCEDULER_EVALUATION_BY_EXECUTION_H_
 
 #include "Evaluation.h"
+#include "Measurement.h"
 #include "Node.h"
 #include "TransformDialectInterpreter.h"
 #include "TransformInterpreterPassBase.h"
@@ -27,6 +28,8 @@
 
 #include "mlir/Parser/Parser.h"
 
+#include <memory>
+#include <mutex>
 #include <utility>
 #include <chrono>
 #include <iostream>
@@ -48,12 +51,49 @@ class EvaluationByExecution {
 
         EvaluationByExecution();
         EvaluationByExecution(std::string LogsFileName);
+        virtual ~EvaluationByExecution() = default;
+
+        /// Creates the evaluator selected by the AS_EVALUATOR environment variable:
+        /// "jit" for the in-process ExecutionEngine, "pool" for the persistent
+        /// runner workers, "analytical" for the estimates of the roofline model
+        /// (see AnalyticalEvaluation), anything else for the mlir-cpu-runner
+        /// child process. defaultEvaluator is used when AS_EVALUATOR is not
+        /// set.
+        static std::unique_ptr<EvaluationByExecution> create(std::string LogsFileName, const std::string &defaultEvaluator = "");
+
         /// Evaluates the transformation by executing it with the given parameters.
         /// Parameters:
         /// - registry: A reference to the DialectRegistry used for execution.
         /// - node: A pointer to the Node object representing the transformation.
         /// Returns: The evaluation result as a double value.
-        std::string evaluateTransformation(/*int argc, char** argv, DialectRegistry &registry,*/ Node* node);
+        virtual std::string evaluateTransformation(/*int argc, char** argv, DialectRegistry &registry,*/ Node* node);
+
+        /// Evaluates a batch of candidates and stores each evaluation in its node
+        /// with setEvaluation, evaluators able to measure several candidates at
+        /// once override it, the default evaluates them one after the other.
+        virtual void evaluateTransformations(llvm::ArrayRef<Node *> nodes);
+
+    protected:
+        /// Queues the code of the candidate to the logs (see TuningLogger) when
+        /// AS_VERBOSE is 1 and AS_LOG_IR is "all".
+        void logTransformation(Node *node, mlir::Operation *op);
+        void logTransformation(Node *node, const std::string &code);
+        /// Queues the evaluation record of the candidate to the logs when
+        /// AS_VERBOSE is 1, with its code when it is a new best.
+        void logEvaluation(Node *node, const std::string &OutputData);
+
+        /// Lowers the printed module down to the LLVM dialect with the
+        /// pipeline selected by AS_LOWERING_PIPELINE (see LoweringPipeline),
+        /// on a worker of the shared lowering pool so that a lowering that
+        /// never ends is stopped at Measurement::getLoweringTimeout(). Returns
+        /// Ok with the printed lowered module, or the TimedOut, LoweringFailed
+        /// or Crashed status.
+        ResultStatus lowerToLLVMDialect(const std::string &transformedModule, std::string &loweredModule);
+
+        /// Executes a module lowered by lowerToLLVMDialect repeatedly (see
+        /// Measurement::measure) and returns the times printed by printFlops,
+        /// the default pipes it through mlir-cpu-runner once per repetition.
+        virtual Measurement executeLoweredModule(const std::string &loweredModule);
 };
 
 #endif // MLSCEDULER_EVALUATION_BY_EXECUTION_H_
\ No newline at end of file
@@ -0,0 +1,59 @@
+//===----------------------- EvaluationByJIT.h ----------------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the EvaluationByJIT class, which
+/// contains an evaluator of the transformed code that JIT-compiles the lowered
+/// module with the MLIR ExecutionEngine in a persistent runner process instead
+/// of spawning mlir-cpu-runner for every candidate
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_EVALUATION_BY_JIT_H_
+#define MLSCEDULER_EVALUATION_BY_JIT_H_
+
+#include "EvaluationByExecution.h"
+#include "RunnerPool.h"
+
+#include "mlir/ExecutionEngine/ExecutionEngine.h"
+#include "mlir/ExecutionEngine/OptUtils.h"
+#include "llvm/ExecutionEngine/Orc/Mangling.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace mlir;
+class EvaluationByJIT : public EvaluationByExecution {
+    private:
+        /// Runner of the candidates of the evaluator, its watchdog stops the
+        /// runs at the cutoff (see RunnerPool).
+        std::unique_ptr<RunnerPool> runner;
+
+    public:
+        EvaluationByJIT();
+        EvaluationByJIT(std::string LogsFileName);
+
+        /// JIT-compiles a module lowered to the LLVM dialect once, calls its
+        /// `main` repeatedly (see Measurement::measure) and returns the values
+        /// passed to printFlops, the measurement is failed if a run fails.
+        /// The shared libraries listed in SHARED_LIBS are loaded once per
+        /// process and stay resident for the following candidates. With
+        /// AS_OBJECT_CACHE, the generated object is stored and later runs of the
+        /// same lowered module load it instead of compiling it again.
+        /// The hardware counters (see PerfCounters) are read around the region
+        /// the kernel times with nanoTime and their mean over the runs is
+        /// added to the measurement.
+        /// Runs slower than cutoffSeconds end the measurement as censored,
+        /// armWatchdog (when given) is called with the cutoff before each run
+        /// and with 0 after it, so that a caller able to interrupt the run can
+        /// do it.
+        static Measurement runMain(mlir::ModuleOp module, double cutoffSeconds = 0,
+                                   const std::function<void(double)> &armWatchdog = nullptr);
+
+    protected:
+        Measurement executeLoweredModule(const std::string &loweredModule) override;
+};
+
+#endif // MLSCEDULER_EVALUATION_BY_JIT_H_
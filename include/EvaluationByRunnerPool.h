@@ -0,0 +1,68 @@
+//===----------------------- EvaluationByRunnerPool.h ---------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the EvaluationByRunnerPool class,
+/// which contains an evaluator of the transformed code that executes the
+/// lowered candidates on a pool of persistent runner worker processes
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_EVALUATION_BY_RUNNER_POOL_H_
+#define MLSCEDULER_EVALUATION_BY_RUNNER_POOL_H_
+
+#include "EvaluationByExecution.h"
+#include "EvaluationScheduler.h"
+#include "RunnerPool.h"
+
+#include <memory>
+
+using namespace mlir;
+class EvaluationByRunnerPool : public EvaluationByExecution {
+    private:
+        std::shared_ptr<RunnerPool> pool;
+        std::shared_ptr<EvaluationScheduler> scheduler;
+
+        /// Looks the transformed module up in the cache under the first of
+        /// the cache keys (none when the cache is off), then lowers it to the
+        /// LLVM dialect on a worker of the lowering pool. Returns true with the
+        /// cached measurement if the transformed or the lowered module was
+        /// already evaluated (or with the TimedOut, LoweringFailed or Crashed
+        /// measurement of a lowering that did not succeed), otherwise gives
+        /// the printed lowered module and adds its cache key.
+        bool lowerToString(Node *node, const std::string &transformedModule, std::string &loweredModule,
+                           std::vector<std::string> &cacheKeys, Measurement &cached);
+
+    public:
+        /// Creates an evaluator on top of the process-wide pool, the pool is
+        /// started on first use with AS_RUNNER_WORKERS workers (1 by default),
+        /// or with one pinned worker per slot when AS_EVAL_SLOTS is set.
+        EvaluationByRunnerPool(std::string LogsFileName);
+
+        /// Returns the pool shared by all the evaluators of the process.
+        static std::shared_ptr<RunnerPool> getSharedPool();
+        /// Returns the pool of workers lowering the candidates of every
+        /// evaluator of the process, one per compile thread (see
+        /// getCompileThreads), under the watchdog of the lowering timeout.
+        static std::shared_ptr<RunnerPool> getSharedLoweringPool();
+        /// Returns the scheduler of the shared pool.
+        static std::shared_ptr<EvaluationScheduler> getSharedScheduler();
+        /// Returns the number of threads lowering the candidates, read from
+        /// AS_COMPILE_THREADS (1 by default). When AS_EVAL_SLOTS is set, as many
+        /// cores are kept out of the measurement slots for these threads.
+        static int getCompileThreads();
+
+        /// Runs the evaluation as a two stages pipeline: the compile threads
+        /// have the next candidates lowered by the lowering pool while the
+        /// slots of the pool measure the previous ones, the lowered modules go
+        /// through a bounded queue. With
+        /// the MachineCalibration on, the candidates of a batch during which
+        /// the machine drifted that are close to its fastest one are lowered
+        /// and measured again.
+        void evaluateTransformations(llvm::ArrayRef<Node *> nodes) override;
+
+    protected:
+        Measurement executeLoweredModule(const std::string &loweredModule) override;
+};
+
+#endif // MLSCEDULER_EVALUATION_BY_RUNNER_POOL_H_
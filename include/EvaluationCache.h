@@ -0,0 +1,60 @@
+//===----------------------- EvaluationCache.h ----------------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the EvaluationCache class, which
+/// contains the process-wide cache of the measurements, keyed by a hash of the
+/// printed IR of the candidates, so that candidates reaching the same code
+/// through different transformations are lowered and executed only once
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_EVALUATION_CACHE_H_
+#define MLSCEDULER_EVALUATION_CACHE_H_
+
+#include "Measurement.h"
+
+#include "mlir/IR/Operation.h"
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class EvaluationCache {
+    private:
+        std::unordered_map<std::string, Measurement> entries;
+        std::mutex mutex;
+        bool enabled;
+        int hits;
+        int misses;
+
+        EvaluationCache();
+
+    public:
+        /// Returns the cache shared by all the evaluators of the process, it can
+        /// be disabled with AS_EVAL_CACHE=0. When AS_SCHEDULE_DB is set, the
+        /// misses are looked up in the persistent ScheduleDatabase.
+        static EvaluationCache &get();
+
+        /// Returns the key of a module: the SHA1 of its printed form. Printing
+        /// gives the same text for structurally identical modules whatever the
+        /// transformations that produced them.
+        static std::string getKey(mlir::Operation *op);
+        static std::string getKey(const std::string &printedModule);
+
+        bool isEnabled();
+        /// Copies the measurement cached for the key, returns false on a miss.
+        /// A candidate is looked up under its transformed module first, then
+        /// under its lowered module (firstKey false): the miss is counted once
+        /// and only the first key is looked up in the persistent database.
+        bool lookup(const std::string &key, Measurement &measurement, bool firstKey = true);
+        /// Caches the measurement if it succeeded, it is also stored in the
+        /// persistent database when the schedule that produced the module is
+        /// given.
+        void insert(const std::string &key, const Measurement &measurement, const std::string &schedule = "");
+
+        int getHits();
+        int getMisses();
+};
+
+#endif // MLSCEDULER_EVALUATION_CACHE_H_
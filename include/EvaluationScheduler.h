@@ -0,0 +1,71 @@
+//===----------------------- EvaluationScheduler.h ------------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the EvaluationScheduler class, which
+/// contains a scheduler that runs several lowered candidates at once on the
+/// pinned workers of a RunnerPool, one candidate per slot of cores, and
+/// reduces the number of concurrent slots when it detects that concurrent
+/// measurements interfere with each other
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_EVALUATION_SCHEDULER_H_
+#define MLSCEDULER_EVALUATION_SCHEDULER_H_
+
+#include "RunnerPool.h"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class EvaluationScheduler {
+    private:
+        std::shared_ptr<RunnerPool> pool;
+        /// Number of candidates measured at the same time.
+        int activeSlots;
+        /// Accepted slowdown of the reference candidate when it runs next to
+        /// other candidates before the number of active slots is halved.
+        double interferenceTolerance;
+        /// Lowered module used to detect interference and its time when it was
+        /// measured alone on the machine.
+        std::string referenceModule;
+        double referenceSoloTime;
+        std::mutex mutex;
+
+        /// Runs the reference candidate concurrently with the given modules and
+        /// shrinks the active slots if it got slower than when measured alone.
+        void checkInterference(double concurrentReferenceTime);
+
+    public:
+        /// Creates a scheduler using every worker of the pool as a slot, the
+        /// tolerance is read from AS_INTERFERENCE_TOLERANCE (0.05 by default).
+        EvaluationScheduler(std::shared_ptr<RunnerPool> pool);
+
+        /// Returns the cores the tuner is allowed to run on.
+        static std::vector<int> getAllowedCores();
+        /// Splits the cores the tuner is allowed to run on into numSlots
+        /// disjoint slots of the same size, the last reservedCores cores are
+        /// left out of the slots for the compilation threads.
+        static std::vector<std::vector<int>> partitionCores(int numSlots, int reservedCores = 0);
+        /// Returns the cores left out of the slots by partitionCores.
+        static std::vector<int> getReservedCores(int reservedCores);
+
+        int getActiveSlots();
+
+        /// Runs the lowered modules, up to getActiveSlots() at the same time, and
+        /// returns their measurements in the same order. Empty modules
+        /// (candidates whose lowering failed) get a failed measurement.
+        std::vector<Measurement> runAll(const std::vector<std::string> &loweredModules);
+
+        /// Same as above, the lowered modules are pulled from nextModule as the
+        /// slots become free, nextModule blocks until a module is ready and
+        /// returns false when there are no more. Each module comes with its
+        /// index in the returned measurements.
+        std::vector<Measurement> runAll(size_t numModules,
+                                        const std::function<bool(size_t &index, std::string &loweredModule)> &nextModule);
+};
+
+#endif // MLSCEDULER_EVALUATION_SCHEDULER_H_
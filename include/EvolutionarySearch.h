@@ -0,0 +1,68 @@
+//===----------------------- EvolutionarySearch.h -------------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the EvolutionarySearch class, which
+/// contains a definition of a genetic search method over the transformation
+/// lists of the nodes, for the spaces too large to be enumerated
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_EVOLUTIONARY_SEARCH_H_
+#define MLSCEDULER_EVOLUTIONARY_SEARCH_H_
+
+#include "SearchMethod.h"
+#include "SearchSpace.h"
+#include "Node.h"
+#include "EvaluationByExecution.h"
+
+#include <random>
+
+using namespace mlir;
+class EvolutionarySearch : public SearchMethod{
+    private:
+        using Gene = SearchSpace::Gene;
+        using Genome = SearchSpace::Genome;
+
+        struct Individual {
+            Genome genome;
+            Node *node;
+        };
+
+        mlir::MLIRContext *context;
+        std::string functionName;
+        SearchSpace space;
+        int populationSize;
+        int generations;
+        int numThreads;
+        std::mt19937 generator;
+
+        /// Decodes the genomes on numThreads threads and evaluates the nodes
+        /// as one batch.
+        std::vector<Individual> evaluate(Node *root, std::vector<Genome> &genomes, EvaluationByExecution *evaluator);
+        /// Fastest of EVOLUTION_TOURNAMENT individuals drawn at random.
+        const Individual &select(const std::vector<Individual> &population);
+        /// Prefix of the first genome followed by the suffix of the second,
+        /// cut at the same stage boundary.
+        Genome crossover(const Genome &first, const Genome &second);
+        /// Moves a tile size to a neighbouring divisor of its extent, swaps
+        /// two entries of an interchange or toggles the vectorization.
+        void mutate(Genome &genome);
+
+    public:
+        /// Creates a search of the given number of generations of populationSize
+        /// schedules, the random schedules go through the depth steps of the
+        /// SearchSpace and are decoded by numThreads threads (0 for one per
+        /// core).
+        EvolutionarySearch(mlir::MLIRContext *context, std::string functionName, int populationSize, int generations,
+                           int depth = 3, int numThreads = 0);
+
+        /// Runs the search from a root already evaluated and returns the
+        /// fastest node. The first population is seeded with the fastest
+        /// schedules of the ScheduleDatabase for the problem and completed with
+        /// random ones, each generation keeps the EVOLUTION_ELITES fastest
+        /// individuals and breeds the others from tournament winners.
+        Node * runSearchMethod(Node * root) override;
+};
+
+#endif // MLSCEDULER_EVOLUTIONARY_SEARCH_H_
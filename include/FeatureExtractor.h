@@ -0,0 +1,64 @@
+//===----------------------- FeatureExtractor.h ---------------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the FeatureExtractor class, which
+/// contains the description of a transformed module as a fixed-width vector
+/// of numbers: its loop nests, the tiles and accesses of its main operation
+/// and its vector shapes, used by the cost models and the logged datasets
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_FEATURE_EXTRACTOR_H_
+#define MLSCEDULER_FEATURE_EXTRACTOR_H_
+
+#include "mlir/Dialect/Linalg/IR/Linalg.h"
+#include "mlir/IR/Operation.h"
+
+#include <string>
+#include <vector>
+
+/// Loop levels around the main operation described by the features.
+#define FEATURE_LOOP_LEVELS 6
+/// Iteration dimensions of the main operation described by the features.
+#define FEATURE_DIMS 7
+/// Operands of the main operation described by the features.
+#define FEATURE_OPERANDS 3
+
+using namespace mlir;
+class FeatureExtractor {
+    public:
+        /// One induction variable of a loop around an operation.
+        struct LoopLevel {
+            /// True for the induction variables of an scf.forall.
+            bool parallel;
+            /// Number of iterations, 1 when the bounds are not constant.
+            double tripCount;
+        };
+
+        /// Loop levels around the operation in its function, outermost first.
+        static llvm::SmallVector<LoopLevel, 8> getLoopLevels(mlir::Operation *op);
+        /// Extent of each loop of the linalg operation, dynamic extents count
+        /// as AS_HARNESS_DYNAMIC_SIZE like in the generated harness.
+        static llvm::SmallVector<int64_t> getLoopExtents(mlir::linalg::LinalgOp linalgOp);
+        /// Width of the elements of the type (or of the type itself) in bits.
+        static double getElementBits(mlir::Type type);
+        /// Bytes of the operand touched by one execution of the linalg
+        /// operation with the given loop extents.
+        static double getOperandFootprint(mlir::linalg::LinalgOp linalgOp, mlir::OpOperand &operand,
+                                          llvm::ArrayRef<int64_t> extents);
+
+        /// Walks the module once and returns getNames().size() features:
+        /// counts of the loops and operations, the roofline estimate, then for
+        /// the main operation (the one with the most work, linalg or vector)
+        /// the fused producers in its loop nest, the trip count and kind of
+        /// each loop level around it, the extent of each of its dimensions and
+        /// whether it is a reduction, the footprint per tile and innermost
+        /// stride of each operand, and the vector shapes. Counts and sizes are
+        /// given as log2(1 + x), missing levels as 0.
+        static std::vector<float> extract(mlir::Operation *module);
+        /// Names of the features, in the order of extract.
+        static const std::vector<std::string> &getNames();
+};
+
+#endif // MLSCEDULER_FEATURE_EXTRACTOR_H_
@@ -0,0 +1,45 @@
+//===----------------------- HarnessGenerator.h ---------------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the HarnessGenerator class, which
+/// contains the synthesis of the benchmark harness of a bare kernel: the
+/// `main` that allocates and initializes the inputs, warms the kernel up,
+/// times a loop of calls and prints a checksum of the results
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_HARNESS_GENERATOR_H_
+#define MLSCEDULER_HARNESS_GENERATOR_H_
+
+#include "mlir/Dialect/Func/IR/FuncOps.h"
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/Support/LogicalResult.h"
+
+using namespace mlir;
+class HarnessGenerator {
+    public:
+        /// True when the module has no `main` to run, it then needs a harness.
+        static bool needsHarness(mlir::ModuleOp module);
+
+        /// Returns the function named by AS_KERNEL, or the first function with
+        /// a body that contains linalg operations.
+        static mlir::func::FuncOp findKernel(mlir::ModuleOp module);
+
+        /// Adds a `main` that calls the kernel on inputs allocated with a
+        /// deterministic content (out of the timed region), runs it
+        /// AS_HARNESS_WARMUP times (1 by default), then times
+        /// AS_HARNESS_REPETITIONS calls (1 by default) and passes the mean time
+        /// of a call to printFlops. The arguments the kernel writes are
+        /// initialized again before each call, out of the timed interval. An
+        /// element of every result is added to a checksum printed after the
+        /// time, so that the calls are not removed. The dynamic dimensions of
+        /// the kernel arguments are specialized to AS_HARNESS_DYNAMIC_SIZE (128
+        /// by default) in the kernel itself. In the cold measurement mode, the
+        /// caches are flushed and a single call is timed. Fails when an
+        /// argument type is not a ranked tensor, an identity memref, an
+        /// integer, an index or a float.
+        static mlir::LogicalResult generate(mlir::ModuleOp module, mlir::func::FuncOp kernel);
+};
+
+#endif // MLSCEDULER_HARNESS_GENERATOR_H_
@@ -0,0 +1,96 @@
+//===----------------------- LockFreeQueue.h ------------------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the LockFreeQueue class, which
+/// contains a bounded multi-producer multi-consumer queue that never blocks:
+/// pushing to a full queue or popping from an empty one fails at once
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_LOCK_FREE_QUEUE_H_
+#define MLSCEDULER_LOCK_FREE_QUEUE_H_
+
+#include <atomic>
+#include <memory>
+
+template <typename T>
+class LockFreeQueue {
+    private:
+        /// The sequence of a cell tells whose turn it is: a producer when it
+        /// equals the position, a consumer when it equals the position + 1.
+        struct Cell {
+            std::atomic<size_t> sequence;
+            T item;
+        };
+
+        std::unique_ptr<Cell[]> cells;
+        size_t mask;
+        alignas(64) std::atomic<size_t> enqueuePos;
+        alignas(64) std::atomic<size_t> dequeuePos;
+
+    public:
+        /// The capacity is rounded up to a power of two.
+        LockFreeQueue(size_t capacity) : enqueuePos(0), dequeuePos(0)
+        {
+            size_t size = 2;
+            while (size < capacity)
+                size *= 2;
+            cells.reset(new Cell[size]);
+            mask = size - 1;
+            for (size_t i = 0; i < size; ++i)
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        /// Adds an item, returns false if the queue is full.
+        bool tryPush(T item)
+        {
+            size_t pos = enqueuePos.load(std::memory_order_relaxed);
+            while (true)
+            {
+                Cell &cell = cells[pos & mask];
+                size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+                if (diff == 0)
+                {
+                    if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        cell.item = std::move(item);
+                        cell.sequence.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                    return false;
+                else
+                    pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        /// Removes the oldest item, returns false if the queue is empty.
+        bool tryPop(T &item)
+        {
+            size_t pos = dequeuePos.load(std::memory_order_relaxed);
+            while (true)
+            {
+                Cell &cell = cells[pos & mask];
+                size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+                if (diff == 0)
+                {
+                    if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        item = std::move(cell.item);
+                        cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                    return false;
+                else
+                    pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+};
+
+#endif // MLSCEDULER_LOCK_FREE_QUEUE_H_
@@ -0,0 +1,92 @@
+//===----------------------- LoweringPipeline.h ---------------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the LoweringPipeline class, which
+/// contains the lowering of the candidates down to the LLVM dialect: the
+/// vector lowering transform library is parsed once per context and the pass
+/// pipeline is built once, then both are reused for every candidate. Their
+/// states belong to the context they were built for and are released with it
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_LOWERING_PIPELINE_H_
+#define MLSCEDULER_LOWERING_PIPELINE_H_
+
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/IR/MLIRContext.h"
+#include "mlir/IR/OwningOpRef.h"
+#include "mlir/Pass/PassManager.h"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace mlir;
+class LoweringPipeline {
+    private:
+        /// Pass manager of one run at a time, with the deadline its deadline
+        /// passes check.
+        struct Instance {
+            std::unique_ptr<mlir::PassManager> passManager;
+            std::chrono::steady_clock::time_point deadline;
+        };
+
+        /// Transform library and idle pass managers of one context.
+        struct ContextState {
+            mlir::OwningOpRef<mlir::ModuleOp> library;
+            mlir::Operation *entryPoint = nullptr;
+            std::vector<std::unique_ptr<Instance>> idleInstances;
+        };
+
+        std::string name;
+        std::mutex mutex;
+        std::unordered_map<mlir::MLIRContext *, ContextState> contexts;
+
+        LoweringPipeline(const std::string &name);
+        /// Parses the transform library of the context on its first use.
+        ContextState &getContextState(mlir::MLIRContext *context);
+        std::unique_ptr<Instance> createInstance(mlir::MLIRContext *context);
+
+    public:
+        /// Returns the pipeline with the given name, or nullptr if there is
+        /// none. The variants are "default" and "sequential" (parallel loops
+        /// are not converted to OpenMP).
+        static LoweringPipeline *get(const std::string &name);
+        /// Returns the pipeline selected by AS_LOWERING_PIPELINE, "default"
+        /// when it is not set or unknown.
+        static LoweringPipeline *getDefault();
+        static std::vector<std::string> getNames();
+
+        const std::string &getName() const;
+
+        /// Drops the transform library and the pass managers of the context
+        /// in every pipeline, they must not outlive it.
+        static void releaseContext(mlir::MLIRContext *context);
+
+        /// Releases the states of a context when it goes out of scope, it is
+        /// declared right after the context by its owner.
+        class ContextScope {
+            private:
+                mlir::MLIRContext *context;
+
+            public:
+                ContextScope(mlir::MLIRContext *context) : context(context) {}
+                ~ContextScope() { releaseContext(context); }
+        };
+
+        /// Lowers the module in place down to the LLVM dialect (vector
+        /// lowerings, bufferization, SCF to OpenMP, conversion to LLVM). Fails
+        /// when the transform library fails, and at the next stage once
+        /// timeoutSeconds are spent, timedOut then tells the timeout apart from
+        /// the other failures. A stage that never ends is not stopped, the
+        /// runner workers lower the candidates under their watchdog (see
+        /// RunnerPool::lower). Can be called from several threads, each run
+        /// takes its own pass manager.
+        mlir::LogicalResult run(mlir::Operation *op, double timeoutSeconds, bool *timedOut = nullptr);
+};
+
+#endif // MLSCEDULER_LOWERING_PIPELINE_H_
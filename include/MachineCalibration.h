@@ -0,0 +1,73 @@
+//===----------------------- MachineCalibration.h -------------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the MachineCalibration class, which
+/// contains the tracking of the speed of the machine during the tuning: a
+/// fixed reference kernel is timed periodically, the drift of its time
+/// (frequency scaling, turbo) is used to rescale the measurements to the
+/// conditions of the start of the tuning
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_MACHINE_CALIBRATION_H_
+#define MLSCEDULER_MACHINE_CALIBRATION_H_
+
+#include "Measurement.h"
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class MachineCalibration {
+    private:
+        /// Time of the reference kernel at the first check.
+        double baselineTime;
+        /// Time of the reference kernel at the last check divided by the
+        /// baseline.
+        double drift;
+        double minDrift;
+        double maxDrift;
+        int numChecks;
+        int numRemeasured;
+        std::string governor;
+        std::string turbo;
+        std::chrono::steady_clock::time_point lastCheck;
+        std::mutex mutex;
+
+        MachineCalibration();
+        /// Median time of a few runs of the reference kernel, the calling
+        /// thread is pinned to the given cores meanwhile (if any).
+        static double timeReference(const std::vector<int> &cores);
+
+    public:
+        /// Returns the calibration of the machine, or nullptr unless
+        /// AS_CALIBRATION is set to 1. Warns when the cpufreq governor is not
+        /// "performance" or turbo is enabled.
+        static MachineCalibration *get();
+
+        /// Times the reference kernel on the given cores (where the calling
+        /// thread runs when empty) and returns the new drift. The first check
+        /// sets the baseline, the cores should be the same for every check.
+        double check(const std::vector<int> &cores = {});
+        /// Same as check when AS_CALIBRATION_INTERVAL_S seconds (60 by
+        /// default) passed since the last check or nothing was checked yet,
+        /// returns the current drift otherwise.
+        double update(const std::vector<int> &cores = {});
+        double getDrift();
+
+        /// True when the drift moved by more than AS_DRIFT_TOLERANCE (0.05 by
+        /// default) between two checks.
+        static bool hasShifted(double before, double after);
+        /// Rescales a measurement taken under the given drift to the
+        /// conditions of the baseline.
+        static void normalize(Measurement &measurement, double drift);
+        /// Counts the batches measured again because of a drift.
+        void addRemeasured();
+
+        /// Governor, turbo and drift statistics for the tuning report.
+        std::string summary();
+};
+
+#endif // MLSCEDULER_MACHINE_CALIBRATION_H_
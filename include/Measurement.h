@@ -0,0 +1,135 @@
+//===----------------------- Measurement.h --------------------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the Measurement class, which
+/// contains the execution times collected for one candidate, the statistics
+/// reported for them (median, min, spread, confidence interval) and the
+/// significance test the search uses to accept a new best candidate
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_MEASUREMENT_H_
+#define MLSCEDULER_MEASUREMENT_H_
+
+#include "ResultRecord.h"
+
+#include "llvm/ADT/ArrayRef.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class Node;
+
+class Measurement {
+    private:
+        ResultStatus status;
+        /// Execution times in seconds.
+        std::vector<double> samples;
+        /// Hardware counters read around the timed region, in the order of
+        /// PerfCounters::Counter.
+        std::vector<uint64_t> counters;
+
+    public:
+        Measurement();
+        Measurement(ResultStatus status);
+
+        ResultStatus getStatus() const;
+        void setStatus(ResultStatus status);
+        void addSample(double seconds);
+        /// Multiplies the samples by the factor.
+        void scale(double factor);
+        const std::vector<double> &getSamples() const;
+        int getNumSamples() const;
+        void addCounter(uint64_t value);
+        const std::vector<uint64_t> &getCounters() const;
+        /// The candidate failed if its status is not Ok or it has no samples.
+        bool isFailed() const;
+
+        double getMedian() const;
+        double getMin() const;
+        double getMean() const;
+        double getStdDev() const;
+        /// Spread of the samples relative to the median, (max - min) / median.
+        double getSpread() const;
+        /// Half width of the 95% confidence interval of the mean relative to
+        /// the mean.
+        double getRelativeConfidence() const;
+
+        /// Returns the evaluation string used by the search: the median in
+        /// seconds, or "9000000000000000000" if the candidate failed.
+        std::string toEvaluation() const;
+        /// One line summary (median, min, spread, repetitions) for the logs.
+        std::string summary() const;
+
+        /// Binary record sent by the runners, samples and counters past the
+        /// capacity of the record are dropped.
+        ResultRecord toRecord() const;
+        /// Returns a Crashed measurement if the record is not valid.
+        static Measurement fromRecord(const ResultRecord &record);
+
+        /// Runs the kernel until the confidence interval of its mean is below
+        /// AS_CI_TARGET (0.02 by default) or the time budget AS_TIME_BUDGET_MS
+        /// (1000 ms by default) is spent, with at least AS_MIN_REPETITIONS (3)
+        /// and at most AS_MAX_REPETITIONS (50) runs; a kernel slower than the
+        /// budget runs once. runOnce returns the time of one run in seconds,
+        /// or a negative value if the run failed, the measurement then has the
+        /// RunFailed status. A run slower than cutoffSeconds (when not 0) ends
+        /// the measurement with the Censored status.
+        static Measurement measure(const std::function<double()> &runOnce, double cutoffSeconds = 0);
+
+        /// Returns the longest a run may take before it is stopped: the
+        /// AS_RUN_TIMEOUT_MS timeout (60 s by default), lowered to
+        /// AS_CUTOFF_FACTOR (10 by default, 0 disables it) times the best time
+        /// recorded since the last resetBestTime.
+        static double getRunCutoff();
+        /// Returns the timeout of the lowering and of the JIT compilation of
+        /// a candidate, AS_LOWERING_TIMEOUT_MS (60 s by default).
+        static double getLoweringTimeout();
+        /// Returns the time budget of the repetitions of a candidate in seconds.
+        static double getTimeBudget();
+        /// Returns the measurement mode AS_MEASUREMENT_MODE: "warm" (the
+        /// default) runs the kernel on inputs already in the caches, "cold"
+        /// flushes the caches before each timed run. Measurements taken in
+        /// different modes are not compared (see ScheduleDatabase).
+        static std::string getMode();
+        /// Returns the number of untimed runs done before the repetitions by
+        /// the evaluators that run the kernel in-process, AS_WARMUP_RUNS (1 by
+        /// default).
+        static int getWarmupRuns();
+
+        /// Keeps the measurement of the node, the evaluation string of the node
+        /// only holds the median. Also updates the best time used by the
+        /// cutoff, unless the node was marked as reduced.
+        static void record(Node *node, const Measurement &measurement);
+        /// The measurements recorded for the node do not change the best time
+        /// used by the cutoff (copies of the candidates on a reduced problem).
+        static void markReduced(Node *node);
+        /// Drops the measurement recorded for the node and its mark, called
+        /// before the node is deleted.
+        static void forget(Node *node);
+        /// Forgets the best time used by the cutoff, called when the measured
+        /// times change meaning (a new problem, or the timers moved to another
+        /// stage).
+        static void resetBestTime();
+        /// Copies the measurement recorded for the node, returns false if there
+        /// is none.
+        static bool lookup(Node *node, Measurement &measurement);
+        /// Returns the median time recorded for the node, infinity for failed
+        /// candidates. Nodes evaluated before the measurements were recorded
+        /// fall back to their evaluation string.
+        static double getTime(Node *node);
+        /// Sorts the nodes from the fastest to the slowest.
+        static void sortByTime(llvm::MutableArrayRef<Node *> nodes);
+
+        /// True when the candidate is faster than the best with a one-sided
+        /// Welch t-test at the 95% level. Falls back to comparing the medians
+        /// when one of them has fewer than two samples.
+        static bool isSignificantlyFaster(const Measurement &candidate, const Measurement &best);
+        /// Same test on the measurements recorded for the nodes, compares their
+        /// evaluation strings when a node has no recorded measurement.
+        static bool isSignificantlyFaster(Node *candidate, Node *best);
+};
+
+#endif // MLSCEDULER_MEASUREMENT_H_
@@ -0,0 +1,93 @@
+//===----------------------- MonteCarloTreeSearch.h -----------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the MonteCarloTreeSearch class,
+/// which contains a definition of the Monte Carlo tree search method, the
+/// stages are revisited as long as the budget allows it instead of being
+/// committed to once
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_MONTE_CARLO_TREE_SEARCH_H_
+#define MLSCEDULER_MONTE_CARLO_TREE_SEARCH_H_
+
+#include "SearchMethod.h"
+#include "SearchSpace.h"
+#include "Node.h"
+#include "EvaluationByExecution.h"
+
+#include "llvm/ADT/DenseMap.h"
+
+#include <random>
+
+using namespace mlir;
+class MonteCarloTreeSearch : public SearchMethod{
+    private:
+        /// Statistics of a node of the tree.
+        struct Statistics {
+            /// Level of the step following the node in the SearchSpace.
+            int level = 0;
+            int visits = 0;
+            /// Descents of the current round going through the node, they
+            /// count as visits without reward so that the workers spread.
+            int virtualLoss = 0;
+            /// Best reward (inverse time) observed in the subtree.
+            double bestReward = 0;
+            bool expanded = false;
+            llvm::SmallVector<Node *, 2> children;
+            /// Last nodes of the measured playouts of the node, they are not
+            /// part of the tree but are printed with its children.
+            llvm::SmallVector<Node *, 2> playouts;
+        };
+
+        mlir::MLIRContext *context;
+        std::string functionName;
+        SearchSpace space;
+        int iterations;
+        int numWorkers;
+        std::string rollout;
+        double exploration;
+        std::mt19937 generator;
+        llvm::DenseMap<Node *, Statistics> tree;
+        Node *root;
+
+        /// Upper confidence bound of the child, the rewards are normalized by
+        /// the best reward of the tree.
+        double getScore(Node *child, Node *parent);
+        /// Child of the node with the highest bound, the unvisited children
+        /// come first.
+        Node *selectChild(Node *node);
+        /// Descends from the root to an unvisited node, a node to expand or a
+        /// leaf of the space, and returns the path.
+        SmallVector<Node *, 8> descend();
+        /// Creates the children of the node for the first step from level
+        /// that applies to it and sets the level after that step.
+        SmallVector<Node *, 2> expand(Node *node, int &level);
+        /// Applies random steps (or the steps with the lowest predicted time
+        /// when useModel) from the node down to the end of the space and
+        /// returns the last node, the node itself when no step applies. The
+        /// nodes left on the way are freed.
+        Node *playout(Node *node, int level, unsigned seed, bool useModel);
+        /// Sets the children nodes of the node to its children in the tree
+        /// followed by its measured playouts (for printing the tree).
+        void updateChildrenNodes(Node *node);
+
+    public:
+        /// Creates a search of iterations descents through the depth steps of
+        /// the SearchSpace. Each round runs numWorkers descents (0 for one per
+        /// core) whose candidates are evaluated as one batch. The rollouts are
+        /// scored by "execution" or by the "model" (the CostModel, once it is
+        /// warm). exploration is the constant of the confidence bound.
+        MonteCarloTreeSearch(mlir::MLIRContext *context, std::string functionName, int iterations, int depth = 3,
+                             int numWorkers = 0, std::string rollout = "execution", double exploration = 1.4);
+
+        /// Runs the search from a root already evaluated and returns the
+        /// fastest measured node. Each descent selects children by their upper
+        /// confidence bound on the best reward of their subtree, expands a new
+        /// node, measures it and plays it out to the end of the space, the best
+        /// of the two rewards is backpropagated up to the root.
+        Node * runSearchMethod(Node * root) override;
+};
+
+#endif // MLSCEDULER_MONTE_CARLO_TREE_SEARCH_H_
@@ -0,0 +1,72 @@
+//===----------------------- MultiFidelity.h ------------------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the MultiFidelity class, which
+/// contains the screening of the candidates on a reduced problem: every
+/// candidate is first measured with its outermost tiled loops shortened, and
+/// only the fastest ones are measured on the full problem
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_MULTI_FIDELITY_H_
+#define MLSCEDULER_MULTI_FIDELITY_H_
+
+#include "EvaluationByExecution.h"
+#include "Node.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+
+#include <string>
+#include <vector>
+
+using namespace mlir;
+class MultiFidelity {
+    private:
+        /// Share of the iterations of the outermost loops kept in the reduced
+        /// problem.
+        double fraction;
+        /// Share of the screened candidates measured on the full problem.
+        double promoted;
+        /// Times on the reduced problem of the candidates promoted by the last
+        /// screen.
+        llvm::DenseMap<Node *, double> reducedTimes;
+        std::vector<double> correlations;
+        int numScreened;
+        int numPromoted;
+
+        MultiFidelity(double fraction, double promoted);
+
+    public:
+        /// Returns the multi-fidelity screen, or nullptr unless AS_FIDELITY
+        /// (the share of the iterations kept, 0.25 for a quarter) is between 0
+        /// and 1. AS_FIDELITY_PROMOTE (0.25 by default) is the share of the
+        /// candidates promoted to the full problem.
+        static MultiFidelity *get();
+
+        /// Shortens in place the outermost scf.forall and scf.for loops around
+        /// the linalg and vector computations of the module to the given share
+        /// of their iterations. Whole iterations are removed, so the tiles stay
+        /// the same and keep dividing the iteration space, and parallel loops
+        /// keep at least one iteration per core. Returns false when the module
+        /// has no loop to shorten.
+        static bool reduce(mlir::Operation *module, double fraction);
+
+        /// Measures reduced copies of the nodes with the evaluator and returns
+        /// the promoted ones with the lowest times, the other nodes are given
+        /// the failed evaluation. Nodes without a loop to shorten are always
+        /// returned. The reduced times do not lower the run cutoff.
+        llvm::SmallVector<Node *, 2> screen(llvm::ArrayRef<Node *> nodes, EvaluationByExecution *evaluator);
+
+        /// Compares the reduced and full times of the promoted nodes once they
+        /// are measured and prints their Spearman rank correlation.
+        void update(llvm::ArrayRef<Node *> nodes);
+
+        /// Screened and promoted candidates and mean rank agreement for the
+        /// tuning report.
+        std::string summary();
+};
+
+#endif // MLSCEDULER_MULTI_FIDELITY_H_
@@ -0,0 +1,45 @@
+//===----------------------- ObjectCache.h --------------------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the ObjectCache class, which
+/// contains an on-disk cache of the machine code generated by the JIT for the
+/// lowered candidates, keyed by the hash of the lowered module and of the
+/// code generation options
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_OBJECT_CACHE_H_
+#define MLSCEDULER_OBJECT_CACHE_H_
+
+#include "mlir/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <memory>
+#include <string>
+
+class ObjectCache {
+    private:
+        std::string directory;
+
+        ObjectCache(const std::string &directory);
+        std::string getPath(const std::string &key);
+
+    public:
+        /// Returns the cache stored in the AS_OBJECT_CACHE directory, or nullptr
+        /// when the variable is not set.
+        static ObjectCache *get();
+
+        /// Returns the key of a lowered module compiled with the given options:
+        /// the hexadecimal SHA1 of both.
+        static std::string getKey(const std::string &loweredModule, const std::string &codegenOptions);
+
+        /// Returns the object file stored for the key, or nullptr.
+        std::unique_ptr<llvm::MemoryBuffer> load(const std::string &key);
+        /// Stores the object generated by the engine, it must have been created
+        /// with enableObjectDump and have compiled the module (a lookup of one
+        /// of its functions). An empty object is not stored.
+        void store(const std::string &key, mlir::ExecutionEngine &engine);
+};
+
+#endif // MLSCEDULER_OBJECT_CACHE_H_
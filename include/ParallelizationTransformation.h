@@ -60,9 +60,12 @@ class Parallelization: public Transformation{
         std::string getType() override;
         /// Creates a list of tiling transformation candidates for the given CodeIR object.
         /// Overrides the createCandidates() method from the base class Transformation.
+        /// When TileCombinations is given, one candidate is created for each of
+        /// its tile sizes instead of the enumerated ones.
         static SmallVector<Node* , 2>  createParallelizationCandidates(Node *node, mlir::MLIRContext *context,
                                                                         int CurrentStage,
-                                                                        SmallVector<mlir::linalg::LinalgOp, 4> LinalgOpStages);
+                                                                        SmallVector<mlir::linalg::LinalgOp, 4> LinalgOpStages,
+                                                                        SmallVector<SmallVector<int64_t, 4>, 4> TileCombinations = {});
 
         llvm::SmallVector<int64_t, 4>  getTileSizes();
         int getOperationStage();
@@ -0,0 +1,66 @@
+//===----------------------- PerfCounters.h -------------------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the PerfCounters class, which
+/// contains the Linux hardware performance counters (perf_event_open) of the
+/// thread that runs the timed region of a kernel, they tell why a candidate is
+/// slow (cache or TLB misses, few vector instructions, low IPC)
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_PERF_COUNTERS_H_
+#define MLSCEDULER_PERF_COUNTERS_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+/// Value of a counter the machine or the kernel settings do not provide.
+#define PERF_COUNTER_UNAVAILABLE UINT64_MAX
+
+class PerfCounters {
+    public:
+        /// Counters in the order they are stored in a Measurement.
+        enum Counter {
+            Cycles = 0,
+            Instructions,
+            L1DMisses,
+            LLCMisses,
+            DTLBMisses,
+            /// Raw event given by AS_PERF_VECTOR_EVENT (e.g. 0x1fc7 for the
+            /// retired packed floating point operations of Intel cores),
+            /// there is no generic event for it.
+            VectorInstructions,
+            NumCounters
+        };
+
+    private:
+        int fds[NumCounters];
+
+        PerfCounters();
+
+    public:
+        ~PerfCounters();
+
+        /// Returns the counters of the calling thread, opened on its first
+        /// call, or nullptr when AS_PERF_COUNTERS is 0 or none of them can be
+        /// opened (see perf_event_paranoid). They count the events of that
+        /// thread only, not those of the OpenMP workers it starts.
+        static PerfCounters *get();
+
+        /// Resets and starts the counters.
+        void start();
+        /// Stops the counters and returns their values, scaled when the
+        /// kernel multiplexed them, PERF_COUNTER_UNAVAILABLE for the counters
+        /// that could not be opened.
+        std::vector<uint64_t> stop();
+
+        static const char *getName(int counter);
+        /// Counters of a measurement with their names and the derived IPC for
+        /// the logs, empty when there are none.
+        static std::string summary(const std::vector<uint64_t> &counters);
+};
+
+#endif // MLSCEDULER_PERF_COUNTERS_H_
@@ -0,0 +1,79 @@
+//===----------------------- RegionTiming.h -------------------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the timing instrumentation of the
+/// tuned code: the tuner inserts the nanoTime and printFlops calls around the
+/// operation being tuned itself, so that a schedule is scored on that
+/// operation only and modules without a hand-written harness can be tuned
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_REGION_TIMING_H_
+#define MLSCEDULER_REGION_TIMING_H_
+
+#include "mlir/Dialect/Func/IR/FuncOps.h"
+#include "mlir/IR/Builders.h"
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/IR/Operation.h"
+#include "mlir/Support/LogicalResult.h"
+
+#include <string>
+
+/// Attribute of the operation whose loop nest is timed, it can also be set in
+/// the input module to pick the operation to time.
+#define TIMED_REGION_ATTR "as.timed_region"
+/// Attribute of the operations inserted by timeRegion.
+#define TIMER_ATTR "as.timer"
+/// Global buffer streamed through by the cache flushes.
+#define FLUSH_BUFFER "__as_flush_buffer"
+/// Functions called right before the first nanoTime call of a timed region
+/// and right after the last one. They are empty in the module, the JIT
+/// evaluators replace them to read the hardware counters over the region.
+#define COUNTERS_START "__as_counters_start"
+#define COUNTERS_STOP "__as_counters_stop"
+
+/// Returns the nanoTime and printFlops functions of the module, declares the
+/// ones it does not have.
+void declareTimerFunctions(mlir::ModuleOp module, mlir::func::FuncOp &nanoTime, mlir::func::FuncOp &printFlops);
+
+/// Calls the counter hooks around the region timed by the nanoTime calls
+/// start and end, the hooks are defined in the module when missing. The calls
+/// are tagged like the timers.
+void insertCounterHooks(mlir::func::CallOp start, mlir::func::CallOp end);
+
+/// Calls the counter hooks around every region timed by the input module (the
+/// nanoTime calls subtracted from one another).
+void hookInputTimers(mlir::Operation *module);
+
+/// Inserts at the insertion point of the builder a streaming pass over a
+/// buffer twice the size of the last level cache (AS_FLUSH_BYTES overrides
+/// it), which evicts the data of the kernel. The inserted operations are
+/// tagged like the timers.
+void insertCacheFlush(mlir::OpBuilder &builder, mlir::Location loc);
+
+/// In the cold measurement mode, inserts a cache flush before every timed
+/// region of the module (the nanoTime calls that start a region).
+void flushBeforeTimers(mlir::Operation *module);
+
+/// Returns AS_TIMED_REGION: "" (the default) keeps the timing of the input
+/// module, "stage" times the operation of the current stage, and an index
+/// times that operation of getLinalgOps during the whole search.
+std::string getTimedRegionMode();
+
+/// Times the loop nest of the function that contains op: the nanoTime calls
+/// are inserted before and after it and their difference is passed to
+/// printFlops. The timers of a previous region and the printFlops calls of
+/// the input module are removed, the nanoTime calls of the input module are
+/// replaced by zeros, the missing declarations are added.
+mlir::LogicalResult timeRegion(mlir::Operation *op);
+
+/// True when op (or the operation it was tiled from) is the timed operation.
+bool isTimedRegion(mlir::Operation *op);
+
+/// Times the operation picked by AS_TIMED_REGION (see getTimedRegionMode) for
+/// the given stage, or the operation tagged with TIMED_REGION_ATTR in the
+/// input module. Returns false when nothing was instrumented.
+bool instrumentTimedRegion(mlir::Operation *module, int stage);
+
+#endif // MLSCEDULER_REGION_TIMING_H_
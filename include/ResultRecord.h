@@ -0,0 +1,51 @@
+//===----------------------- ResultRecord.h -------------------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the ResultRecord structure, the
+/// fixed size binary record a runner writes back to the tuner on its result
+/// pipe, separate from the output of the kernel
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_RESULT_RECORD_H_
+#define MLSCEDULER_RESULT_RECORD_H_
+
+#include <stdint.h>
+
+#define RESULT_RECORD_MAGIC 0x41535252 // "ASRR"
+#define RESULT_RECORD_MAX_SAMPLES 256
+#define RESULT_RECORD_MAX_COUNTERS 8
+
+/// Outcome of the evaluation of a candidate.
+enum class ResultStatus : uint32_t {
+    Ok = 0,
+    /// The candidate could not be lowered to the LLVM dialect.
+    LoweringFailed = 1,
+    /// The module could not be compiled or its main failed.
+    RunFailed = 2,
+    /// The kernel ran but never called printFlops.
+    NoTiming = 3,
+    /// The runner died while running the kernel.
+    Crashed = 4,
+    /// The lowering or the compilation went past its timeout.
+    TimedOut = 5,
+    /// The run was stopped at the cutoff, the only sample is a lower bound of
+    /// the execution time.
+    Censored = 6,
+};
+
+struct ResultRecord {
+    uint32_t magic;
+    ResultStatus status;
+    uint32_t numSamples;
+    uint32_t numCounters;
+    /// Set when the runner exits right after writing the record (its
+    /// watchdog stopped the run), the tuner then reaps and replaces it.
+    uint32_t exiting;
+    /// Execution times in seconds.
+    double samples[RESULT_RECORD_MAX_SAMPLES];
+    uint64_t counters[RESULT_RECORD_MAX_COUNTERS];
+};
+
+#endif // MLSCEDULER_RESULT_RECORD_H_
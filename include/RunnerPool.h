@@ -0,0 +1,93 @@
+//===----------------------- RunnerPool.h ---------------------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the RunnerPool class, which
+/// contains a pool of long-lived runner worker processes, the workers are
+/// started once, keep their shared libraries and JIT infrastructure loaded
+/// and execute the lowered candidates they receive over a pipe
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_RUNNER_POOL_H_
+#define MLSCEDULER_RUNNER_POOL_H_
+
+#include "Measurement.h"
+
+#include "mlir/IR/MLIRContext.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+/// Command line flag the tuner binary is re-executed with to become a worker.
+#define RUNNER_WORKER_FLAG "--runner-worker"
+
+class RunnerPool {
+    private:
+        struct Worker {
+            pid_t pid = -1;
+            int toWorker = -1;
+            int fromWorker = -1;
+            /// Cores the worker and its OpenMP threads are pinned to, empty
+            /// when the worker is not pinned.
+            std::vector<int> cpus;
+        };
+
+        std::vector<Worker> workers;
+        std::vector<int> idleWorkers;
+        std::mutex mutex;
+        std::condition_variable workerAvailable;
+
+        /// Requests a worker is sent: the lowering of a transformed module or
+        /// the measurement of a lowered one.
+        enum class RequestKind : uint32_t { Lower = 0, Run = 1 };
+
+        /// Sends the request to the first idle worker and returns the
+        /// measurement it writes back, blocks while all workers are busy. The
+        /// worker is respawned when it crashes, does not answer within timeout
+        /// seconds or exits after its watchdog fired. The lowered module that
+        /// follows a successful lowering is stored in reply.
+        Measurement request(RequestKind kind, double cutoff, const std::string &module, double timeout,
+                            std::string *reply);
+        /// Starts (or restarts) the worker at the given index.
+        bool spawnWorker(int index);
+        /// Kills the worker at the given index and reaps it.
+        void killWorker(int index);
+
+    public:
+        /// Starts numWorkers runner workers that are not pinned.
+        RunnerPool(int numWorkers);
+        /// Starts one runner worker per slot, each worker is pinned to the cores
+        /// of its slot and runs its OpenMP threads on them (OMP_NUM_THREADS and
+        /// OMP_PLACES are set to the slot).
+        RunnerPool(const std::vector<std::vector<int>> &slots);
+        ~RunnerPool();
+
+        int getNumWorkers();
+
+        /// Executes a module lowered to the LLVM dialect on the first idle worker
+        /// and returns its measurement, blocks while all workers are busy.
+        /// A worker that crashes or does not answer in time is respawned and
+        /// the measurement is failed, a run longer than
+        /// Measurement::getRunCutoff() is stopped and censored.
+        Measurement run(const std::string &loweredModule);
+        /// Lowers a transformed module to the LLVM dialect on the first idle
+        /// worker (see LoweringPipeline) and returns Ok with the lowered
+        /// module. A lowering longer than Measurement::getLoweringTimeout() is
+        /// stopped by the watchdog of the worker and TimedOut, a lowering
+        /// that fails or crashes the worker is LoweringFailed or Crashed.
+        ResultStatus lower(const std::string &transformedModule, std::string &loweredModule);
+
+        /// Main loop of a worker process: reads the requests from readFd,
+        /// lowers the transformed modules or runs the lowered ones with the
+        /// in-process JIT, under a watchdog, and writes back the serialized
+        /// measurements (and lowered modules) to writeFd until the tuner
+        /// closes the pipe.
+        static int runWorker(mlir::MLIRContext &context, int readFd, int writeFd);
+};
+
+#endif // MLSCEDULER_RUNNER_POOL_H_
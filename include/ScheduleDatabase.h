@@ -0,0 +1,108 @@
+//===----------------------- ScheduleDatabase.h ---------------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the ScheduleDatabase class, which
+/// contains a persistent database of the evaluated schedules shared by the
+/// tuning runs (and the concurrent tuning jobs) of a machine. Records are
+/// appended to a log file and found through a memory-mapped open addressing
+/// index, both files are protected by flock
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_SCHEDULE_DATABASE_H_
+#define MLSCEDULER_SCHEDULE_DATABASE_H_
+
+#include "Measurement.h"
+
+#include "mlir/IR/Operation.h"
+
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+
+class ScheduleDatabase {
+    private:
+        std::string path;
+        std::string indexPath;
+        int dataFd;
+        int indexFd;
+        /// Mapping of the index file and the inode it was mapped from, another
+        /// job that grows the index replaces the file.
+        char *index;
+        size_t indexSize;
+        ino_t indexInode;
+        /// Hash of the hardware fingerprint and of the problem being tuned.
+        std::string problemKey;
+        std::mutex mutex;
+
+        ScheduleDatabase(const std::string &path);
+
+        bool lock(bool exclusive);
+        void unlock();
+        /// Maps the current index file, resets it if it is missing or damaged
+        /// (needs the exclusive lock), the records are then indexed again by
+        /// refreshIndex.
+        bool mapIndex(bool exclusive);
+        void unmapIndex();
+        /// Brings the index up to date with the records of the log file (needs
+        /// the exclusive lock), returns false if it is not up to date and the
+        /// lock is shared.
+        bool refreshIndex(bool exclusive);
+        /// Writes a new index with the given capacity and replaces the current
+        /// one with it.
+        bool growIndex(uint64_t capacity);
+        bool findSlot(const std::string &key, uint64_t &offset);
+        /// Returns false if the index is full and could not grow.
+        bool insertSlot(const std::string &key, uint64_t offset);
+        bool readRecord(uint64_t offset, std::string &problem, std::string &schedule, Measurement &measurement);
+
+        /// Key of a candidate: the hash of the problem key and of the key of the
+        /// candidate in the EvaluationCache.
+        std::string getRecordKey(const std::string &candidateKey);
+
+    public:
+        ~ScheduleDatabase();
+
+        /// Returns the database opened from the AS_SCHEDULE_DB path, or nullptr
+        /// when the variable is not set or the file cannot be opened.
+        static ScheduleDatabase *get();
+
+        /// Describes the machine: cpu model, number of cpus and cache sizes.
+        static std::string getHardwareFingerprint();
+        /// Describes the problem: the linalg operations of the module with the
+        /// types (shapes and element types) of their operands.
+        static std::string getProblemSignature(mlir::Operation *module);
+
+        /// Returns the schedule of the node, its transformations printed one
+        /// after the other.
+        static std::string getSchedule(Node *node);
+
+        /// Describes how the candidates are measured: the evaluator, the
+        /// slots and workers of the pool and the threads of the kernels.
+        static std::string getEvaluationConfiguration();
+        /// True for the outcomes that may not happen again (Crashed, TimedOut
+        /// and Censored), they are not stored.
+        static bool isTransient(const Measurement &measurement);
+
+        /// Sets the problem the following lookups and inserts refer to, the
+        /// measurement mode (see Measurement::getMode) and the evaluation
+        /// configuration are part of the problem.
+        void setProblem(const std::string &problemSignature);
+
+        /// Copies the measurement stored for the candidate, returns false if the
+        /// candidate was never evaluated on this machine.
+        bool lookup(const std::string &candidateKey, Measurement &measurement);
+        /// Appends the measurement of the candidate and its schedule, unless
+        /// the outcome is transient.
+        void insert(const std::string &candidateKey, const std::string &schedule, const Measurement &measurement);
+
+        /// Returns the schedules stored for the current problem on this machine
+        /// with their measurements, to seed a search.
+        std::vector<std::pair<std::string, Measurement>> getSchedules();
+};
+
+#endif // MLSCEDULER_SCHEDULE_DATABASE_H_
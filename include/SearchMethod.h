@@ -18,6 +18,7 @@ class SearchMethod {
     private:
         
     public:
+        virtual ~SearchMethod() = default;
         virtual Node * runSearchMethod(Node * root) = 0;
 };
 
@@ -0,0 +1,99 @@
+//===----------------------- SearchSpace.h --------------------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the SearchSpace class, which
+/// contains the sequence of transformation steps the search methods explore:
+/// the parallelization of the main operation, the tiling of the operations
+/// and the vectorization, each step creates the children of a node
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_SEARCH_SPACE_H_
+#define MLSCEDULER_SEARCH_SPACE_H_
+
+#include "Node.h"
+#include "TilingTransformation.h"
+#include "ParallelizationTransformation.h"
+#include "VectorizationTransformation.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace mlir;
+class SearchSpace {
+    public:
+        enum class Step { Parallelization, Tiling, Vectorization };
+
+        /// A transformation of a schedule. Genes without tile sizes are
+        /// given random ones when they are applied, the extents of the loops
+        /// of the transformed operation are filled in at that time.
+        struct Gene {
+            Step step;
+            SmallVector<int64_t, 4> tileSizes;
+            std::vector<unsigned> interchange;
+            SmallVector<int64_t, 4> extents;
+        };
+        using Genome = std::vector<Gene>;
+
+    private:
+        mlir::MLIRContext *context;
+        std::vector<Step> steps;
+
+    public:
+        /// Creates a space of depth steps: the first parallelizes, the last
+        /// vectorizes and the ones in between tile one more operation each.
+        /// A depth below 3 drops the tiling, then the parallelization. It must
+        /// be created before the threads that expand the nodes start.
+        SearchSpace(mlir::MLIRContext *context, int depth);
+
+        int getDepth();
+        Step getStep(int level);
+        static std::string getStepName(Step step);
+
+        /// Creates the children of the node for the step of the level, none
+        /// when the step does not apply to the node (no operation left to
+        /// tile, nothing to parallelize). The parallelization targets the
+        /// last operation of the module, the tiling the last operation not
+        /// yet in an scf.for, possibly under the scf.forall of the
+        /// parallelization. Nodes of different levels may be expanded by
+        /// different threads at the same time: the dialects are loaded when
+        /// the space is created and the transform interpreter and pass
+        /// manager runs of the candidates are serialized by getContextMutex.
+        llvm::SmallVector<Node *, 2> expand(Node *node, int level);
+
+        /// Operation of the node the step transforms, with its stage in
+        /// getLinalgOps, nullptr when the step does not apply to the node.
+        /// The vectorization targets the whole module, the last operation is
+        /// returned for it.
+        mlir::Operation *getTarget(Node *node, Step step, int &stage);
+        /// Creates the child of the node for the step with the given tile
+        /// sizes and interchange (unused by the vectorization), nullptr when
+        /// the step does not apply to the node.
+        Node *apply(Node *node, Step step, llvm::ArrayRef<int64_t> tileSizes, llvm::ArrayRef<unsigned> interchange);
+
+        /// Tile sizes of a loop of the given extent for the step, in the
+        /// ranges of the candidates of the transformations.
+        static SmallVector<int64_t, 4> getDivisors(int64_t extent, Step step);
+        /// Index of the divisor closest to the size.
+        static size_t getNearestDivisor(int64_t size, llvm::ArrayRef<int64_t> divisors);
+
+        /// Frees a node that is not kept by the search, its IR and its
+        /// recorded measurement.
+        static void eraseNode(Node *node);
+
+        /// Returns the genome of the transformations of a schedule printed by
+        /// ScheduleDatabase::getSchedule.
+        static Genome parseSchedule(const std::string &schedule);
+        /// Applies the genes one after the other to the root and returns the
+        /// last node, the intermediate nodes are erased. The tile sizes are
+        /// repaired to divisors of the extents (and to the 2 to rank - 1
+        /// loops of the parallelization candidates), the genes that do not
+        /// apply are dropped from the genome. A genome whose genes all have
+        /// tile sizes and valid interchanges is decoded the same way every
+        /// time.
+        Node *decode(Node *root, Genome &genome, std::mt19937 &generator);
+};
+
+#endif // MLSCEDULER_SEARCH_SPACE_H_
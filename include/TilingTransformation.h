@@ -47,9 +47,13 @@ class Tiling: public Transformation{
         llvm::SmallVector<int64_t, 4> getTilingSizes();
         /// Creates a list of tiling transformation candidates for the given CodeIR object.
         /// Overrides the createCandidates() method from the base class Transformation.
+        /// When TileSizes (and InterchangeVector) are given, the candidate uses
+        /// them instead of sampled ones.
         static SmallVector<Node* , 2>  createTilingCandidates(Node *node, mlir::MLIRContext *context,
                                                                         int CurrentStage,
-                                                                        SmallVector<mlir::linalg::LinalgOp, 4> LinalgOpStages);
+                                                                        SmallVector<mlir::linalg::LinalgOp, 4> LinalgOpStages,
+                                                                        SmallVector<int64_t, 4> TileSizes = {},
+                                                                        std::vector<unsigned> InterchangeVector = {});
 
         mlir::scf::SCFTilingOptions getOptions();
         int getOperationStage();
@@ -0,0 +1,74 @@
+//===----------------------- TuningLogger.h -------------------------------===//
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declaration of the TuningLogger class, which
+/// contains the writer of the tuning logs: records are queued without
+/// blocking and written as JSON lines by a background thread
+///
+//===----------------------------------------------------------------------===//
+#ifndef MLSCEDULER_TUNING_LOGGER_H_
+#define MLSCEDULER_TUNING_LOGGER_H_
+
+#include "LockFreeQueue.h"
+#include "Measurement.h"
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TuningLogger {
+    public:
+        /// Which candidates get their code in the logs (AS_LOG_IR).
+        enum class IRMode { None, Best, All };
+
+    private:
+        std::string fileName;
+        FILE *file;
+        bool compressed;
+        LockFreeQueue<std::string> queue;
+        std::atomic<bool> stopping;
+        std::atomic<uint64_t> dropped;
+        std::atomic<double> bestTime;
+        std::thread writer;
+
+        TuningLogger(const std::string &fileName);
+        /// Body of the background thread, writes the queued records until the
+        /// logger is destroyed.
+        void writeRecords();
+
+    public:
+        ~TuningLogger();
+
+        /// Returns the logger of the given file, or nullptr when AS_VERBOSE is
+        /// not 1. The first record of the file holds the names of the
+        /// features. With AS_LOG_COMPRESS=1 the records are gzip-compressed
+        /// into fileName + ".gz".
+        static TuningLogger *get(const std::string &fileName);
+        /// AS_LOG_IR: "none", "best" (the default, only the code of the
+        /// candidates improving on the best time) or "all".
+        static IRMode getIRMode();
+
+        /// Queues one record, it is dropped (and counted) when the queue is
+        /// full, the caller never waits for the disk.
+        void log(std::string record);
+        /// True when the time improves on every time logged before, the
+        /// code of the candidate is then logged with IRMode::Best.
+        bool isNewBest(double seconds);
+
+        /// Builds the record of an evaluation: the schedule, the status and
+        /// statistics of the measurement, its counters, the features of the
+        /// candidate (see FeatureExtractor) and optionally its code.
+        static std::string getEvaluationRecord(const std::string &schedule, const Measurement &measurement,
+                                               bool best, const std::string &code = "",
+                                               const std::vector<float> &features = {});
+        /// Builds the record of a candidate's code before its evaluation.
+        static std::string getCodeRecord(const std::string &schedule, const std::string &code);
+
+        uint64_t getDropped() const;
+};
+
+#endif // MLSCEDULER_TUNING_LOGGER_H_
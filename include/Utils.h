@@ -10,6 +10,7 @@
 #include "mlir/Parser/Parser.h"
 
 #include <iostream>
+#include <mutex>
 #include <regex>
 #include <string>
 #include <vector>
@@ -63,4 +64,16 @@ llvm::SmallVector<mlir::OpFoldResult> getMixedSizes(llvm::ArrayRef<int64_t> tile
 
 mlir::LogicalResult TagSCFForAll(mlir::Operation *Target, std::string tag);
 mlir::LogicalResult TagOperation(mlir::Operation *Target, std::string tag);
+
+/// Loads every dialect registered in the context, so that the threads that
+/// share it never load one lazily.
+void preloadDialects(mlir::MLIRContext *context);
+/// Held around the parsing of the transform scripts, the transform interpreter
+/// and the pass manager runs on a context shared by several threads, they may
+/// load dialects or append extensions to its registry.
+std::mutex &getContextMutex();
+
+/// Value of the environment variable, the default when it is not set.
+double getEnvDouble(const char *name, double defaultValue);
+int getEnvInt(const char *name, int defaultValue);
 #endif // MLSCHEDULER_UTILS_H_
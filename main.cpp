@@ -32,13 +32,26 @@
 
 // Include custom headers
 #include "Node.h"
+#include "AnalyticalEvaluation.h"
+#include "CostModel.h"
 #include "EvaluationByExecution.h"
+#include "EvaluationCache.h"
+#include "HarnessGenerator.h"
+#include "LoweringPipeline.h"
+#include "MachineCalibration.h"
+#include "MultiFidelity.h"
+#include "ScheduleDatabase.h"
+#include "RegionTiming.h"
+#include "RunnerPool.h"
 #include "TilingTransformation.h"
 #include "InterchangeTransformation.h"
 #include "ParallelizationTransformation.h"
 #include "VectorizationTransformation.h"
 #include "MLIRCodeIR.h"
 #include "BeamSearch.h"
+#include "MonteCarloTreeSearch.h"
+#include "EvolutionarySearch.h"
+#include "BayesianOptimization.h"
 #include "mlir/Tools/mlir-opt/MlirOptMain.h"
 #include <optional>
 #include "mlir/Dialect/Transform/IR/TransformInterfaces.h"
@@ -75,6 +88,73 @@ namespace OptimizationEnum
   };
 }
 SmallVector<Node *, 2> func1(Node *root, int stage, SmallVector<mlir::linalg::LinalgOp, 4> linalgOps, mlir::MLIRContext *context, OptimizationEnum::Optimization optimization);
+
+static llvm::cl::opt<std::string> inputFileOption(llvm::cl::Positional, llvm::cl::desc("<input file>"), llvm::cl::Required);
+static llvm::cl::opt<std::string> searchOption("search", llvm::cl::desc("Search method: greedy (default), beam, mcts, evolution or bayes"),
+                                               llvm::cl::init("greedy"));
+static llvm::cl::opt<int> beamWidthOption("beam-width", llvm::cl::desc("Nodes kept at each level of the beam search"),
+                                          llvm::cl::init(3));
+static llvm::cl::opt<int> beamDepthOption("beam-depth", llvm::cl::desc("Transformation steps of the beam search"),
+                                          llvm::cl::init(3));
+static llvm::cl::opt<int> mctsIterationsOption("mcts-iterations", llvm::cl::desc("Descents of the Monte Carlo tree search"),
+                                               llvm::cl::init(64));
+static llvm::cl::opt<int> mctsDepthOption("mcts-depth", llvm::cl::desc("Transformation steps of the Monte Carlo tree search"),
+                                          llvm::cl::init(3));
+static llvm::cl::opt<std::string> mctsRolloutOption("mcts-rollout", llvm::cl::desc("Scoring of the rollouts: execution (default) or model"),
+                                                    llvm::cl::init("execution"));
+static llvm::cl::opt<double> mctsExplorationOption("mcts-exploration", llvm::cl::desc("Exploration constant of the upper confidence bound"),
+                                                   llvm::cl::init(1.4));
+static llvm::cl::opt<int> populationOption("evolution-population", llvm::cl::desc("Schedules of a generation of the evolutionary search"),
+                                           llvm::cl::init(16));
+static llvm::cl::opt<int> generationsOption("evolution-generations", llvm::cl::desc("Generations of the evolutionary search"),
+                                            llvm::cl::init(8));
+static llvm::cl::opt<int> evolutionDepthOption("evolution-depth", llvm::cl::desc("Transformation steps of the random schedules of the evolutionary search"),
+                                               llvm::cl::init(3));
+static llvm::cl::opt<int> bayesEvaluationsOption("bayes-evaluations", llvm::cl::desc("Schedules measured by the Bayesian optimization"),
+                                                 llvm::cl::init(64));
+static llvm::cl::opt<int> bayesBatchOption("bayes-batch", llvm::cl::desc("Schedules acquired at once by the Bayesian optimization"),
+                                           llvm::cl::init(8));
+static llvm::cl::opt<int> bayesDepthOption("bayes-depth", llvm::cl::desc("Transformation steps of the schedule tuned by the Bayesian optimization"),
+                                           llvm::cl::init(3));
+static llvm::cl::opt<int> searchThreadsOption("search-threads", llvm::cl::desc("Threads expanding the evolutionary, Bayesian and tree searches and parallel descents of the tree search (0 for one per core)"),
+                                              llvm::cl::init(0));
+
+/// With AS_TIMED_REGION=stage, moves the timers of the node around the
+/// operation of the stage and measures the node again, so that the candidates
+/// of the stage are compared with it on that operation only.
+static bool timeStage(Node *node, int stage, EvaluationByExecution *evaluator)
+{
+  if (getTimedRegionMode() != "stage")
+    return false;
+  mlir::Operation *target = ((mlir::Operation *)(*((MLIRCodeIR *)node->getTransformedCodeIr())).getIr());
+  SmallVector<mlir::linalg::LinalgOp, 4> ops = getLinalgOps(target);
+  if (stage >= (int)ops.size() || isTimedRegion(ops[stage]) || mlir::failed(timeRegion(ops[stage])))
+    return false;
+  // The times of the other stages do not bound the runs of this one
+  Measurement::resetBestTime();
+  node->setEvaluation(evaluator->evaluateTransformation(node));
+  return true;
+}
+/// Evaluates the candidates of a step, the ones ranked last by the roofline
+/// model (AS_ANALYTICAL_SCREEN), then by the learned cost model
+/// (AS_COST_MODEL), then on the reduced problem (AS_FIDELITY) are not
+/// measured on the full problem. The cost model learns from the full
+/// measurements.
+static void evaluateCandidates(llvm::ArrayRef<Node *> candidates, EvaluationByExecution *evaluator)
+{
+  SmallVector<Node *, 2> selected = AnalyticalEvaluation::screen(candidates);
+  CostModel *costModel = CostModel::get();
+  if (costModel != nullptr)
+    selected = costModel->select(selected);
+  MultiFidelity *fidelity = MultiFidelity::get();
+  if (fidelity != nullptr)
+    selected = fidelity->screen(selected, evaluator);
+  evaluator->evaluateTransformations(selected);
+  if (costModel != nullptr)
+    costModel->update(selected);
+  if (fidelity != nullptr)
+    fidelity->update(selected);
+}
 SmallVector<Node *, 2> func1(Node *root, int stage, SmallVector<mlir::linalg::LinalgOp, 4> linalgOps, mlir::MLIRContext *context, OptimizationEnum::Optimization optimization)
 {
   SmallVector<Node *, 2> list;
@@ -249,6 +329,39 @@ void insertFunction(mlir::ModuleOp &moduleOp, mlir::Operation *funcToInsert,
   // Insert the function to be inserted
   builder.insert(funcToInsert);
 }
+/// Writes the explored tree to benchmark_exhustiveEval_<name>.json and prints
+/// the statistics of the tuning.
+static void writeResults(Node *root, const std::string &functionName)
+{
+  // Prepare the output JSON string
+  std::ostringstream outputStringStream;
+  outputStringStream << "{ \"name\" : \"" + functionName + "\" , \"evaluations\": [\n";
+
+  // Print the schedule information to the output string
+  root->printSchedule(outputStringStream);
+  outputStringStream << "]\n}]}";
+
+  // Convert the output string to JSON and write it to a file
+  std::string outputString = outputStringStream.str();
+  std::ofstream outputFile("./benchmark_exhustiveEval_" + functionName + ".json");
+  if (!outputFile.is_open())
+  {
+    std::cout << "Failed to open file: " << std::endl;
+  }
+  outputFile << outputString;
+  outputFile.close();
+
+  // Display a message indicating the end of exploration
+  std::cout << "Evaluation cache: " << EvaluationCache::get().getHits() << " hits, "
+            << EvaluationCache::get().getMisses() << " misses" << std::endl;
+  if (CostModel *costModel = CostModel::get())
+    std::cout << costModel->summary() << std::endl;
+  if (MultiFidelity *fidelity = MultiFidelity::get())
+    std::cout << fidelity->summary() << std::endl;
+  if (MachineCalibration *calibration = MachineCalibration::get())
+    std::cout << calibration->summary() << std::endl;
+  std::cout << "End of exploration!" << std::endl;
+}
 int main(int argc, char **argv)
 {
   // Check if the correct number of command-line arguments is provided
@@ -258,13 +371,6 @@ int main(int argc, char **argv)
     return 1; // Indicate an error
   }
 
-  // Extract the input filename and function name from command-line arguments
-  llvm::StringRef inputFilename = argv[1];
-  std::string inputFilenameString = argv[1];
-  std::string extractedSubstring = inputFilenameString.substr(inputFilenameString.find_last_of('/') + 1);
-  size_t dotIndex = extractedSubstring.find('.');
-  std::string functionName = extractedSubstring.substr(0, dotIndex);
-
   // Create an instance of the MLIRCodeIR class
   MLIRCodeIR codeIr;
   // mlir::test::registerTestTransformDialectInterpreterPass();
@@ -272,9 +378,22 @@ int main(int argc, char **argv)
   mlir::registerAsmPrinterCLOptions();
   mlir::registerMLIRContextCLOptions();
   mlir::registerPassManagerCLOptions();
+  // Runner workers are given their pipes instead of the options
+  bool runnerWorker = argc >= 4 && std::string(argv[1]) == RUNNER_WORKER_FLAG;
+  if (!runnerWorker)
+    llvm::cl::ParseCommandLineOptions(argc, argv, "MLIR auto-scheduler\n");
 
-  // Create an MLIR context
+  // Extract the input filename and function name from command-line arguments
+  llvm::StringRef inputFilename = inputFileOption;
+  std::string inputFilenameString = inputFileOption;
+  std::string extractedSubstring = inputFilenameString.substr(inputFilenameString.find_last_of('/') + 1);
+  size_t dotIndex = extractedSubstring.find('.');
+  std::string functionName = extractedSubstring.substr(0, dotIndex);
+
+  // Create an MLIR context, the lowering pipelines built for it are released
+  // before it is destroyed
   mlir::MLIRContext context;
+  LoweringPipeline::ContextScope loweringScope(&context);
 
   // Create a dialect registry and register necessary dialects
   DialectRegistry registry;
@@ -300,6 +419,11 @@ int main(int argc, char **argv)
   context.loadDialect<vector::VectorDialect>();
   context.loadDialect<mlir::transform::TransformDialect>();
 
+  // Runner worker mode: the pool of EvaluationByRunnerPool re-executes the
+  // tuner with this flag and sends it the lowered candidates to run
+  if (runnerWorker)
+    return RunnerPool::runWorker(context, std::stoi(argv[2]), std::stoi(argv[3]));
+
   mlir::OwningOpRef<mlir::ModuleOp> moduleFromFile;
   mlir::ModuleOp transformModule =
       transform::detail::getPreloadedTransformModule(&context);
@@ -319,18 +443,49 @@ int main(int argc, char **argv)
 
   // Create a root Node for transformations
   Node *root = new Node(&codeIr, 0);
-  EvaluationByExecution evaluator = EvaluationByExecution(functionName + "_logs_best_exhustive_debug_single_op_vect_all.txt");
+  std::unique_ptr<EvaluationByExecution> evaluator = EvaluationByExecution::create(functionName + "_logs_best_exhustive_debug_single_op_vect_all.txt");
 
   // Evaluate the root transformation
-  /*std::string RootEvel = evaluator.evaluateTransformation(root);
+  /*std::string RootEvel = evaluator->evaluateTransformation(root);
   root->setEvaluation(RootEvel);
   BeamSearch* searcher = new BeamSearch(3, &context, functionName);
   Node * res = searcher->runSearchMethod(root);*/
 
   // Initialize an evaluator for transformation evaluations
   // EvaluationByExecution evaluator =  EvaluationByExecution(functionName+"_logs_best.txt");
+
+  // A bare kernel without a main gets a generated harness, it specializes the
+  // dynamic shapes of the kernel before the operations are collected
+  mlir::ModuleOp tunedModule = mlir::cast<mlir::ModuleOp>((mlir::Operation *)codeIr.getIr());
+  bool harnessGenerated = HarnessGenerator::needsHarness(tunedModule);
+  if (harnessGenerated)
+  {
+    mlir::func::FuncOp kernel = HarnessGenerator::findKernel(tunedModule);
+    if (!kernel || mlir::failed(HarnessGenerator::generate(tunedModule, kernel)))
+    {
+      llvm::errs() << "No kernel to build a harness for in " << inputFilename << "\n";
+      return 1;
+    }
+  }
   SmallVector<mlir::linalg::LinalgOp, 4> linalgOps = getLinalgOps(module1.get());
 
+  // The tuner inserts the timers around the tuned operation itself when
+  // AS_TIMED_REGION asks for it or the input module tags one, the nodes work
+  // on the copy of the module held by codeIr. The regions timed by the input
+  // module itself get their counter hooks, and their cache flush in the cold
+  // mode, here
+  if (!instrumentTimedRegion((mlir::Operation *)codeIr.getIr(), 0) && !harnessGenerated)
+  {
+    flushBeforeTimers((mlir::Operation *)codeIr.getIr());
+    hookInputTimers((mlir::Operation *)codeIr.getIr());
+  }
+
+  // Measurements of previous runs on the same problem and machine are reused,
+  // the cutoff only follows the times of this problem
+  if (ScheduleDatabase *database = ScheduleDatabase::get())
+    database->setProblem(ScheduleDatabase::getProblemSignature(module1.get()));
+  Measurement::resetBestTime();
+
   // Tile and Fuse for tensors inputs (TODO: all tensor operands).
   bool changed = false;
   int stage = 0;
@@ -339,11 +494,33 @@ int main(int argc, char **argv)
   bool found = false;
 
   // Evaluate the root transformation
-  std::string RootEvel = evaluator.evaluateTransformation(bestEval);
+  std::string RootEvel = evaluator->evaluateTransformation(bestEval);
   bestEval->setEvaluation(RootEvel);
   changed = true;
   stage = bestEval->getCurrentStage();
   std::cerr << "Number of opeartions = " << linalgOps.size() << std::endl;
+
+  // The search methods other than the default stage by stage search run
+  // from the evaluated root and share the printing of the results
+  std::unique_ptr<SearchMethod> searcher;
+  if (searchOption == "beam")
+    searcher = std::make_unique<BeamSearch>(beamWidthOption, &context, functionName, beamDepthOption);
+  else if (searchOption == "evolution")
+    searcher = std::make_unique<EvolutionarySearch>(&context, functionName, populationOption, generationsOption,
+                                                    evolutionDepthOption, searchThreadsOption);
+  else if (searchOption == "bayes")
+    searcher = std::make_unique<BayesianOptimization>(&context, functionName, bayesEvaluationsOption, bayesBatchOption,
+                                                      bayesDepthOption, searchThreadsOption);
+  else if (searchOption == "mcts")
+    searcher = std::make_unique<MonteCarloTreeSearch>(&context, functionName, mctsIterationsOption, mctsDepthOption,
+                                                      searchThreadsOption, mctsRolloutOption, mctsExplorationOption);
+  if (searcher)
+  {
+    bestEval = searcher->runSearchMethod(root);
+    std::cout << "Best schedule: " << ScheduleDatabase::getSchedule(bestEval) << " (" << Measurement::getTime(bestEval) << " s)" << std::endl;
+    writeResults(root, functionName);
+    return 0;
+  }
   IRRewriter rewriter(&context);
   SmallVector<Node *, 2> nodesToVect;
   while (stage < linalgOps.size() - 1)
@@ -361,6 +538,7 @@ int main(int argc, char **argv)
     mlir::Operation *newOp = ((mlir::Operation *)(*((MLIRCodeIR *)bestEval->getTransformedCodeIr()))
                                   .getIr());
     linalgOps = getLinalgOps(newOp);
+    timeStage(bestEval, stage, evaluator.get());
     int OpToVectStage = stage;
     auto start = std::chrono::high_resolution_clock::now();
     mlir::Operation *tagged = linalgOps[stage];
@@ -376,22 +554,16 @@ int main(int argc, char **argv)
     std::cout << "Time taken by candaidte generation: " << duration.count() << " microseconds" << std::endl;
     changed = false;
     bestEval->setChildrenNodes(optList);
+    // The candidates and their vectorized versions are evaluated together
+    // once they are all built, so that they can be measured concurrently
+    SmallVector<Node *, 2> toEvaluate;
     for (auto node : optList)
     {
       nodesToVect.push_back(node);
       auto start_node = std::chrono::high_resolution_clock::now();
 
       found = false;
-      std::string evel = evaluator.evaluateTransformation(node);
-      node->setEvaluation(evel);
-
-      if (std::stod(bestEval->getEvaluation()) > std::stod(evel))
-      {
-        std::cerr << "We changed the node\n";
-        bestEval = node;
-        stage = bestEval->getCurrentStage();
-        changed = true;
-      }
+      toEvaluate.push_back(node);
 
       // ## VECTORIZE ONE OP
       MLIRCodeIR *CodeIrVect = (MLIRCodeIR *)node->getTransformedCodeIr();
@@ -550,19 +722,7 @@ int main(int argc, char **argv)
 
       std::cout << "END VECT" << std::endl;
       //}
-      evel = evaluator.evaluateTransformation(VectNode);
-      VectNode->setEvaluation(evel);
-      if (std::stod(bestEval->getEvaluation()) > std::stod(evel))
-      {
-        std::cerr << "We changed the node" << std::endl;
-        bestEval = VectNode;
-        // MLIRCodeIR *CodeIrTEST = (MLIRCodeIR *)bestEval->getTransformedCodeIr();
-        // mlir::Operation *targetTEST = ((mlir::Operation *)(*CodeIrTEST)
-        //                                  .getIr());
-        // targetTEST->dump();
-        stage = bestEval->getCurrentStage();
-        changed = true;
-      }
+      toEvaluate.push_back(VectNode);
 
       /*ClonedOpVect->walk([&](mlir::Operation *op)
             {
@@ -745,6 +905,24 @@ int main(int argc, char **argv)
       // stage = 0;
     }
 
+    // A candidate replaces the best one only when it is significantly faster,
+    // not when it wins by the noise of the measurements
+    evaluateCandidates(toEvaluate, evaluator.get());
+    for (auto node : toEvaluate)
+    {
+      if (Measurement::isSignificantlyFaster(node, bestEval))
+      {
+        std::cerr << "We changed the node\n";
+        bestEval = node;
+        // MLIRCodeIR *CodeIrTEST = (MLIRCodeIR *)bestEval->getTransformedCodeIr();
+        // mlir::Operation *targetTEST = ((mlir::Operation *)(*CodeIrTEST)
+        //                                  .getIr());
+        // targetTEST->dump();
+        stage = bestEval->getCurrentStage();
+        changed = true;
+      }
+    }
+
     /*}
     else
     {
@@ -766,17 +944,16 @@ int main(int argc, char **argv)
     while (stage < linalgOps.size())
     {
       std::cerr << "STAGe = " << stage << std::endl;
+      timeStage(bestEval, stage, evaluator.get());
 
       if ((linalgOps[stage]->getParentOp()->getName().getStringRef()).str() != "scf.forall" && (linalgOps[stage]->getParentOp()->getName().getStringRef()).str() != "scf.for")
       {
         SmallVector<Node *, 2> optList1 = Tiling::createTilingCandidates(bestEval, &context, stage, linalgOps);
         changed = false;
+        evaluateCandidates(optList1, evaluator.get());
         for (auto node1 : optList1)
         {
-          std::string evel1 = evaluator.evaluateTransformation(node1);
-          node1->setEvaluation(evel1);
-
-          if (std::stod(bestEval->getEvaluation()) > std::stod(evel1))
+          if (Measurement::isSignificantlyFaster(node1, bestEval))
           {
             std::cerr << "We changed the node\n";
             bestEval = node1;
@@ -823,7 +1000,7 @@ int main(int argc, char **argv)
 
         for (auto node3 : list_vect)
         {
-          std::string evel2 = evaluator.evaluateTransformation(node3);
+          std::string evel2 = evaluator->evaluateTransformation(node3);
           node3->setEvaluation(evel2);
           if (std::stod(bestEval->getEvaluation()) > std::stod(evel2))
           {
@@ -840,7 +1017,7 @@ int main(int argc, char **argv)
   for (auto node : toExplore)
   {
     found = false;
-    std::string evel = evaluator.evaluateTransformation(node);
+    std::string evel = evaluator->evaluateTransformation(node);
     node->setEvaluation(evel);
 
     if (std::stod(bestEval->getEvaluation()) > std::stod(evel))
@@ -902,7 +1079,7 @@ int main(int argc, char **argv)
 
      for (auto node3 : list_vect1)
      {
-       std::string evel3 = evaluator.evaluateTransformation(node3);
+       std::string evel3 = evaluator->evaluateTransformation(node3);
        node3->setEvaluation(evel3);
        if (std::stod(bestEval->getEvaluation()) > std::stod(evel3))
        {
@@ -918,7 +1095,7 @@ int main(int argc, char **argv)
   bestEval->setChildrenNodes(toExploreSecond);
   for (auto node1 : toExploreSecond)
   {
-   std::string evel1 = evaluator.evaluateTransformation(node1);
+   std::string evel1 = evaluator->evaluateTransformation(node1);
    node1->setEvaluation(evel1);
 
    if (std::stod(bestEval->getEvaluation()) > std::stod(evel1))
@@ -975,7 +1152,7 @@ int main(int argc, char **argv)
 
     for (auto node3 : list_vect)
     {
-      std::string evel2 = evaluator.evaluateTransformation(node3);
+      std::string evel2 = evaluator->evaluateTransformation(node3);
       node3->setEvaluation(evel2);
       if (std::stod(bestEval->getEvaluation()) > std::stod(evel2))
       {
@@ -1001,7 +1178,7 @@ int main(int argc, char **argv)
       // Loop through the children nodes of the root
       for (auto ChildNode : ParaList)
       {
-        std::string evel = evaluator.evaluateTransformation(ChildNode);
+        std::string evel = evaluator->evaluateTransformation(ChildNode);
         ChildNode->setEvaluation(evel);
 
         if (std::stod(bestEval->getEvaluation()) > std::stod(evel))
@@ -1035,7 +1212,7 @@ int main(int argc, char **argv)
   /*for (auto node1 : list1)
   {
 
-    std::string evel = evaluator.evaluateTransformation(node1);
+    std::string evel = evaluator->evaluateTransformation(node1);
     node1->setEvaluation(evel);
 
     if (std::stod(bestEval->getEvaluation()) > std::stod(evel))
@@ -1057,7 +1234,7 @@ int main(int argc, char **argv)
   // Loop through the children nodes of the current node1
   /*for (auto node2 : list1)
   {
-    std::string evel1 = evaluator.evaluateTransformation(node2);
+    std::string evel1 = evaluator->evaluateTransformation(node2);
     node2->setEvaluation(evel1);
   */
 
@@ -1075,7 +1252,7 @@ int main(int argc, char **argv)
 
     for (auto node3 : list_vect)
     {
-      std::string evel2 = evaluator.evaluateTransformation(node3);
+      std::string evel2 = evaluator->evaluateTransformation(node3);
       node3->setEvaluation(evel2);
        if (std::stod(bestEval->getEvaluation()) > std::stod(evel2))
     {
@@ -1083,24 +1260,5 @@ int main(int argc, char **argv)
       bestEval = node3;
     }
     }*/
-  // Prepare the output JSON string
-  std::ostringstream outputStringStream;
-  outputStringStream << "{ \"name\" : \"" + functionName + "\" , \"evaluations\": [\n";
-
-  // Print the schedule information to the output string
-  root->printSchedule(outputStringStream);
-  outputStringStream << "]\n}]}";
-
-  // Convert the output string to JSON and write it to a file
-  std::string outputString = outputStringStream.str();
-  std::ofstream outputFile("./benchmark_exhustiveEval_" + functionName + ".json");
-  if (!outputFile.is_open())
-  {
-    std::cout << "Failed to open file: " << std::endl;
-  }
-  outputFile << outputString;
-  outputFile.close();
-
-  // Display a message indicating the end of exploration
-  std::cout << "End of exploration!" << std::endl;
+  writeResults(root, functionName);
 }
\ No newline at end of file
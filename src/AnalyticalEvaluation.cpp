@@ -0,0 +1,240 @@
+//===------------- AnalyticalEvaluation.cpp - AnalyticalEvaluation ---------===//
+//
+///===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implmentation of the AnalyticalEvaluation class, which
+/// contains an evaluator of the transformed code that estimates its execution
+/// time with a roofline model of the tiled loop nests
+///
+//===----------------------------------------------------------------------===//
+
+#include "AnalyticalEvaluation.h"
+#include "FeatureExtractor.h"
+#include "MLIRCodeIR.h"
+#include "RegionTiming.h"
+#include "Utils.h"
+
+#include "mlir/Dialect/Linalg/IR/Linalg.h"
+#include "mlir/Dialect/SCF/IR/SCF.h"
+#include "mlir/Dialect/Vector/IR/VectorOps.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include <unistd.h>
+
+/// Cost of starting the threads of one execution of an scf.forall.
+#define FORALL_OVERHEAD_SECONDS 5e-6
+
+/// The machine the estimates are made for.
+struct MachineModel {
+    double coreFlops;
+    double vectorBits;
+    double coreBandwidth;
+    double bandwidth;
+    double cacheBytes;
+    double cores;
+
+    MachineModel()
+    {
+        coreFlops = getEnvDouble("AS_CORE_GFLOPS", 32) * 1e9;
+        vectorBits = getEnvDouble("AS_VECTOR_BITS", 256);
+        coreBandwidth = getEnvDouble("AS_CORE_BANDWIDTH_GBS", 10) * 1e9;
+        bandwidth = getEnvDouble("AS_BANDWIDTH_GBS", 40) * 1e9;
+        long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+        cacheBytes = getEnvDouble("AS_CACHE_BYTES", l2 > 0 ? l2 : 1 << 20);
+        cores = getEnvDouble("AS_CORES", getEnvDouble("OMP_NUM_THREADS", std::max(1u, std::thread::hardware_concurrency())));
+    }
+
+    /// Cores kept busy by the given number of parallel iterations, the last
+    /// round of iterations leaves some cores idle.
+    double getEffectiveCores(double parallelIterations) const
+    {
+        if (parallelIterations <= cores)
+            return std::max(parallelIterations, 1.0);
+        return parallelIterations / std::ceil(parallelIterations / cores);
+    }
+
+    /// SIMD lanes for elements of the given width.
+    double getLanes(double elementBits) const
+    {
+        return std::max(vectorBits / elementBits, 1.0);
+    }
+};
+
+/// Executions of the operation (product of the trip counts of the loops
+/// around it) and the parallel iterations among them.
+static void getLoopContext(Operation *op, double &executions, double &parallelIterations)
+{
+    executions = 1;
+    parallelIterations = 1;
+    for (const FeatureExtractor::LoopLevel &level : FeatureExtractor::getLoopLevels(op))
+    {
+        executions *= level.tripCount;
+        if (level.parallel)
+            parallelIterations *= level.tripCount;
+    }
+}
+
+/// Memory traffic of a tile executed the given number of times, a tile larger
+/// than the cache is streamed again for each cache-sized part of it.
+static double getTraffic(const MachineModel &machine, double footprint, double executions)
+{
+    return executions * footprint * std::max(1.0, footprint / machine.cacheBytes);
+}
+
+/// Time of an operation, the longest of its compute and memory times on the
+/// cores its parallel loops use.
+static double getTime(const MachineModel &machine, double scalarFlops, double elementBits, double vectorFlops,
+                      double bytes, double parallelIterations)
+{
+    double cores = machine.getEffectiveCores(parallelIterations);
+    double scalarPeak = machine.coreFlops / machine.getLanes(elementBits);
+    double compute = (scalarFlops / scalarPeak + vectorFlops / machine.coreFlops) / cores;
+    double memory = bytes / std::min(machine.bandwidth, machine.coreBandwidth * cores);
+    return std::max(compute, memory);
+}
+
+AnalyticalEvaluation::AnalyticalEvaluation(std::string LogsFileName) : EvaluationByExecution(LogsFileName)
+{
+}
+
+AnalyticalEvaluation::Estimate AnalyticalEvaluation::estimate(mlir::Operation *module)
+{
+    static const MachineModel machine;
+    Estimate result;
+    result.parallelIterations = INFINITY;
+    // The transfers of a vectorized tile are grouped by the block they are in
+    llvm::DenseMap<Block *, std::pair<double, double>> vectorTiles;
+    llvm::DenseMap<Block *, double> vectorParallelism;
+
+    module->walk([&](Operation *op)
+                 {
+        if (op->hasAttr(TIMER_ATTR))
+            return;
+        double executions, parallelIterations;
+        if (linalg::LinalgOp linalgOp = dyn_cast<linalg::LinalgOp>(op))
+        {
+            getLoopContext(op, executions, parallelIterations);
+            SmallVector<int64_t> extents = FeatureExtractor::getLoopExtents(linalgOp);
+            double iterations = executions;
+            for (int64_t extent : extents)
+                iterations *= extent;
+            double payloadOps = linalgOp.getBlock()->getOperations().size() - 1;
+            double footprint = 0, elementBits = 8;
+            for (OpOperand &operand : op->getOpOperands())
+            {
+                footprint += FeatureExtractor::getOperandFootprint(linalgOp, operand, extents);
+                elementBits = std::max(elementBits, FeatureExtractor::getElementBits(operand.get().getType()));
+            }
+            double flops = iterations * payloadOps;
+            double bytes = getTraffic(machine, footprint, executions);
+            result.scalarFlops += flops;
+            result.bytes += bytes;
+            result.seconds += getTime(machine, flops, elementBits, 0, bytes, parallelIterations);
+            result.parallelIterations = std::min(result.parallelIterations, parallelIterations);
+            return;
+        }
+        if (isa<vector::TransferReadOp, vector::TransferWriteOp>(op))
+        {
+            VectorType type = isa<vector::TransferReadOp>(op) ? cast<vector::TransferReadOp>(op).getVectorType()
+                                                               : cast<vector::TransferWriteOp>(op).getVectorType();
+            getLoopContext(op, executions, parallelIterations);
+            std::pair<double, double> &tile = vectorTiles[op->getBlock()];
+            tile.first += type.getNumElements() * FeatureExtractor::getElementBits(type) / 8;
+            tile.second = executions;
+            vectorParallelism[op->getBlock()] = parallelIterations;
+            return;
+        }
+        // Vector computations fill the lanes with their innermost dimension
+        VectorType type;
+        double flops = 0;
+        if (vector::ContractionOp contraction = dyn_cast<vector::ContractionOp>(op))
+        {
+            SmallVector<int64_t> bounds;
+            contraction.getIterationBounds(bounds);
+            flops = 2;
+            for (int64_t bound : bounds)
+                flops *= bound;
+            type = dyn_cast<VectorType>(contraction.getLhsType());
+        }
+        else if (op->getNumResults() == 1 && isa<VectorType>(op->getResult(0).getType()) &&
+                 (op->getDialect()->getNamespace() == "arith" || op->getDialect()->getNamespace() == "math" || isa<vector::FMAOp>(op)))
+        {
+            type = cast<VectorType>(op->getResult(0).getType());
+            flops = type.getNumElements() * (isa<vector::FMAOp>(op) ? 2 : 1);
+        }
+        if (!type || type.getRank() == 0)
+            return;
+        getLoopContext(op, executions, parallelIterations);
+        double laneUse = std::min(1.0, type.getShape().back() / machine.getLanes(FeatureExtractor::getElementBits(type)));
+        double vectorFlops = executions * flops / laneUse;
+        result.vectorFlops += executions * flops;
+        result.seconds += getTime(machine, 0, 64, vectorFlops, 0, parallelIterations);
+        result.parallelIterations = std::min(result.parallelIterations, parallelIterations); });
+
+    for (auto &[block, tile] : vectorTiles)
+    {
+        double bytes = getTraffic(machine, tile.first, tile.second);
+        result.bytes += bytes;
+        result.seconds += getTime(machine, 0, 64, 0, bytes, vectorParallelism[block]);
+    }
+
+    // Every execution of a parallel loop starts its threads again
+    module->walk([&](scf::ForallOp forall)
+                 {
+        double executions, parallelIterations;
+        getLoopContext(forall, executions, parallelIterations);
+        result.seconds += executions * FORALL_OVERHEAD_SECONDS; });
+
+    if (std::isinf(result.parallelIterations))
+        result.parallelIterations = 1;
+    return result;
+}
+
+llvm::SmallVector<Node *, 2> AnalyticalEvaluation::screen(llvm::ArrayRef<Node *> nodes)
+{
+    llvm::SmallVector<Node *, 2> kept(nodes.begin(), nodes.end());
+    double fraction = getEnvDouble("AS_ANALYTICAL_SCREEN", 1);
+    if (fraction >= 1 || fraction <= 0 || nodes.size() <= 1)
+        return kept;
+
+    std::vector<std::pair<double, Node *>> ranked;
+    for (Node *node : nodes)
+    {
+        mlir::Operation *op = (mlir::Operation *)((MLIRCodeIR *)node->getTransformedCodeIr())->getIr();
+        ranked.push_back(std::make_pair(estimate(op).seconds, node));
+    }
+    std::stable_sort(ranked.begin(), ranked.end(), [](const std::pair<double, Node *> &a, const std::pair<double, Node *> &b)
+                     { return a.first < b.first; });
+    size_t numKept = std::max<size_t>(1, std::ceil(fraction * nodes.size()));
+    kept.clear();
+    for (size_t i = 0; i < ranked.size(); ++i)
+    {
+        if (i < numKept)
+            kept.push_back(ranked[i].second);
+        else
+            ranked[i].second->setEvaluation("9000000000000000000");
+    }
+    std::cout << "Analytical screen: " << numKept << " of " << nodes.size() << " candidates kept" << std::endl;
+    return kept;
+}
+
+std::string AnalyticalEvaluation::evaluateTransformation(Node *node)
+{
+    mlir::Operation *op = (mlir::Operation *)((MLIRCodeIR *)node->getTransformedCodeIr())->getIr();
+    logTransformation(node, op);
+
+    Estimate result = estimate(op);
+    Measurement measurement(ResultStatus::Ok);
+    measurement.addSample(result.seconds);
+    Measurement::record(node, measurement);
+    std::cout << "Estimate: " << result.seconds * 1000 << " ms, " << result.scalarFlops + result.vectorFlops
+              << " flops, " << result.bytes << " bytes, " << result.parallelIterations << " parallel iterations" << std::endl;
+
+    std::string OutputData = measurement.toEvaluation();
+    logEvaluation(node, OutputData);
+    return OutputData;
+}
@@ -0,0 +1,402 @@
+//===------------------------- BayesianOptimization.cpp - BayesianOptimization ===//
+//
+///===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implmentation of the BayesianOptimization class,
+/// which contains the implmentation of the search of the tile sizes guided by
+/// a Gaussian process
+///
+//===----------------------------------------------------------------------===//
+
+#include "BayesianOptimization.h"
+#include "CostModel.h"
+#include "MLIRCodeIR.h"
+#include "Measurement.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+/// Candidates scored by the expected improvement for each pick.
+#define BAYES_CANDIDATES 512
+/// Measured genomes whose neighbours are candidates.
+#define BAYES_NEIGHBOURHOODS 4
+/// Improvement (in log time) below which a candidate is not worth measuring.
+#define BAYES_MIN_IMPROVEMENT 0.01
+
+/// Gaussian process regression with a squared exponential kernel, the length
+/// scale is the median distance between the inputs.
+class GaussianProcess {
+    private:
+        std::vector<std::vector<double>> inputs;
+        /// Lower triangular Cholesky factor of the kernel matrix (row major).
+        std::vector<double> factor;
+        std::vector<double> weights;
+        double mean;
+        double variance;
+        double lengthScale;
+
+        double kernel(const std::vector<double> &a, const std::vector<double> &b)
+        {
+            double distance = 0;
+            for (size_t i = 0; i < a.size(); ++i)
+                distance += (a[i] - b[i]) * (a[i] - b[i]);
+            return variance * std::exp(-0.5 * distance / (lengthScale * lengthScale));
+        }
+
+    public:
+        void fit(const std::vector<std::vector<double>> &x, const std::vector<double> &y)
+        {
+            inputs = x;
+            size_t n = x.size();
+            mean = 0;
+            for (double value : y)
+                mean += value / n;
+            variance = 0;
+            for (double value : y)
+                variance += (value - mean) * (value - mean) / n;
+            variance = n > 1 ? std::max(variance, 1e-6) : 1;
+
+            std::vector<double> distances;
+            for (size_t i = 0; i < n; ++i)
+                for (size_t j = i + 1; j < n; ++j)
+                {
+                    double distance = 0;
+                    for (size_t k = 0; k < x[i].size(); ++k)
+                        distance += (x[i][k] - x[j][k]) * (x[i][k] - x[j][k]);
+                    distances.push_back(std::sqrt(distance));
+                }
+            lengthScale = 1;
+            if (!distances.empty())
+            {
+                std::nth_element(distances.begin(), distances.begin() + distances.size() / 2, distances.end());
+                lengthScale = std::max(distances[distances.size() / 2], 1e-3);
+            }
+
+            // The noise of the measurements is a percent of the variance
+            factor.assign(n * n, 0);
+            for (size_t i = 0; i < n; ++i)
+                for (size_t j = 0; j <= i; ++j)
+                {
+                    double sum = kernel(x[i], x[j]) + (i == j ? 0.01 * variance : 0);
+                    for (size_t k = 0; k < j; ++k)
+                        sum -= factor[i * n + k] * factor[j * n + k];
+                    factor[i * n + j] = i == j ? std::sqrt(std::max(sum, 1e-12)) : sum / factor[j * n + j];
+                }
+
+            // weights = K^-1 (y - mean) by two triangular solves
+            weights.assign(n, 0);
+            for (size_t i = 0; i < n; ++i)
+            {
+                double sum = y[i] - mean;
+                for (size_t k = 0; k < i; ++k)
+                    sum -= factor[i * n + k] * weights[k];
+                weights[i] = sum / factor[i * n + i];
+            }
+            for (size_t i = n; i-- > 0;)
+            {
+                double sum = weights[i];
+                for (size_t k = i + 1; k < n; ++k)
+                    sum -= factor[k * n + i] * weights[k];
+                weights[i] = sum / factor[i * n + i];
+            }
+        }
+
+        void predict(const std::vector<double> &x, double &predictedMean, double &predictedVariance)
+        {
+            size_t n = inputs.size();
+            std::vector<double> covariances(n);
+            predictedMean = mean;
+            for (size_t i = 0; i < n; ++i)
+            {
+                covariances[i] = kernel(x, inputs[i]);
+                predictedMean += covariances[i] * weights[i];
+            }
+            predictedVariance = variance;
+            for (size_t i = 0; i < n; ++i)
+            {
+                double sum = covariances[i];
+                for (size_t k = 0; k < i; ++k)
+                    sum -= factor[i * n + k] * covariances[k];
+                covariances[i] = sum / factor[i * n + i];
+                predictedVariance -= covariances[i] * covariances[i];
+            }
+            predictedVariance = std::max(predictedVariance, 1e-12);
+        }
+};
+
+/// Expected decrease of the log time below best.
+static double getExpectedImprovement(double mean, double variance, double best)
+{
+    double deviation = std::sqrt(variance);
+    double improvement = best - mean - BAYES_MIN_IMPROVEMENT;
+    double z = improvement / deviation;
+    return improvement * 0.5 * std::erfc(-z / std::sqrt(2.0)) + deviation * std::exp(-0.5 * z * z) / std::sqrt(2 * M_PI);
+}
+
+BayesianOptimization::BayesianOptimization(mlir::MLIRContext *context, std::string functionName, int numEvaluations, int batchSize,
+                                           int depth, int numThreads)
+    : space(context, depth), generator(42)
+{
+    this->context = context;
+    this->functionName = functionName;
+    this->numEvaluations = std::max(numEvaluations, 1);
+    this->batchSize = std::max(batchSize, 1);
+    this->numThreads = numThreads > 0 ? numThreads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+bool BayesianOptimization::hasLayout(const Genome &genome)
+{
+    if (genome.size() != schedule.size())
+        return false;
+    for (size_t i = 0; i < genome.size(); ++i)
+        if (genome[i].step != schedule[i].step || genome[i].tileSizes.size() != schedule[i].tileSizes.size())
+            return false;
+    return true;
+}
+
+std::vector<double> BayesianOptimization::getFeatures(const Genome &genome)
+{
+    std::vector<double> values;
+    for (const std::pair<size_t, size_t> &slot : layout)
+        values.push_back(std::log2((double)genome[slot.first].tileSizes[slot.second]));
+    return values;
+}
+
+BayesianOptimization::Genome BayesianOptimization::getRandomGenome()
+{
+    Genome genome = schedule;
+    for (const std::pair<size_t, size_t> &slot : layout)
+    {
+        SearchSpace::Gene &gene = genome[slot.first];
+        SmallVector<int64_t, 4> divisors = SearchSpace::getDivisors(gene.extents[slot.second], gene.step);
+        gene.tileSizes[slot.second] = divisors[std::uniform_int_distribution<size_t>(0, divisors.size() - 1)(generator)];
+    }
+    return genome;
+}
+
+std::vector<BayesianOptimization::Genome> BayesianOptimization::getCandidates()
+{
+    std::vector<size_t> fastest;
+    for (size_t i = 0; i < observed.size(); ++i)
+        if (std::isfinite(logTimes[i]))
+            fastest.push_back(i);
+    std::sort(fastest.begin(), fastest.end(), [&](size_t a, size_t b)
+              { return logTimes[a] < logTimes[b]; });
+    fastest.resize(std::min<size_t>(fastest.size(), BAYES_NEIGHBOURHOODS));
+
+    // Half of the candidates explore the whole space, the other half moves
+    // one or two tile sizes of the fastest genomes to neighbouring divisors
+    std::vector<Genome> candidates;
+    std::set<std::vector<double>> seen = visited;
+    for (int attempt = 0; attempt < 4 * BAYES_CANDIDATES && candidates.size() < BAYES_CANDIDATES; ++attempt)
+    {
+        Genome genome;
+        if (fastest.empty() || attempt % 2 == 0)
+            genome = getRandomGenome();
+        else
+        {
+            genome = observed[fastest[std::uniform_int_distribution<size_t>(0, fastest.size() - 1)(generator)]];
+            int moves = std::uniform_int_distribution<int>(1, 2)(generator);
+            for (int move = 0; move < moves; ++move)
+            {
+                const std::pair<size_t, size_t> &slot = layout[std::uniform_int_distribution<size_t>(0, layout.size() - 1)(generator)];
+                SearchSpace::Gene &gene = genome[slot.first];
+                SmallVector<int64_t, 4> divisors = SearchSpace::getDivisors(gene.extents[slot.second], gene.step);
+                size_t index = SearchSpace::getNearestDivisor(gene.tileSizes[slot.second], divisors);
+                if (divisors.size() < 2)
+                    continue;
+                bool larger = index == 0 || (index + 1 < divisors.size() && std::bernoulli_distribution(0.5)(generator));
+                gene.tileSizes[slot.second] = divisors[larger ? index + 1 : index - 1];
+            }
+        }
+        if (seen.insert(getFeatures(genome)).second)
+            candidates.push_back(genome);
+    }
+    return candidates;
+}
+
+std::vector<BayesianOptimization::Genome> BayesianOptimization::acquire(int count)
+{
+    // The failed candidates are given a time worse than all the others
+    double worst = 0;
+    bool anyFinite = false;
+    for (double logTime : logTimes)
+        if (std::isfinite(logTime))
+        {
+            worst = anyFinite ? std::max(worst, logTime) : logTime;
+            anyFinite = true;
+        }
+    std::vector<std::vector<double>> x = features;
+    std::vector<double> y;
+    for (double logTime : logTimes)
+        y.push_back(std::isfinite(logTime) ? logTime : worst + 1);
+
+    std::vector<Genome> candidates = getCandidates();
+    std::vector<std::vector<double>> candidateFeatures;
+    for (const Genome &candidate : candidates)
+        candidateFeatures.push_back(getFeatures(candidate));
+
+    std::vector<Genome> batch;
+    GaussianProcess process;
+    while ((int)batch.size() < count && !candidates.empty())
+    {
+        process.fit(x, y);
+        double best = *std::min_element(y.begin(), y.end());
+        size_t picked = 0;
+        double pickedScore = -INFINITY, pickedMean = 0;
+        for (size_t i = 0; i < candidates.size(); ++i)
+        {
+            double mean, variance;
+            process.predict(candidateFeatures[i], mean, variance);
+            double score = getExpectedImprovement(mean, variance, best);
+            if (score > pickedScore)
+            {
+                pickedScore = score;
+                pickedMean = mean;
+                picked = i;
+            }
+        }
+        batch.push_back(candidates[picked]);
+        // The pick is believed to run at its predicted time
+        x.push_back(candidateFeatures[picked]);
+        y.push_back(pickedMean);
+        candidates.erase(candidates.begin() + picked);
+        candidateFeatures.erase(candidateFeatures.begin() + picked);
+    }
+    return batch;
+}
+
+Node *BayesianOptimization::evaluate(Node *root, std::vector<Genome> &genomes, EvaluationByExecution *evaluator)
+{
+    std::vector<Node *> nodes(genomes.size());
+    std::vector<Genome> decoded = genomes;
+    std::vector<unsigned> seeds(genomes.size());
+    for (unsigned &seed : seeds)
+        seed = generator();
+
+    // Each thread decodes the next genome on a clone of the root
+    std::atomic<size_t> nextNode(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < std::min<int>(numThreads, genomes.size()); ++t)
+    {
+        threads.emplace_back([&]()
+                             {
+            size_t index;
+            while ((index = nextNode++) < genomes.size())
+            {
+                std::mt19937 decodeGenerator(seeds[index]);
+                nodes[index] = space.decode(root, decoded[index], decodeGenerator);
+            } });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+
+    SmallVector<Node *, 2> batch;
+    for (Node *node : nodes)
+        if (node != root)
+            batch.push_back(node);
+    // Evaluate the batch at once
+    evaluator->evaluateTransformations(batch);
+    if (CostModel *costModel = CostModel::get())
+        costModel->update(batch);
+    evaluatedNodes.insert(evaluatedNodes.end(), batch.begin(), batch.end());
+
+    // The measurement describes the repaired tile sizes, the extents of the
+    // tiling depend on the parallel tile sizes. A genome that could not be
+    // decoded to the structure of the schedule is recorded as failed under
+    // its requested tile sizes.
+    Node *fastest = nullptr;
+    for (size_t i = 0; i < genomes.size(); ++i)
+    {
+        bool decodedSchedule = nodes[i] != root && hasLayout(decoded[i]);
+        double time = decodedSchedule ? Measurement::getTime(nodes[i]) : INFINITY;
+        observed.push_back(decodedSchedule ? decoded[i] : genomes[i]);
+        features.push_back(getFeatures(observed.back()));
+        visited.insert(features.back());
+        visited.insert(getFeatures(genomes[i]));
+        logTimes.push_back(std::isfinite(time) && time > 0 ? std::log(time) : INFINITY);
+        if (nodes[i] != root && (!fastest || Measurement::getTime(nodes[i]) < Measurement::getTime(fastest)))
+            fastest = nodes[i];
+    }
+    return fastest != nullptr ? fastest : root;
+}
+
+Node *BayesianOptimization::runSearchMethod(Node *root)
+{
+    // Create an evaluator for transformation evaluations
+    std::unique_ptr<EvaluationByExecution> evaluator = EvaluationByExecution::create(this->functionName + "_logs_bayes.txt");
+
+    // The steps, interchanges and extents of the schedule come from a random
+    // genome, its tile sizes are then tuned
+    schedule.clear();
+    for (int level = 0; level < space.getDepth(); ++level)
+        schedule.push_back({space.getStep(level), {}, {}, {}});
+    Node *probe = space.decode(root, schedule, generator);
+    if (probe != root)
+        SearchSpace::eraseNode(probe);
+    layout.clear();
+    for (size_t i = 0; i < schedule.size(); ++i)
+    {
+        SearchSpace::Gene &gene = schedule[i];
+        // Every loop but the innermost may be parallelized
+        if (gene.step == SearchSpace::Step::Parallelization)
+            while (gene.tileSizes.size() + 1 < gene.extents.size())
+                gene.tileSizes.push_back(SearchSpace::getDivisors(gene.extents[gene.tileSizes.size()], gene.step).back());
+        for (size_t loop = 0; loop < gene.tileSizes.size(); ++loop)
+            layout.push_back(std::make_pair(i, loop));
+    }
+    if (layout.empty())
+    {
+        std::cout << "Bayesian optimization: no tile sizes to tune" << std::endl;
+        return root;
+    }
+    std::cout << "Bayesian optimization: " << layout.size() << " tile sizes tuned" << std::endl;
+
+    Node *BestNode = root;
+    observed.clear();
+    features.clear();
+    logTimes.clear();
+    visited.clear();
+    evaluatedNodes.clear();
+    for (int batchIndex = 0; (int)observed.size() < numEvaluations; ++batchIndex)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        int count = std::min<int>(batchSize, numEvaluations - observed.size());
+        std::vector<Genome> genomes;
+        if (observed.empty())
+        {
+            // The first batch is drawn at random
+            std::set<std::vector<double>> seen;
+            for (int attempt = 0; attempt < 4 * count && (int)genomes.size() < count; ++attempt)
+            {
+                Genome genome = getRandomGenome();
+                if (seen.insert(getFeatures(genome)).second)
+                    genomes.push_back(genome);
+            }
+        }
+        else
+            genomes = acquire(count);
+        // Every tile size combination was measured
+        if (genomes.empty())
+            break;
+        auto acquired = std::chrono::high_resolution_clock::now();
+
+        Node *fastest = evaluate(root, genomes, evaluator.get());
+        if (Measurement::getTime(fastest) < Measurement::getTime(BestNode))
+            BestNode = fastest;
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << "Batch " << batchIndex << ": " << genomes.size() << " schedules, acquisition "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(acquired - start).count() << " ms, evaluation "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - acquired).count() << " ms, best "
+                  << Measurement::getTime(BestNode) << " s" << std::endl;
+    }
+
+    // Set the children nodes of the root (for printing the schedules)
+    root->setChildrenNodes(evaluatedNodes);
+    return BestNode;
+}
@@ -10,120 +10,64 @@
 
 #include "BeamSearch.h"
 
-BeamSearch::BeamSearch(int beamSize, mlir::MLIRContext *context, std::string functionName)
+BeamSearch::BeamSearch(int beamSize, mlir::MLIRContext *context, std::string functionName, int depth)
+    : space(context, depth)
 {
-    this->beamSize = beamSize;
+    this->beamSize = std::max(beamSize, 1);
     this->context = context;
     this->functionName = functionName;
 }
 
 Node *BeamSearch::runSearchMethod(Node *root)
 {
+    // Create an evaluator for transformation evaluations, the candidates of a
+    // level are lowered and measured concurrently by the runner pool unless
+    // AS_EVALUATOR selects another evaluator
+    std::unique_ptr<EvaluationByExecution> evaluator = EvaluationByExecution::create(this->functionName + "_logs_best_beam_search_now.txt", "pool");
 
-    // Initialize the exploration queue and level counter
-    std::queue<Node *> exploration_queue;
-    exploration_queue.push(root);
-    int level = 0;
+    SmallVector<Node *, 2> beam = {root};
+    Node *BestNode = root;
+    childrenNodes.clear();
 
-    // Clone the root's MLIR code for evaluation
-    MLIRCodeIR *CodeIr = (MLIRCodeIR *)root->getTransformedCodeIr();
-    MLIRCodeIR *ClonedCode = (MLIRCodeIR *)CodeIr->cloneIr();
-    Node *clone = new Node(ClonedCode, root->getCurrentStage());
-    Node *BestNode = clone;
-
-    // Create an evaluator for transformation evaluations
-    EvaluationByExecution evaluator = EvaluationByExecution(this->functionName + "_logs_best_beam_search_now.txt");
-
-    while (!exploration_queue.empty() && level != 3)
+    for (int level = 0; level < space.getDepth(); ++level)
     {
-        std::cout << "################# Level = " << level << " ###############\n";
-        // SmallVector<Node *,2> parent_nodes;
-
-        // Create a list to store schedule nodes at the current level
-        SmallVector<Node *, 2> level_schedules;
-
-        // Iterate through nodes in the exploration queue at the current level
-        while (!exploration_queue.empty())
+        std::cout << "################# Level = " << level << " (" << SearchSpace::getStepName(space.getStep(level))
+                  << ", beam of " << beam.size() << ") ###############\n";
+        auto start = std::chrono::high_resolution_clock::now();
+
+        // The candidates are built on the context of the search, whose
+        // transform interpreter and pass manager runs are serialized, the
+        // nodes of the beam are expanded one after the other
+        SmallVector<Node *, 2> candidates;
+        for (Node *node : beam)
         {
-
-            Node *node = exploration_queue.front();
-
-            exploration_queue.pop();
-            SmallVector<Node *, 2> candidates;
-
-            // Generate transformation candidates based on the current level.
-            switch (level)
-            {
-            case 0:
-                //candidates = Parallelization::createParallelizationCandidates(node, this->context);
-                break;
-            case 1:
-            {
-                //candidates = Tiling::createTilingCandidates(node, this->context);
-
-                // Insert the parent node as a candidate
-                /*MLIRCodeIR *ToCloneCodeIr = (MLIRCodeIR *)node->getTransformedCodeIr();
-                MLIRCodeIR *ClonedCode = (MLIRCodeIR *)ToCloneCodeIr->cloneIr();
-                Node *ClonedNode = new Node(ClonedCode);
-
-                std::vector<Transformation *> TransList = node->getTransformationList();
-                ClonedNode->setTransformationList(TransList);
-
-                candidates.insert(candidates.begin(), ClonedNode);*/
-
-                // parent_nodes.insert(parent_nodes.begin(),ClonedNode );
-                break;
-            }
-
-            /*case 2:
-                candidates = Interchange::createInterchangeCandidates(node, this->context);
-                break;*/
-            case 2:
-                candidates = Vectorization::createVectorizationCandidates(node, this->context);
-                break;
-            }
-            // Evaluate each transformation candidate and store their evaluation results
-            for (auto ChildNode : candidates)
-            {
-                std::string evel = evaluator.evaluateTransformation(ChildNode);
-                ChildNode->setEvaluation(evel);
-            }
-            // Sort the candidates based on their evaluation scores
-            
-            std::sort(candidates.begin(), candidates.end(), [](Node *a, Node *b)
-                      { return std::stod(a->getEvaluation()) < std::stod(b->getEvaluation()); });
-
+            SmallVector<Node *, 2> children = space.expand(node, level);
             // Set the children nodes of the current node (for printing the tree)
-            node->setChildrenNodes(candidates);
-            // Save the best node at level 0 (the root node of the resulting tree)
-            if (level == 0)
-                BestNode = node;
-
-            level_schedules.insert(level_schedules.end(), candidates.begin(), candidates.end());
+            SmallVector<Node *, 2> &nodeChildren = childrenNodes[node];
+            nodeChildren.append(children.begin(), children.end());
+            node->setChildrenNodes(nodeChildren);
+            candidates.insert(candidates.end(), children.begin(), children.end());
         }
+        auto expanded = std::chrono::high_resolution_clock::now();
 
-        // Sort the level's schedule nodes from smallest to largest evaluation
-        std::sort(level_schedules.begin(), level_schedules.end(), [](Node *a, Node *b)
-                  { return std::stod(a->getEvaluation()) < std::stod(b->getEvaluation()); });
+        // Evaluate the transformation candidates of the whole level at once
+        evaluator->evaluateTransformations(candidates);
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << "Level " << level << ": " << candidates.size() << " candidates, expansion "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(expanded - start).count() << " ms, evaluation "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - expanded).count() << " ms" << std::endl;
 
-        /* // Forcing beam search to take one of the parent nodes in the next level
-        std::sort(parent_nodes.begin(), parent_nodes.end(), [](Node *a, Node *b) {
-            return std::stod(a->getEvaluation()) < std::stod(b->getEvaluation());
-        });
-        parent_nodes.resize(std::min(1, (int)parent_nodes.size()));
-        level_schedules.insert(level_schedules.begin(), parent_nodes.begin(), parent_nodes.end());*/
+        // The parents compete with their children, a step that slows every
+        // candidate down is skipped
+        SmallVector<Node *, 2> level_schedules(beam.begin(), beam.end());
+        level_schedules.insert(level_schedules.end(), candidates.begin(), candidates.end());
 
-        // keep the top 'beam_size' children and delete the rest
-        /*for (int i = this->beamSize; i < level_schedules.size(); ++i)
-            delete level_schedules[i];*/
+        // Sort the level's schedule nodes from smallest to largest evaluation
+        Measurement::sortByTime(level_schedules);
         level_schedules.resize(std::min(this->beamSize, (int)level_schedules.size()));
-
-        // Add the level's schedule nodes to the exploration queue for the next level
-        for (Node *child : level_schedules)
-        {
-            exploration_queue.push(child);
-        }
-        level++;
+        if (Measurement::getTime(level_schedules.front()) < Measurement::getTime(BestNode))
+            BestNode = level_schedules.front();
+        beam = level_schedules;
     }
 
     return BestNode;
@@ -0,0 +1,254 @@
+//===------------------------- CostModel.cpp - CostModel -------------------===//
+//
+///===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implmentation of the CostModel class, which
+/// contains a small multilayer perceptron trained during the tuning on the
+/// measured candidates
+///
+//===----------------------------------------------------------------------===//
+
+#include "CostModel.h"
+#include "FeatureExtractor.h"
+#include "MLIRCodeIR.h"
+#include "Measurement.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+
+/// Units of the hidden layer.
+#define COST_MODEL_HIDDEN 16
+/// Training samples kept.
+#define COST_MODEL_CAPACITY 4096
+/// Gradient steps done after each step of the search.
+#define COST_MODEL_STEPS 512
+
+CostModel::CostModel()
+    : numFeatures(FeatureExtractor::getNames().size()), numHidden(COST_MODEL_HIDDEN), outputBias(0), targetMean(0), targetScale(1), nextSample(0),
+      generator(42), numSkipped(0)
+{
+    // Uniform Glorot initialization, the seed is fixed so that runs repeat
+    std::uniform_real_distribution<float> hiddenInit(-std::sqrt(6.0f / (numFeatures + numHidden)), std::sqrt(6.0f / (numFeatures + numHidden)));
+    std::uniform_real_distribution<float> outputInit(-std::sqrt(6.0f / (numHidden + 1)), std::sqrt(6.0f / (numHidden + 1)));
+    hiddenWeights.resize(numHidden * numFeatures);
+    for (float &weight : hiddenWeights)
+        weight = hiddenInit(generator);
+    hiddenBiases.assign(numHidden, 0);
+    outputWeights.resize(numHidden);
+    for (float &weight : outputWeights)
+        weight = outputInit(generator);
+    featureMeans.assign(numFeatures, 0);
+    featureScales.assign(numFeatures, 1);
+}
+
+CostModel *CostModel::get()
+{
+    static CostModel *model = std::getenv("AS_COST_MODEL") != nullptr && std::string(std::getenv("AS_COST_MODEL")) == "1"
+                                  ? new CostModel()
+                                  : nullptr;
+    return model;
+}
+
+std::vector<float> CostModel::getFeatures(Node *node)
+{
+    mlir::Operation *op = (mlir::Operation *)((MLIRCodeIR *)node->getTransformedCodeIr())->getIr();
+    return FeatureExtractor::extract(op);
+}
+
+float CostModel::predictNormalized(const std::vector<float> &features, std::vector<float> *hidden)
+{
+    // The inner loops run over contiguous arrays so that they are vectorized
+    float output = outputBias;
+    for (int j = 0; j < numHidden; ++j)
+    {
+        const float *weights = &hiddenWeights[j * numFeatures];
+        float sum = hiddenBiases[j];
+        for (int i = 0; i < numFeatures; ++i)
+            sum += weights[i] * (features[i] - featureMeans[i]) * featureScales[i];
+        sum = std::max(sum, 0.0f);
+        if (hidden != nullptr)
+            (*hidden)[j] = sum;
+        output += outputWeights[j] * sum;
+    }
+    return output;
+}
+
+float CostModel::predict(Node *node)
+{
+    return predictNormalized(getFeatures(node)) / targetScale + targetMean;
+}
+
+void CostModel::train()
+{
+    if (samples.empty())
+        return;
+    // The normalization follows the samples seen so far
+    for (int i = 0; i < numFeatures; ++i)
+    {
+        double mean = 0, variance = 0;
+        for (const std::vector<float> &sample : samples)
+            mean += sample[i];
+        mean /= samples.size();
+        for (const std::vector<float> &sample : samples)
+            variance += (sample[i] - mean) * (sample[i] - mean);
+        variance /= samples.size();
+        featureMeans[i] = mean;
+        featureScales[i] = variance > 1e-12 ? 1 / std::sqrt(variance) : 1;
+    }
+    double mean = std::accumulate(targets.begin(), targets.end(), 0.0) / targets.size();
+    double variance = 0;
+    for (float target : targets)
+        variance += (target - mean) * (target - mean);
+    variance /= targets.size();
+    targetMean = mean;
+    targetScale = variance > 1e-12 ? 1 / std::sqrt(variance) : 1;
+
+    // Stochastic gradient descent on the squared error of the normalized
+    // log times
+    float learningRate = getEnvDouble("AS_COST_MODEL_LR", 0.01);
+    std::uniform_int_distribution<size_t> pick(0, samples.size() - 1);
+    std::vector<float> hidden(numHidden);
+    for (int step = 0; step < COST_MODEL_STEPS; ++step)
+    {
+        size_t index = pick(generator);
+        const std::vector<float> &features = samples[index];
+        float error = predictNormalized(features, &hidden) - (targets[index] - targetMean) * targetScale;
+        for (int j = 0; j < numHidden; ++j)
+        {
+            float gradient = error * outputWeights[j];
+            outputWeights[j] -= learningRate * error * hidden[j];
+            if (hidden[j] <= 0)
+                continue;
+            float *weights = &hiddenWeights[j * numFeatures];
+            for (int i = 0; i < numFeatures; ++i)
+                weights[i] -= learningRate * gradient * (features[i] - featureMeans[i]) * featureScales[i];
+            hiddenBiases[j] -= learningRate * gradient;
+        }
+        outputBias -= learningRate * error;
+    }
+}
+
+bool CostModel::isWarm()
+{
+    return (int)targets.size() >= getEnvInt("AS_COST_MODEL_WARMUP", 32);
+}
+
+llvm::SmallVector<Node *, 2> CostModel::select(llvm::ArrayRef<Node *> nodes)
+{
+    llvm::SmallVector<Node *, 2> selected(nodes.begin(), nodes.end());
+    size_t topK = std::max(getEnvInt("AS_COST_MODEL_TOPK", 8), 1);
+    if (!isWarm() || nodes.size() <= topK)
+        return selected;
+
+    std::vector<std::pair<float, Node *>> ranked;
+    for (Node *node : nodes)
+        ranked.push_back(std::make_pair(predict(node), node));
+    std::stable_sort(ranked.begin(), ranked.end(), [](const std::pair<float, Node *> &a, const std::pair<float, Node *> &b)
+                     { return a.first < b.first; });
+    selected.clear();
+    for (size_t i = 0; i < ranked.size(); ++i)
+    {
+        if (i < topK)
+        {
+            selected.push_back(ranked[i].second);
+            predictions[ranked[i].second] = ranked[i].first;
+        }
+        else
+        {
+            ranked[i].second->setEvaluation("9000000000000000000");
+            ++numSkipped;
+        }
+    }
+    return selected;
+}
+
+void CostModel::update(llvm::ArrayRef<Node *> nodes)
+{
+    std::vector<double> predicted, measured;
+    for (Node *node : nodes)
+    {
+        Measurement measurement;
+        if (!Measurement::lookup(node, measurement) || measurement.isFailed())
+            continue;
+        float target = std::log(std::max(measurement.getMedian(), 1e-12));
+        if (predictions.count(node))
+        {
+            predicted.push_back(predictions[node]);
+            measured.push_back(target);
+        }
+        if (samples.size() < COST_MODEL_CAPACITY)
+        {
+            samples.push_back(getFeatures(node));
+            targets.push_back(target);
+        }
+        else
+        {
+            samples[nextSample] = getFeatures(node);
+            targets[nextSample] = target;
+            nextSample = (nextSample + 1) % COST_MODEL_CAPACITY;
+        }
+    }
+    predictions.clear();
+    train();
+
+    if (predicted.size() >= 3)
+    {
+        correlations.push_back(getRankCorrelation(predicted, measured));
+        std::cout << "Cost model: rank correlation " << correlations.back() << " on " << predicted.size()
+                  << " candidates, " << samples.size() << " samples" << std::endl;
+    }
+}
+
+std::string CostModel::summary()
+{
+    std::ostringstream out;
+    double mean = correlations.empty() ? 0 : std::accumulate(correlations.begin(), correlations.end(), 0.0) / correlations.size();
+    out << "Cost model: " << samples.size() << " samples, " << numSkipped << " candidates not executed, mean rank correlation "
+        << mean << " over " << correlations.size() << " steps";
+    return out.str();
+}
+
+/// Ranks of the values, tied values share their mean rank.
+static std::vector<double> getRanks(const std::vector<double> &values)
+{
+    std::vector<size_t> order(values.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+              { return values[a] < values[b]; });
+    std::vector<double> ranks(values.size());
+    for (size_t i = 0; i < order.size();)
+    {
+        size_t j = i;
+        while (j + 1 < order.size() && values[order[j + 1]] == values[order[i]])
+            ++j;
+        for (size_t k = i; k <= j; ++k)
+            ranks[order[k]] = (i + j) / 2.0;
+        i = j + 1;
+    }
+    return ranks;
+}
+
+double CostModel::getRankCorrelation(const std::vector<double> &a, const std::vector<double> &b)
+{
+    if (a.size() != b.size() || a.size() < 2)
+        return 0;
+    std::vector<double> rankA = getRanks(a), rankB = getRanks(b);
+    double meanA = std::accumulate(rankA.begin(), rankA.end(), 0.0) / rankA.size();
+    double meanB = std::accumulate(rankB.begin(), rankB.end(), 0.0) / rankB.size();
+    double covariance = 0, varianceA = 0, varianceB = 0;
+    for (size_t i = 0; i < rankA.size(); ++i)
+    {
+        covariance += (rankA[i] - meanA) * (rankB[i] - meanB);
+        varianceA += (rankA[i] - meanA) * (rankA[i] - meanA);
+        varianceB += (rankB[i] - meanB) * (rankB[i] - meanB);
+    }
+    if (varianceA == 0 || varianceB == 0)
+        return 0;
+    return covariance / std::sqrt(varianceA * varianceB);
+}
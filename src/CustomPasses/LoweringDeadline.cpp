@@ -0,0 +1,40 @@
+#include "mlir/Pass/Pass.h"
+
+#include "Passes.h"
+using namespace mlir;
+
+namespace mlir
+{
+
+#define GEN_PASS_DEF_LOWERINGDEADLINE
+#include "CustomPasses/Passes.h.inc"
+
+  namespace
+  {
+    class LoweringDeadline final
+        : public impl::LoweringDeadlineBase<LoweringDeadline>
+    {
+    public:
+      LoweringDeadline(const std::chrono::steady_clock::time_point *deadline) : deadline(deadline) {}
+
+      void runOnOperation() override
+      {
+        if (std::chrono::steady_clock::now() > *deadline)
+        {
+          getOperation()->emitError("lowering deadline exceeded");
+          signalPassFailure();
+        }
+        markAllAnalysesPreserved();
+      }
+
+    private:
+      const std::chrono::steady_clock::time_point *deadline;
+    };
+  } // namespace
+
+  std::unique_ptr<Pass> createLoweringDeadline(const std::chrono::steady_clock::time_point *deadline)
+  {
+    return std::make_unique<LoweringDeadline>(deadline);
+  }
+
+} // namespace mlir
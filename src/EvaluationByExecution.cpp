@@ -10,10 +10,24 @@
 //===----------------------------------------------------------------------===//
 
 #include "EvaluationByExecution.h"
+#include "AnalyticalEvaluation.h"
+#include "EvaluationCache.h"
+#include "FeatureExtractor.h"
+#include "MachineCalibration.h"
+#include "ScheduleDatabase.h"
+#include "TuningLogger.h"
+#include "EvaluationByJIT.h"
+#include "EvaluationByRunnerPool.h"
+
+#include <chrono>
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
 
 using namespace mlir;
 std::string getTransformedCode(std::string inputCode, std::string transfromDialectString);
-std::string getEvaluation(std::string inputCode);
+std::string getEvaluation(std::string inputCode, double timeoutSeconds = 0, bool *timedOut = nullptr);
 std::string removeExtraModuleTagCreated(std::string input);
 pid_t popen2(const char *command, int *infp, int *outfp);
 pid_t popen22(const char *command, int *infp, int *outfp);
@@ -25,6 +39,18 @@ EvaluationByExecution::EvaluationByExecution(std::string LogsFileName)
 {
   this->LogsFileName = LogsFileName;
 }
+
+std::unique_ptr<EvaluationByExecution> EvaluationByExecution::create(std::string LogsFileName, const std::string &defaultEvaluator)
+{
+  std::string evaluator = std::getenv("AS_EVALUATOR") != nullptr ? std::getenv("AS_EVALUATOR") : defaultEvaluator;
+  if (evaluator == "jit")
+    return std::make_unique<EvaluationByJIT>(LogsFileName);
+  if (evaluator == "pool")
+    return std::make_unique<EvaluationByRunnerPool>(LogsFileName);
+  if (evaluator == "analytical")
+    return std::make_unique<AnalyticalEvaluation>(LogsFileName);
+  return std::make_unique<EvaluationByExecution>(LogsFileName);
+}
 std::string EvaluationByExecution::evaluateTransformation(Node *node)
 {
     std::string str1;
@@ -37,40 +63,8 @@ std::string EvaluationByExecution::evaluateTransformation(Node *node)
     mlir::Operation *op = ((mlir::Operation *)(*(ClonedCode))
                                      .getIr());
     // Printing the transformed code
-    if (std::getenv("AS_VERBOSE") != nullptr)
-    {
-        int asVerbose = std::stoi(std::getenv("AS_VERBOSE"));
-        if (asVerbose == 1)
-        {
-            std::ofstream debugFile;
-            /*time_t now = time(0);
-            char* dt = ctime(&now); // Assuming you have this correctly defined elsewhere
-
-            std::string dtString(dt); // Convert char* to std::string
+    logTransformation(node, op);
 
-            std::string logs = "logs_" + dtString + ".txt";*/
-            debugFile.open(LogsFileName, std::ios_base::app);
-            if (debugFile.is_open())
-            {
-                std::string str;
-                llvm::raw_string_ostream debugOut(str);
-                if (node->getTransformation() != NULL)
-                {
-                    debugFile << "###################################" << std::endl;
-                    debugFile << "Transformtion : " << std::endl;
-                    for (const auto &transformation : node->getTransformationList())
-                    {
-                        debugFile << transformation->printTransformation();
-                    }
-                    debugFile << std::endl;
-                }
-                op->print(debugOut);
-
-                debugFile << str << std::endl;
-                debugFile.close();
-            }
-        }
-    }
     /*mlir::PassManager pmBefore((*op).get()->getName());
 
     // Apply any generic pass manager command line options and run the pipeline.
@@ -113,111 +107,153 @@ std::string EvaluationByExecution::evaluateTransformation(Node *node)
   
     //mlir::OwningOpRef<Operation *> module = parseSourceString(transformDialectString, (op)->getContext());
     //(*module)->dump();
-    std::string outString;
-    llvm::raw_string_ostream output_run(outString);
-
-
-    std::string transformDialectString = "module attributes {transform.with_named_sequence} { \n transform.named_sequence @__transform_main(%variant_op: !transform.any_op {transform.readonly})  { %f = transform.structured.match ops{[\"func.func\"]} in %variant_op : (!transform.any_op) -> !transform.any_op \n transform.apply_patterns to %f {  \n transform.apply_patterns.vector.lower_contraction lowering_strategy = \"outerproduct\" \n transform.apply_patterns.vector.transfer_permutation_patterns \n transform.apply_patterns.vector.lower_multi_reduction lowering_strategy = \"innerparallel\" \n transform.apply_patterns.vector.split_transfer_full_partial split_transfer_strategy = \"vector-transfer\" \n transform.apply_patterns.vector.transfer_to_scf max_transfer_rank = 1 full_unroll = true \n transform.apply_patterns.vector.lower_transfer max_transfer_rank = 1 \n transform.apply_patterns.vector.lower_shape_cast \n transform.apply_patterns.vector.lower_transpose lowering_strategy = \"shuffle_1d\" \n transform.apply_patterns.canonicalization} \n : !transform.any_op \n transform.yield}}";
-    std::cout << "START VECT\n";
-
-    mlir::transform::TransformOptions options1;
-    mlir::OwningOpRef<mlir::ModuleOp> moduleFromFile = parseSourceString<mlir::ModuleOp>(transformDialectString, op->getContext());
-    llvm::StringRef entryPoint = "__transform_main";
-    mlir::Operation *transformEntryPoint = transform::detail::findTransformEntryPoint(op, *moduleFromFile, entryPoint);
-
-    transform::applyTransformNamedSequence(
-        op, transformEntryPoint, *moduleFromFile,
-        options1.enableExpensiveChecks(false));
 
-    //auto start = std::chrono::high_resolution_clock::now();
-    mlir::PassManager pm((op)->getName());
-    
-    
-    // Apply any generic pass manager command line options and run the pipeline.
-    applyPassManagerCLOptions(pm);
-    
-    bufferization::OneShotBufferizationOptions options;
-    //options.allowReturnAllocs = true;
-    options.bufferizeFunctionBoundaries = true;
-    //options.createDeallocs = true;
-    options.setFunctionBoundaryTypeConversion(mlir::bufferization::LayoutMapOption::IdentityLayoutMap);
-    //pm.addPass(createTransformDialectInterpreterPass(transformDialectString));
-
-    //pm.addPass(createTestTransformDialectEraseSchedulePass());
-    pm.addPass(mlir::createLoopInvariantCodeMotionPass());
-    pm.addPass(mlir::createCSEPass());
-    pm.addPass(mlir::createCanonicalizerPass());
-    pm.addPass(mlir::createCSEPass());
-
-    pm.addPass(mlir::bufferization::createEmptyTensorEliminationPass());
-    pm.addPass(mlir::bufferization::createEmptyTensorToAllocTensorPass());
-    
-    pm.addPass(mlir::bufferization::createOneShotBufferizePass(options));
-
-    mlir::OpPassManager &optPM = pm.nest<mlir::func::FuncOp>();
-    
-    optPM.addPass(mlir::bufferization::createBufferDeallocationPass());
-    //optPM.addPass(mlir::bufferization::createFinalizingBufferizePass());
-    //pm.addPass(mlir::createBufferizationToMemRefPass());
-    //optPM.addPass(mlir::bufferization::createBufferDeallocationPass());
-    
-    optPM.addPass(mlir::createConvertLinalgToLoopsPass());
-    optPM.addPass(mlir::createForEachThreadLowering());
-    pm.addPass(mlir::createConvertVectorToSCFPass());
-    pm.addPass(mlir::createConvertSCFToOpenMPPass());
-    pm.addPass(mlir::createCanonicalizerPass());
-    optPM.addPass(mlir::createLowerAffinePass());
-    optPM.addPass(memref::createExpandStridedMetadataPass());
-    pm.addPass(mlir::createFinalizeMemRefToLLVMConversionPass());
-    pm.addPass(mlir::createConvertSCFToCFPass());
-    pm.addPass(mlir::createLowerAffinePass());
-    optPM.addPass(mlir::createArithToLLVMConversionPass());
- 
-    pm.addPass(createConvertOpenMPToLLVMPass());
-     pm.addPass(createConvertVectorToLLVMPass());
-    pm.addPass(createConvertControlFlowToLLVMPass());
-    pm.addPass(mlir::createConvertFuncToLLVMPass());
-    pm.addPass(mlir::createReconcileUnrealizedCastsPass());
-
-    if (!mlir::failed(pm.run((op))))
-        (op)->print(output_run);
-    /*auto end = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);*/
-    
-
-
-    // Getting the evaluation uisng mlir-cpu-runner, the function uses a system call
+    // Lower the transformed code to the LLVM dialect, then run it to get the evaluation
     //auto start_eval = std::chrono::high_resolution_clock::now();
-    std::string OutputData = getEvaluation(outString);
+    // Candidates that already reached the same code, before or after the
+    // lowering, reuse its measurement
+    EvaluationCache &cache = EvaluationCache::get();
+    std::string transformedModule;
+    llvm::raw_string_ostream output_transformed(transformedModule);
+    op->print(output_transformed);
+    output_transformed.flush();
+    std::string transformedKey = cache.isEnabled() ? EvaluationCache::getKey(transformedModule) : "";
+    Measurement measurement;
+    if (!cache.lookup(transformedKey, measurement))
+    {
+        std::string loweredModule;
+        ResultStatus lowered = lowerToLLVMDialect(transformedModule, loweredModule);
+        measurement = Measurement(lowered);
+        if (lowered == ResultStatus::Ok)
+        {
+            std::string loweredKey = cache.isEnabled() ? EvaluationCache::getKey(loweredModule) : "";
+            if (!cache.lookup(loweredKey, measurement, false))
+            {
+                // Measurements are kept in the conditions of the start of the
+                // tuning, the drift is checked between candidates
+                MachineCalibration *calibration = MachineCalibration::get();
+                double drift = calibration != nullptr ? calibration->update() : 1;
+                measurement = executeLoweredModule(loweredModule);
+                MachineCalibration::normalize(measurement, drift);
+                cache.insert(loweredKey, measurement);
+            }
+        }
+        cache.insert(transformedKey, measurement, ScheduleDatabase::getSchedule(node));
+    }
+    op->erase();
+    Measurement::record(node, measurement);
+    std::string OutputData = measurement.toEvaluation();
+
         //op->dump();
    
     /*auto end_eval = std::chrono::high_resolution_clock::now();
     auto duration_eval = std::chrono::duration_cast<std::chrono::microseconds>(end_eval - start_eval);*/
     
     // Printing the evaluation 
-    if (std::getenv("AS_VERBOSE") != nullptr)
+    logEvaluation(node, OutputData);
+    return OutputData;
+}
+
+void EvaluationByExecution::evaluateTransformations(llvm::ArrayRef<Node *> nodes)
+{
+    for (Node *node : nodes)
+        node->setEvaluation(evaluateTransformation(node));
+}
+
+
+void EvaluationByExecution::logTransformation(Node *node, mlir::Operation *op)
+{
+    // The code of every candidate is only printed on request, the
+    // evaluation record carries the schedule
+    TuningLogger *logger = TuningLogger::get(LogsFileName);
+    if (logger == nullptr || node->getTransformation() == NULL || TuningLogger::getIRMode() != TuningLogger::IRMode::All)
+        return;
+    std::string code;
+    llvm::raw_string_ostream output(code);
+    op->print(output);
+    output.flush();
+    logTransformation(node, code);
+}
+
+void EvaluationByExecution::logTransformation(Node *node, const std::string &code)
+{
+    TuningLogger *logger = TuningLogger::get(LogsFileName);
+    if (logger == nullptr || node->getTransformation() == NULL || TuningLogger::getIRMode() != TuningLogger::IRMode::All)
+        return;
+    logger->log(TuningLogger::getCodeRecord(ScheduleDatabase::getSchedule(node), code));
+}
+
+void EvaluationByExecution::logEvaluation(Node *node, const std::string &OutputData)
+{
+    TuningLogger *logger = TuningLogger::get(LogsFileName);
+    if (logger == nullptr || node->getTransformation() == NULL)
+        return;
+    Measurement measurement(ResultStatus::RunFailed);
+    if (!Measurement::lookup(node, measurement))
     {
-        int asVerbose = std::stoi(std::getenv("AS_VERBOSE"));
-        if (asVerbose == 1)
+        // Evaluations that were not measured here only have their time
+        try
         {
-            std::ofstream debugFile;
-            debugFile.open(LogsFileName, std::ios_base::app);
-            if (debugFile.is_open())
+            double seconds = std::stod(OutputData);
+            if (OutputData != "9000000000000000000")
             {
-                if (node->getTransformation() != NULL)
-                {
-                    debugFile << OutputData << std::endl;
-                    /*debugFile << "Time taken by Lowerings: " << duration.count() << " microseconds" << std::endl;
-                    debugFile << "Time taken by Evaluation: " << duration_eval.count() << " microseconds" << std::endl;*/
-                }
-                debugFile.close();
+                measurement = Measurement(ResultStatus::Ok);
+                measurement.addSample(seconds);
             }
         }
+        catch (const std::exception &)
+        {
+        }
     }
-    return OutputData;
+    bool best = !measurement.isFailed() && logger->isNewBest(measurement.getMedian());
+    std::string code;
+    if (best && TuningLogger::getIRMode() == TuningLogger::IRMode::Best)
+    {
+        llvm::raw_string_ostream output(code);
+        ((mlir::Operation *)(*node->getTransformedCodeIr()).getIr())->print(output);
+        output.flush();
+    }
+    // The features make the logs a dataset of (features, time) pairs
+    std::vector<float> features = FeatureExtractor::extract((mlir::Operation *)(*node->getTransformedCodeIr()).getIr());
+    logger->log(TuningLogger::getEvaluationRecord(ScheduleDatabase::getSchedule(node), measurement, best, code, features));
 }
 
+ResultStatus EvaluationByExecution::lowerToLLVMDialect(const std::string &transformedModule, std::string &loweredModule)
+{
+    std::cout << "START VECT\n";
+    return EvaluationByRunnerPool::getSharedLoweringPool()->lower(transformedModule, loweredModule);
+}
 
+Measurement EvaluationByExecution::executeLoweredModule(const std::string &outString)
+{
+    // Getting the evaluation uisng mlir-cpu-runner, the function uses a system call.
+    // The runner also compiles the module, so it is given the lowering timeout
+    // on top of the cutoff before it is killed
+    double cutoff = Measurement::getRunCutoff();
+    bool killed = false;
+    Measurement measurement = Measurement::measure([&]()
+                                                   {
+        bool timedOut = false;
+        std::string evalString = getEvaluation(outString, cutoff > 0 ? Measurement::getLoweringTimeout() + cutoff : 0, &timedOut);
+        killed = killed || timedOut;
+        if (evalString == "9000000000000000000")
+            return -1.0;
+        try
+        {
+            return std::stod(evalString);
+        }
+        catch (const std::exception &)
+        {
+            return -1.0;
+        } }, cutoff);
+    if (killed)
+    {
+        Measurement censored(ResultStatus::Censored);
+        censored.addSample(cutoff);
+        return censored;
+    }
+    return measurement;
+}
 
 pid_t popen2(const char *command, int *infp, int *outfp)
 {
@@ -347,8 +383,10 @@ std::string removeExtraModuleTagCreated(std::string input) // TODO: Figure out w
 /// feeds it the input code, captures the command's output 
 /// Returns the captured output as a string, optionally stripping
 /// newline characters from the output.
+/// With a timeout, the child is killed once it runs longer than
+/// timeoutSeconds and timedOut is set.
 
-std::string getEvaluation(std::string inputCode)
+std::string getEvaluation(std::string inputCode, double timeoutSeconds, bool *timedOut)
 {
 
     std::string command = "";
@@ -368,32 +406,50 @@ std::string getEvaluation(std::string inputCode)
     write(in_fd, inputCode.c_str(), inputCode.size());
 
     close(in_fd);
-    // Read the output of the executed command
-    const int max_output_size = 4280;
-    std::vector<char> output_data(max_output_size); // Using a dynamic buffer
-
-    ssize_t total_bytes_read = 0;
+    // Read the output of the executed command, the whole output is drained so
+    // that a kernel printing a lot is neither blocked nor killed by SIGPIPE,
+    // only its tail (where printFlops prints) is kept
+    const size_t max_output_size = 4280;
+    std::string output_data;
+    char buffer[4096];
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timeoutSeconds));
 
     while (true)
     {
-        ssize_t bytes_read = read(out_fd, output_data.data() + total_bytes_read, output_data.size() - total_bytes_read);
-
-        if (bytes_read > 0)
+        if (timeoutSeconds > 0)
         {
-            total_bytes_read += bytes_read;
-
-            // Check if the buffer is full (you can adjust this condition based on your needs)
-            if (total_bytes_read == max_output_size)
+            int remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            struct pollfd pfd = {out_fd, POLLIN, 0};
+            int ready = remaining > 0 ? poll(&pfd, 1, remaining) : 0;
+            if (ready < 0 && errno == EINTR)
+                continue;
+            if (ready == 0)
             {
-                break; // Exit the loop to avoid buffer overflow
+                // The candidate is too slow to be worth finishing
+                printf("Cpu Runner Child process timed out.\n");
+                kill(pid, SIGKILL);
+                close(out_fd);
+                waitpid(pid, NULL, 0);
+                if (timedOut != nullptr)
+                    *timedOut = true;
+                return "9000000000000000000";
             }
         }
+        ssize_t bytes_read = read(out_fd, buffer, sizeof(buffer));
+
+        if (bytes_read > 0)
+        {
+            output_data.append(buffer, bytes_read);
+            if (output_data.size() > max_output_size)
+                output_data.erase(0, output_data.size() - max_output_size);
+        }
         else if (bytes_read == 0)
         {
             // No more data available to read
             break;
         }
-        else
+        else if (errno != EINTR)
         {
             // Error occurred while reading
             perror("Error while reading output");
@@ -403,7 +459,7 @@ std::string getEvaluation(std::string inputCode)
 
     // Remove newline characters from the output data
     output_data.erase(std::remove(output_data.begin(), output_data.end(), '\n'), output_data.end());
-    printf("Command output:\n%s\n", output_data.data());
+    printf("Command output:\n%s\n", output_data.c_str());
 
     close(out_fd); // Close the output file descriptor
 
@@ -418,7 +474,7 @@ std::string getEvaluation(std::string inputCode)
         printf("Cpu Runner Child process exited with status: %d\n", exit_status);
          
         std::string evalString = "";
-        std::string data(output_data.begin(), output_data.end());
+        std::string data = output_data;
 
         size_t lastGFLOPSPos = data.rfind("GFLOPS"); // Find the position of the last "GFLOPS"
         if (lastGFLOPSPos != std::string::npos) {
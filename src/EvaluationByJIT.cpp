@@ -0,0 +1,402 @@
+//===------------------- EvaluationByJIT.cpp - EvaluationByJIT -------------===//
+//
+///===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implmentation of the EvaluationByJIT class, which
+/// contains an evaluator of the transformed code that runs the lowered module
+/// in-process with the MLIR ExecutionEngine
+///
+//===----------------------------------------------------------------------===//
+
+#include "EvaluationByJIT.h"
+#include "ObjectCache.h"
+#include "PerfCounters.h"
+#include "RegionTiming.h"
+
+#include "mlir/Dialect/LLVMIR/LLVMDialect.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/TargetParser/Host.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <unordered_set>
+
+using namespace mlir;
+
+/// Values passed to printFlops by the kernel currently running on this thread.
+static thread_local std::vector<double> CapturedFlops;
+
+/// Replaces the runner utils' printFlops, the kernel reports its timing through
+/// it, so capturing the value avoids scraping the text printed on stderr.
+static void capturePrintFlops(double flops)
+{
+    CapturedFlops.push_back(flops);
+}
+
+/// Counters read around the timed region of the kernel currently running on
+/// this thread.
+static thread_local std::vector<uint64_t> CapturedCounters;
+
+/// Replaces the counter hook called right before the timed region.
+static void startCounters()
+{
+    if (PerfCounters *counters = PerfCounters::get())
+        counters->start();
+}
+
+/// Replaces the counter hook called right after the timed region.
+static void stopCounters()
+{
+    if (PerfCounters *counters = PerfCounters::get())
+        CapturedCounters = counters->stop();
+}
+
+/// Buffers allocated by the JIT-compiled code during the current call of main
+/// and not freed yet. The kernels allocate and free buffers on the OpenMP
+/// workers as well as on the calling thread, the set is shared by all the
+/// threads of the process. The buffers returned to main by the kernel (the
+/// results of the calls) are never freed by the lowered code, they are freed
+/// once main returned.
+static std::mutex AllocationsMutex;
+static std::unordered_set<void *> LiveAllocations;
+static bool TrackingAllocations = false;
+/// Held during each call of main, the calls of several threads never share
+/// the set of allocations.
+static std::mutex CallMutex;
+
+static void *trackAllocation(void *buffer)
+{
+    std::lock_guard<std::mutex> lock(AllocationsMutex);
+    if (TrackingAllocations && buffer != nullptr)
+        LiveAllocations.insert(buffer);
+    return buffer;
+}
+
+/// Replaces malloc in the JIT-compiled code.
+static void *trackedMalloc(size_t size)
+{
+    return trackAllocation(std::malloc(size));
+}
+
+/// Replaces aligned_alloc in the JIT-compiled code.
+static void *trackedAlignedAlloc(size_t alignment, size_t size)
+{
+    return trackAllocation(std::aligned_alloc(alignment, size));
+}
+
+/// Replaces free in the JIT-compiled code.
+static void trackedFree(void *buffer)
+{
+    {
+        std::lock_guard<std::mutex> lock(AllocationsMutex);
+        LiveAllocations.erase(buffer);
+    }
+    std::free(buffer);
+}
+
+/// Symbols of the runner utils, allocation functions and counter hooks
+/// replaced in the JIT-compiled kernels.
+static llvm::orc::SymbolMap getOverriddenSymbols(llvm::orc::MangleAndInterner &interner)
+{
+    llvm::orc::SymbolMap symbolMap;
+    symbolMap[interner("printFlops")] = {llvm::orc::ExecutorAddr::fromPtr(&capturePrintFlops),
+                                         llvm::JITSymbolFlags::Exported};
+    symbolMap[interner(COUNTERS_START)] = {llvm::orc::ExecutorAddr::fromPtr(&startCounters),
+                                           llvm::JITSymbolFlags::Exported};
+    symbolMap[interner(COUNTERS_STOP)] = {llvm::orc::ExecutorAddr::fromPtr(&stopCounters),
+                                          llvm::JITSymbolFlags::Exported};
+    symbolMap[interner("malloc")] = {llvm::orc::ExecutorAddr::fromPtr(&trackedMalloc), llvm::JITSymbolFlags::Exported};
+    symbolMap[interner("aligned_alloc")] = {llvm::orc::ExecutorAddr::fromPtr(&trackedAlignedAlloc),
+                                            llvm::JITSymbolFlags::Exported};
+    symbolMap[interner("free")] = {llvm::orc::ExecutorAddr::fromPtr(&trackedFree), llvm::JITSymbolFlags::Exported};
+    return symbolMap;
+}
+
+/// Turns the empty counter hooks of the lowered module into declarations, the
+/// JIT then resolves them to startCounters and stopCounters.
+static void detachCounterHooks(mlir::ModuleOp module)
+{
+    for (const char *name : {COUNTERS_START, COUNTERS_STOP})
+    {
+        mlir::LLVM::LLVMFuncOp hook = module.lookupSymbol<mlir::LLVM::LLVMFuncOp>(name);
+        if (!hook || hook.isExternal())
+            continue;
+        hook.getBody().dropAllReferences();
+        hook.getBody().getBlocks().clear();
+    }
+}
+
+/// Returns the shared libraries from the comma separated SHARED_LIBS variable,
+/// the same list that is given to mlir-cpu-runner.
+static llvm::ArrayRef<llvm::StringRef> getSharedLibPaths()
+{
+    static std::vector<std::string> libs;
+    static std::vector<llvm::StringRef> libRefs;
+    static std::once_flag once;
+    std::call_once(once, []()
+                   {
+        if (std::getenv("SHARED_LIBS") == nullptr)
+            return;
+        llvm::SmallVector<llvm::StringRef, 4> parts;
+        llvm::StringRef(std::getenv("SHARED_LIBS")).split(parts, ',', -1, false);
+        for (llvm::StringRef part : parts)
+            libs.push_back(part.trim().str());
+        for (const std::string &lib : libs)
+            libRefs.push_back(lib); });
+    return libRefs;
+}
+
+EvaluationByJIT::EvaluationByJIT() : runner(std::make_unique<RunnerPool>(1))
+{
+}
+EvaluationByJIT::EvaluationByJIT(std::string LogsFileName)
+    : EvaluationByExecution(LogsFileName), runner(std::make_unique<RunnerPool>(1))
+{
+}
+
+Measurement EvaluationByJIT::executeLoweredModule(const std::string &loweredModule)
+{
+    // A run in the tuner could not be interrupted, the runner stops a slow
+    // run at the cutoff and is replaced
+    Measurement measurement = runner->run(loweredModule);
+    std::cout << measurement.summary() << std::endl;
+    return measurement;
+}
+
+/// Describes the code generation of the JIT, objects compiled with other
+/// options or for another machine are not reused.
+static std::string getCodegenOptions()
+{
+    std::string options = std::string("llvm-") + LLVM_VERSION_STRING + ";" + llvm::sys::getProcessTriple() + ";" +
+                          llvm::sys::getHostCPUName().str() + ";O";
+    if (std::getenv("AS_JIT_OPT_LEVEL") != nullptr)
+        options += std::getenv("AS_JIT_OPT_LEVEL");
+    return options;
+}
+
+/// Runs main repeatedly through invokeMain and collects the values passed to
+/// printFlops, the measurement keeps the mean of the counters of the runs.
+static Measurement measureMain(const std::function<llvm::Error()> &invokeMain, double cutoffSeconds,
+                               const std::function<void(double)> &armWatchdog)
+{
+    // The watchdog bounds whole calls of main while the cutoff applies to the
+    // timed region, the untimed part of a call (the initialization of the
+    // inputs) is measured on the first completed call and added to the
+    // cutoff. Until then, the first warm-up run starts the OpenMP threads
+    // and faults the pages in, it gets the allowance of the compilation.
+    double untimedSeconds = -1;
+    auto callMain = [&]()
+    {
+        bool armed = armWatchdog && cutoffSeconds > 0;
+        if (armed)
+            armWatchdog(cutoffSeconds + (untimedSeconds >= 0 ? untimedSeconds : Measurement::getLoweringTimeout()));
+        CapturedFlops.clear();
+        std::unique_lock<std::mutex> callLock(CallMutex);
+        {
+            std::lock_guard<std::mutex> lock(AllocationsMutex);
+            LiveAllocations.clear();
+            TrackingAllocations = true;
+        }
+        auto start = std::chrono::steady_clock::now();
+        llvm::Error error = invokeMain();
+        double callSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (armed)
+            armWatchdog(0);
+        // The buffers left by a call (results of the kernel, alloc_tensor
+        // buffers) are freed before the next one, the OpenMP workers are idle
+        // once main returned
+        std::unordered_set<void *> allocations;
+        {
+            std::lock_guard<std::mutex> lock(AllocationsMutex);
+            TrackingAllocations = false;
+            allocations.swap(LiveAllocations);
+        }
+        callLock.unlock();
+        for (void *buffer : allocations)
+            std::free(buffer);
+        if (!error && untimedSeconds < 0 && !CapturedFlops.empty())
+            untimedSeconds = std::max(callSeconds - CapturedFlops.back() / 1.0E9, 0.0);
+        return error;
+    };
+
+    // The first runs start the OpenMP threads and fault the pages of the
+    // kernel in, they are not timed
+    for (int i = 0; i < Measurement::getWarmupRuns(); ++i)
+    {
+        llvm::Error error = callMain();
+        if (error)
+        {
+            llvm::errs() << "Failed to run main: " << llvm::toString(std::move(error)) << "\n";
+            return Measurement(ResultStatus::RunFailed);
+        }
+    }
+
+    bool noTiming = false;
+    std::vector<double> counterSums;
+    int countedRuns = 0;
+    Measurement measurement = Measurement::measure([&]()
+                                                   {
+        CapturedCounters.clear();
+        llvm::Error error = callMain();
+        if (error)
+        {
+            llvm::errs() << "Failed to run main: " << llvm::toString(std::move(error)) << "\n";
+            return -1.0;
+        }
+        if (CapturedFlops.empty())
+        {
+            std::cout << "No GFLOPS found in the input string." << std::endl;
+            noTiming = true;
+            return -1.0;
+        }
+        if (!CapturedCounters.empty())
+        {
+            counterSums.resize(CapturedCounters.size(), 0);
+            for (size_t i = 0; i < CapturedCounters.size(); ++i)
+                counterSums[i] = CapturedCounters[i] == PERF_COUNTER_UNAVAILABLE || counterSums[i] < 0
+                                     ? -1
+                                     : counterSums[i] + CapturedCounters[i];
+            ++countedRuns;
+        }
+        // printFlops prints flops / 1.0E9, the same value mlir-cpu-runner shows
+        return CapturedFlops.back() / 1.0E9; }, cutoffSeconds);
+    if (noTiming)
+        measurement.setStatus(ResultStatus::NoTiming);
+    for (double sum : counterSums)
+        measurement.addCounter(sum < 0 ? PERF_COUNTER_UNAVAILABLE : (uint64_t)(sum / countedRuns));
+    std::cout << measurement.summary() << std::endl;
+    return measurement;
+}
+
+/// Loads an object compiled by a previous ExecutionEngine in a bare LLJIT with
+/// the same shared libraries and printFlops override, and measures its main.
+static Measurement runObject(std::unique_ptr<llvm::MemoryBuffer> object, double cutoffSeconds,
+                             const std::function<void(double)> &armWatchdog)
+{
+    llvm::Expected<std::unique_ptr<llvm::orc::LLJIT>> maybeJit = llvm::orc::LLJITBuilder().create();
+    if (!maybeJit)
+    {
+        llvm::errs() << "Failed to create the JIT: " << llvm::toString(maybeJit.takeError()) << "\n";
+        return Measurement(ResultStatus::RunFailed);
+    }
+    std::unique_ptr<llvm::orc::LLJIT> jit = std::move(*maybeJit);
+    llvm::orc::JITDylib &mainDylib = jit->getMainJITDylib();
+    char globalPrefix = jit->getDataLayout().getGlobalPrefix();
+
+    llvm::orc::MangleAndInterner interner(jit->getExecutionSession(), jit->getDataLayout());
+    llvm::Error error = mainDylib.define(llvm::orc::absoluteSymbols(getOverriddenSymbols(interner)));
+    for (llvm::StringRef lib : getSharedLibPaths())
+    {
+        if (error)
+            break;
+        llvm::Expected<std::unique_ptr<llvm::orc::DynamicLibrarySearchGenerator>> generator =
+            llvm::orc::DynamicLibrarySearchGenerator::Load(lib.str().c_str(), globalPrefix);
+        if (!generator)
+            error = generator.takeError();
+        else
+            mainDylib.addGenerator(std::move(*generator));
+    }
+    if (!error)
+    {
+        llvm::Expected<std::unique_ptr<llvm::orc::DynamicLibrarySearchGenerator>> generator =
+            llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(globalPrefix);
+        if (!generator)
+            error = generator.takeError();
+        else
+            mainDylib.addGenerator(std::move(*generator));
+    }
+    if (!error)
+        error = jit->addObjectFile(std::move(object));
+    if (error)
+    {
+        llvm::errs() << "Failed to load the cached object: " << llvm::toString(std::move(error)) << "\n";
+        return Measurement(ResultStatus::RunFailed);
+    }
+
+    // The entry point lowered from `func.func @main()` takes no arguments
+    llvm::Expected<llvm::orc::ExecutorAddr> mainAddress = jit->lookup("main");
+    if (!mainAddress)
+    {
+        llvm::errs() << "Failed to find main: " << llvm::toString(mainAddress.takeError()) << "\n";
+        return Measurement(ResultStatus::RunFailed);
+    }
+    void (*mainFunction)() = mainAddress->toPtr<void (*)()>();
+    return measureMain([&]()
+                       {
+        mainFunction();
+        return llvm::Error::success(); }, cutoffSeconds, armWatchdog);
+}
+
+Measurement EvaluationByJIT::runMain(mlir::ModuleOp module, double cutoffSeconds,
+                                     const std::function<void(double)> &armWatchdog)
+{
+    static std::once_flag nativeTargetInitialized;
+    std::call_once(nativeTargetInitialized, []()
+                   {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter(); });
+    detachCounterHooks(module);
+
+    // Machine code generated for the same lowered module is reused, only the
+    // measurement runs again
+    ObjectCache *objectCache = ObjectCache::get();
+    std::string objectKey;
+    if (objectCache != nullptr)
+    {
+        std::string loweredModule;
+        llvm::raw_string_ostream output(loweredModule);
+        module->print(output);
+        output.flush();
+        objectKey = ObjectCache::getKey(loweredModule, getCodegenOptions());
+        if (std::unique_ptr<llvm::MemoryBuffer> object = objectCache->load(objectKey))
+            return runObject(std::move(object), cutoffSeconds, armWatchdog);
+    }
+
+    // Mirror the optimization levels of the mlir-cpu-runner invocation (no -O
+    // flag) unless AS_JIT_OPT_LEVEL asks for a specific one
+    mlir::ExecutionEngineOptions engineOptions;
+    if (std::getenv("AS_JIT_OPT_LEVEL") != nullptr)
+    {
+        unsigned optLevel = std::stoi(std::getenv("AS_JIT_OPT_LEVEL"));
+        engineOptions.transformer = mlir::makeOptimizingTransformer(optLevel, /*sizeLevel=*/0, /*targetMachine=*/nullptr);
+        engineOptions.jitCodeGenOptLevel = static_cast<llvm::CodeGenOptLevel>(optLevel);
+    }
+    engineOptions.sharedLibPaths = getSharedLibPaths();
+    engineOptions.enableObjectDump = objectCache != nullptr;
+
+    llvm::Expected<std::unique_ptr<mlir::ExecutionEngine>> maybeEngine =
+        mlir::ExecutionEngine::create(module, engineOptions);
+    if (!maybeEngine)
+    {
+        llvm::errs() << "Failed to create the execution engine: " << llvm::toString(maybeEngine.takeError()) << "\n";
+        return Measurement(ResultStatus::RunFailed);
+    }
+    std::unique_ptr<mlir::ExecutionEngine> engine = std::move(*maybeEngine);
+
+    // Symbols of the main JITDylib take precedence over the shared libraries
+    engine->registerSymbols([](llvm::orc::MangleAndInterner interner)
+                            { return getOverriddenSymbols(interner); });
+
+    // The engine compiles lazily, looking main up generates the machine code,
+    // which is only then available to the object cache
+    llvm::Expected<void (*)(void **)> mainFunction = engine->lookupPacked("main");
+    if (!mainFunction)
+    {
+        llvm::errs() << "Failed to find main: " << llvm::toString(mainFunction.takeError()) << "\n";
+        return Measurement(ResultStatus::RunFailed);
+    }
+    if (objectCache != nullptr)
+        objectCache->store(objectKey, *engine);
+
+    // The module is compiled once, only main is called again for each
+    // repetition
+    return measureMain([&]()
+                       {
+        (*mainFunction)(nullptr);
+        return llvm::Error::success(); }, cutoffSeconds, armWatchdog);
+}
@@ -0,0 +1,300 @@
+//===------------ EvaluationByRunnerPool.cpp - EvaluationByRunnerPool -----===//
+//
+///===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implmentation of the EvaluationByRunnerPool class,
+/// which contains an evaluator of the transformed code that executes the
+/// lowered candidates on a pool of persistent runner worker processes
+///
+//===----------------------------------------------------------------------===//
+
+#include "EvaluationByRunnerPool.h"
+#include "BoundedQueue.h"
+#include "EvaluationCache.h"
+#include "MachineCalibration.h"
+#include "ScheduleDatabase.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <unordered_map>
+
+#include <pthread.h>
+#include <sched.h>
+
+using namespace mlir;
+
+EvaluationByRunnerPool::EvaluationByRunnerPool(std::string LogsFileName) : EvaluationByExecution(LogsFileName)
+{
+    this->pool = getSharedPool();
+    this->scheduler = getSharedScheduler();
+}
+
+std::shared_ptr<RunnerPool> EvaluationByRunnerPool::getSharedPool()
+{
+    static std::shared_ptr<RunnerPool> sharedPool;
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!sharedPool)
+    {
+        if (std::getenv("AS_EVAL_SLOTS") != nullptr)
+        {
+            int numSlots = std::stoi(std::getenv("AS_EVAL_SLOTS"));
+            sharedPool = std::make_shared<RunnerPool>(EvaluationScheduler::partitionCores(numSlots, getCompileThreads()));
+        }
+        else
+        {
+            int numWorkers = 1;
+            if (std::getenv("AS_RUNNER_WORKERS") != nullptr)
+                numWorkers = std::stoi(std::getenv("AS_RUNNER_WORKERS"));
+            sharedPool = std::make_shared<RunnerPool>(numWorkers);
+        }
+    }
+    return sharedPool;
+}
+
+std::shared_ptr<RunnerPool> EvaluationByRunnerPool::getSharedLoweringPool()
+{
+    static std::shared_ptr<RunnerPool> sharedLoweringPool;
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!sharedLoweringPool)
+    {
+        // One worker per compile thread, on the cores kept out of the slots
+        if (std::getenv("AS_EVAL_SLOTS") != nullptr)
+            sharedLoweringPool = std::make_shared<RunnerPool>(std::vector<std::vector<int>>(
+                getCompileThreads(), EvaluationScheduler::getReservedCores(getCompileThreads())));
+        else
+            sharedLoweringPool = std::make_shared<RunnerPool>(getCompileThreads());
+    }
+    return sharedLoweringPool;
+}
+
+std::shared_ptr<EvaluationScheduler> EvaluationByRunnerPool::getSharedScheduler()
+{
+    static std::shared_ptr<EvaluationScheduler> sharedScheduler;
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!sharedScheduler)
+        sharedScheduler = std::make_shared<EvaluationScheduler>(getSharedPool());
+    return sharedScheduler;
+}
+
+int EvaluationByRunnerPool::getCompileThreads()
+{
+    int compileThreads = 1;
+    if (std::getenv("AS_COMPILE_THREADS") != nullptr)
+        compileThreads = std::stoi(std::getenv("AS_COMPILE_THREADS"));
+    return std::max(compileThreads, 1);
+}
+
+/// Prints the code of the candidate, it is only read in the context of the
+/// search.
+static std::string printModule(Node *node)
+{
+    std::string transformedModule;
+    llvm::raw_string_ostream output_transformed(transformedModule);
+    ((mlir::Operation *)((MLIRCodeIR *)node->getTransformedCodeIr())->getIr())->print(output_transformed);
+    output_transformed.flush();
+    return transformedModule;
+}
+
+bool EvaluationByRunnerPool::lowerToString(Node *node, const std::string &transformedModule, std::string &loweredModule,
+                                           std::vector<std::string> &cacheKeys, Measurement &cached)
+{
+    EvaluationCache &cache = EvaluationCache::get();
+    bool cacheHit = !cacheKeys.empty() && cache.lookup(cacheKeys.front(), cached);
+    loweredModule = "";
+    if (cacheHit)
+        return true;
+
+    logTransformation(node, transformedModule);
+    ResultStatus lowered = lowerToLLVMDialect(transformedModule, loweredModule);
+    if (lowered != ResultStatus::Ok)
+    {
+        // Nothing to run, the candidate already has its measurement
+        cached = Measurement(lowered);
+        return true;
+    }
+    if (!cacheKeys.empty())
+    {
+        // The miss of the candidate was counted on its transformed module
+        cacheKeys.push_back(EvaluationCache::getKey(loweredModule));
+        if ((cacheHit = cache.lookup(cacheKeys.back(), cached, false)))
+            cache.insert(cacheKeys.front(), cached);
+    }
+    return cacheHit;
+}
+
+void EvaluationByRunnerPool::evaluateTransformations(llvm::ArrayRef<Node *> nodes)
+{
+    if (nodes.empty())
+        return;
+
+    // Enough lowered candidates are kept ahead to refill every slot
+    BoundedQueue<std::pair<size_t, std::string>> loweredQueue(2 * pool->getNumWorkers());
+    int compileThreads = std::min<int>(getCompileThreads(), nodes.size());
+    std::vector<int> compileCores;
+    if (std::getenv("AS_EVAL_SLOTS") != nullptr)
+        compileCores = EvaluationScheduler::getReservedCores(getCompileThreads());
+
+    // Filled by the compile threads, each one only writes the entries of the
+    // candidates it lowers
+    std::vector<char> cacheHits(nodes.size(), false);
+    std::vector<Measurement> cachedMeasurements(nodes.size());
+    std::vector<std::vector<std::string>> cacheKeys(nodes.size());
+    // Candidates of the batch that reached the same code as an earlier one
+    // are measured once, they take the measurement of the first
+    EvaluationCache &cache = EvaluationCache::get();
+    std::unordered_map<std::string, size_t> batchKeys;
+    std::mutex batchMutex;
+    std::vector<size_t> duplicateOf(nodes.size(), nodes.size());
+
+    // The drift of the machine is checked before the compile threads start
+    // and after they joined, on a core of the first slot while its worker is
+    // idle, so that neither the lowering nor the candidates slow the reference
+    // kernel down. Checks closer than the interval of the calibration reuse
+    // the last drift.
+    MachineCalibration *calibration = MachineCalibration::get();
+    std::vector<int> calibrationCores;
+    if (calibration != nullptr && std::getenv("AS_EVAL_SLOTS") != nullptr)
+    {
+        std::vector<std::vector<int>> slots = EvaluationScheduler::partitionCores(std::stoi(std::getenv("AS_EVAL_SLOTS")),
+                                                                                  getCompileThreads());
+        if (!slots.empty() && !slots[0].empty())
+            calibrationCores.push_back(slots[0][0]);
+    }
+    double driftBefore = calibration != nullptr ? calibration->update(calibrationCores) : 1;
+
+    std::atomic<size_t> nextNode(0);
+    std::atomic<int> runningCompilers(compileThreads);
+    std::vector<std::thread> compilers;
+    for (int i = 0; i < compileThreads; ++i)
+    {
+        compilers.emplace_back([&]()
+                               {
+            // The compile threads stay off the cores of the measurement slots
+            if (!compileCores.empty())
+            {
+                cpu_set_t cpuSet;
+                CPU_ZERO(&cpuSet);
+                for (int cpu : compileCores)
+                    CPU_SET(cpu, &cpuSet);
+                pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+            }
+            size_t index;
+            while ((index = nextNode++) < nodes.size())
+            {
+                std::string transformedModule = printModule(nodes[index]);
+                if (cache.isEnabled())
+                {
+                    cacheKeys[index].push_back(EvaluationCache::getKey(transformedModule));
+                    std::lock_guard<std::mutex> lock(batchMutex);
+                    auto inserted = batchKeys.insert(std::make_pair(cacheKeys[index].front(), index));
+                    if (!inserted.second)
+                    {
+                        duplicateOf[index] = inserted.first->second;
+                        continue;
+                    }
+                }
+                std::string loweredModule;
+                Measurement cached;
+                // Duplicates of evaluated candidates and failed lowerings never
+                // reach the slots
+                if (lowerToString(nodes[index], transformedModule, loweredModule, cacheKeys[index], cached))
+                {
+                    cacheHits[index] = true;
+                    cachedMeasurements[index] = cached;
+                }
+                else
+                    loweredQueue.push(std::make_pair(index, loweredModule));
+            }
+            if (--runningCompilers == 0)
+                loweredQueue.close(); });
+    }
+
+    std::vector<Measurement> measurements = scheduler->runAll(nodes.size(), [&](size_t &index, std::string &loweredModule)
+                                                             {
+        std::pair<size_t, std::string> item;
+        if (!loweredQueue.pop(item))
+            return false;
+        index = item.first;
+        loweredModule = std::move(item.second);
+        return true; });
+    for (std::thread &compiler : compilers)
+        compiler.join();
+    if (calibration != nullptr)
+    {
+        double driftAfter = calibration->update(calibrationCores);
+        for (size_t i = 0; i < nodes.size(); ++i)
+            if (!cacheHits[i] && duplicateOf[i] == nodes.size())
+                MachineCalibration::normalize(measurements[i], (driftBefore + driftAfter) / 2);
+        if (MachineCalibration::hasShifted(driftBefore, driftAfter))
+        {
+            // Only the measured candidates close enough to the fastest one of
+            // the batch for the drift to change their order are lowered and
+            // measured again, under the drift of the last check
+            double bestTime = INFINITY;
+            for (size_t i = 0; i < nodes.size(); ++i)
+                if (!cacheHits[i] && duplicateOf[i] == nodes.size() && !measurements[i].isFailed())
+                    bestTime = std::min(bestTime, measurements[i].getMedian());
+            double shift = std::max(driftBefore, driftAfter) / std::min(driftBefore, driftAfter);
+            std::vector<size_t> indices;
+            std::vector<std::string> modules;
+            for (size_t i = 0; i < nodes.size(); ++i)
+            {
+                if (cacheHits[i] || duplicateOf[i] < nodes.size() || measurements[i].isFailed() ||
+                    measurements[i].getMedian() > bestTime * shift)
+                    continue;
+                std::string loweredModule;
+                if (lowerToLLVMDialect(printModule(nodes[i]), loweredModule) != ResultStatus::Ok)
+                    continue;
+                indices.push_back(i);
+                modules.push_back(std::move(loweredModule));
+            }
+            if (!modules.empty())
+            {
+                calibration->addRemeasured();
+                std::vector<Measurement> remeasured = scheduler->runAll(modules);
+                for (size_t k = 0; k < indices.size(); ++k)
+                {
+                    measurements[indices[k]] = remeasured[k];
+                    MachineCalibration::normalize(measurements[indices[k]], driftAfter);
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        if (cacheHits[i])
+            measurements[i] = cachedMeasurements[i];
+        else if (duplicateOf[i] < nodes.size())
+            continue;
+        else
+        {
+            // The key of the transformed module comes first, it is the one
+            // stored with the schedule in the persistent database
+            for (size_t k = 0; k < cacheKeys[i].size(); ++k)
+                cache.insert(cacheKeys[i][k], measurements[i], k == 0 ? ScheduleDatabase::getSchedule(nodes[i]) : "");
+        }
+    }
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        if (duplicateOf[i] < nodes.size())
+            measurements[i] = measurements[duplicateOf[i]];
+        std::cout << measurements[i].summary() << std::endl;
+        Measurement::record(nodes[i], measurements[i]);
+        nodes[i]->setEvaluation(measurements[i].toEvaluation());
+        logEvaluation(nodes[i], measurements[i].toEvaluation());
+    }
+}
+
+Measurement EvaluationByRunnerPool::executeLoweredModule(const std::string &loweredModule)
+{
+    Measurement measurement = pool->run(loweredModule);
+    std::cout << measurement.summary() << std::endl;
+    return measurement;
+}
@@ -0,0 +1,113 @@
+//===------------------- EvaluationCache.cpp - EvaluationCache -------------===//
+//
+///===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implmentation of the EvaluationCache class, which
+/// contains the process-wide cache of the measurements keyed by a hash of the
+/// printed IR of the candidates
+///
+//===----------------------------------------------------------------------===//
+
+#include "EvaluationCache.h"
+#include "ScheduleDatabase.h"
+
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdlib>
+
+EvaluationCache::EvaluationCache()
+{
+    this->enabled = true;
+    if (std::getenv("AS_EVAL_CACHE") != nullptr)
+        this->enabled = std::stoi(std::getenv("AS_EVAL_CACHE")) != 0;
+    this->hits = 0;
+    this->misses = 0;
+}
+
+EvaluationCache &EvaluationCache::get()
+{
+    static EvaluationCache cache;
+    return cache;
+}
+
+std::string EvaluationCache::getKey(mlir::Operation *op)
+{
+    std::string printedModule;
+    llvm::raw_string_ostream output(printedModule);
+    op->print(output);
+    output.flush();
+    return getKey(printedModule);
+}
+
+std::string EvaluationCache::getKey(const std::string &printedModule)
+{
+    std::array<uint8_t, 20> hash = llvm::SHA1::hash(
+        llvm::ArrayRef<uint8_t>((const uint8_t *)printedModule.data(), printedModule.size()));
+    return std::string(hash.begin(), hash.end());
+}
+
+bool EvaluationCache::isEnabled()
+{
+    return enabled;
+}
+
+bool EvaluationCache::lookup(const std::string &key, Measurement &measurement, bool firstKey)
+{
+    if (!enabled)
+        return false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it != entries.end())
+        {
+            hits++;
+            measurement = it->second;
+            return true;
+        }
+    }
+
+    // Candidates measured by previous runs on this machine, the database only
+    // stores the first key of the candidates
+    ScheduleDatabase *database = ScheduleDatabase::get();
+    bool found = firstKey && database != nullptr && database->lookup(key, measurement);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (found)
+    {
+        hits++;
+        if (!measurement.isFailed())
+            entries[key] = measurement;
+    }
+    else if (firstKey)
+        misses++;
+    return found;
+}
+
+void EvaluationCache::insert(const std::string &key, const Measurement &measurement, const std::string &schedule)
+{
+    if (!enabled)
+        return;
+    // Crashes, timeouts, censored runs and failed runs may not happen again,
+    // only the final results are reused
+    if (!measurement.isFailed())
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries[key] = measurement;
+    }
+    ScheduleDatabase *database = ScheduleDatabase::get();
+    if (database != nullptr && !schedule.empty())
+        database->insert(key, schedule, measurement);
+}
+
+int EvaluationCache::getHits()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return hits;
+}
+
+int EvaluationCache::getMisses()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return misses;
+}
@@ -0,0 +1,171 @@
+//===----------------- EvaluationScheduler.cpp - EvaluationScheduler -------===//
+//
+///===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implmentation of the EvaluationScheduler class,
+/// which contains a scheduler that runs several lowered candidates at once on
+/// disjoint slots of cores
+///
+//===----------------------------------------------------------------------===//
+
+#include "EvaluationScheduler.h"
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+#include <sched.h>
+
+/// Returns the time of a measurement, failed measurements are returned as
+/// negative values.
+static double getTime(const Measurement &measurement)
+{
+    if (measurement.isFailed())
+        return -1;
+    return measurement.getMedian();
+}
+
+EvaluationScheduler::EvaluationScheduler(std::shared_ptr<RunnerPool> pool)
+{
+    this->pool = pool;
+    this->activeSlots = pool->getNumWorkers();
+    this->interferenceTolerance = 0.05;
+    if (std::getenv("AS_INTERFERENCE_TOLERANCE") != nullptr)
+        this->interferenceTolerance = std::stod(std::getenv("AS_INTERFERENCE_TOLERANCE"));
+    this->referenceSoloTime = -1;
+}
+
+std::vector<int> EvaluationScheduler::getAllowedCores()
+{
+    // Only the cores we are allowed on (SLURM cpusets, taskset, ...)
+    std::vector<int> cpus;
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    if (sched_getaffinity(0, sizeof(cpuSet), &cpuSet) == 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &cpuSet))
+                cpus.push_back(cpu);
+        }
+    }
+    if (cpus.empty())
+    {
+        for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+std::vector<std::vector<int>> EvaluationScheduler::partitionCores(int numSlots, int reservedCores)
+{
+    std::vector<int> cpus = getAllowedCores();
+    // At least one core is kept for the measurements
+    reservedCores = std::max(0, std::min(reservedCores, (int)cpus.size() - 1));
+    cpus.resize(cpus.size() - reservedCores);
+
+    numSlots = std::max(1, std::min(numSlots, (int)cpus.size()));
+    size_t slotSize = cpus.size() / numSlots;
+    std::vector<std::vector<int>> slots(numSlots);
+    for (int slot = 0; slot < numSlots; ++slot)
+        slots[slot].assign(cpus.begin() + slot * slotSize, cpus.begin() + (slot + 1) * slotSize);
+    return slots;
+}
+
+std::vector<int> EvaluationScheduler::getReservedCores(int reservedCores)
+{
+    std::vector<int> cpus = getAllowedCores();
+    reservedCores = std::max(0, std::min(reservedCores, (int)cpus.size() - 1));
+    return std::vector<int>(cpus.end() - reservedCores, cpus.end());
+}
+
+int EvaluationScheduler::getActiveSlots()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return activeSlots;
+}
+
+void EvaluationScheduler::checkInterference(double concurrentReferenceTime)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (referenceSoloTime <= 0 || concurrentReferenceTime <= 0 || activeSlots == 1)
+        return;
+    double slowdown = concurrentReferenceTime / referenceSoloTime;
+    if (slowdown > 1 + interferenceTolerance)
+    {
+        activeSlots = std::max(1, activeSlots / 2);
+        std::cout << "Measurement interference detected (reference slowed down by " << slowdown
+                  << "x), using " << activeSlots << " concurrent slots" << std::endl;
+    }
+}
+
+std::vector<Measurement> EvaluationScheduler::runAll(const std::vector<std::string> &loweredModules)
+{
+    std::mutex nextMutex;
+    size_t next = 0;
+    return runAll(loweredModules.size(), [&](size_t &index, std::string &loweredModule)
+                  {
+        std::lock_guard<std::mutex> lock(nextMutex);
+        if (next >= loweredModules.size())
+            return false;
+        index = next;
+        loweredModule = loweredModules[next++];
+        return true; });
+}
+
+std::vector<Measurement> EvaluationScheduler::runAll(size_t numModules,
+                                                     const std::function<bool(size_t &index, std::string &loweredModule)> &nextModule)
+{
+    std::vector<Measurement> results(numModules, Measurement(ResultStatus::LoweringFailed));
+    int concurrency = getActiveSlots();
+
+    // The first candidate that runs is measured alone and becomes the
+    // reference used to detect interference between the slots
+    size_t index;
+    std::string loweredModule;
+    if (referenceSoloTime <= 0 && concurrency > 1)
+    {
+        while (nextModule(index, loweredModule))
+        {
+            // Candidates whose lowering failed keep a failed measurement
+            if (loweredModule.empty())
+                continue;
+            results[index] = pool->run(loweredModule);
+            double soloTime = getTime(results[index]);
+            if (soloTime > 0)
+            {
+                referenceModule = loweredModule;
+                referenceSoloTime = soloTime;
+            }
+            break;
+        }
+    }
+
+    // The reference is measured again once half of the slots are busy
+    bool checkReference = concurrency > 1 && referenceSoloTime > 0;
+    std::atomic<int> dispatched(0);
+    auto worker = [&]()
+    {
+        size_t index;
+        std::string loweredModule;
+        while (true)
+        {
+            if (checkReference && dispatched++ == concurrency / 2)
+            {
+                checkInterference(getTime(pool->run(referenceModule)));
+                continue;
+            }
+            if (!nextModule(index, loweredModule))
+                break;
+            if (!loweredModule.empty())
+                results[index] = pool->run(loweredModule);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 0; i < concurrency; ++i)
+        threads.emplace_back(worker);
+    for (std::thread &thread : threads)
+        thread.join();
+    return results;
+}
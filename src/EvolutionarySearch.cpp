@@ -0,0 +1,214 @@
+//===------------------------- EvolutionarySearch.cpp - EvolutionarySearch -===//
+//
+///===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implmentation of the EvolutionarySearch class,
+/// which contains the implmentation of the genetic search method
+///
+//===----------------------------------------------------------------------===//
+
+#include "EvolutionarySearch.h"
+#include "CostModel.h"
+#include "MLIRCodeIR.h"
+#include "Measurement.h"
+#include "ScheduleDatabase.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+/// Individuals drawn by a tournament.
+#define EVOLUTION_TOURNAMENT 3
+/// Fastest individuals copied unchanged to the next generation.
+#define EVOLUTION_ELITES 2
+/// Probability that a child is bred by crossover rather than copied from one
+/// parent, the child is mutated in both cases.
+#define EVOLUTION_CROSSOVER 0.7
+
+EvolutionarySearch::EvolutionarySearch(mlir::MLIRContext *context, std::string functionName, int populationSize, int generations,
+                                       int depth, int numThreads)
+    : space(context, depth), generator(42)
+{
+    this->context = context;
+    this->functionName = functionName;
+    this->populationSize = std::max(populationSize, EVOLUTION_ELITES + 1);
+    this->generations = std::max(generations, 1);
+    this->numThreads = numThreads > 0 ? numThreads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+std::vector<EvolutionarySearch::Individual> EvolutionarySearch::evaluate(Node *root, std::vector<Genome> &genomes,
+                                                                        EvaluationByExecution *evaluator)
+{
+    std::vector<Individual> individuals(genomes.size());
+    std::vector<unsigned> seeds(genomes.size());
+    for (unsigned &seed : seeds)
+        seed = generator();
+
+    // Each thread decodes the next genome, the genomes are applied to clones
+    // of the root so they are decoded independently
+    std::atomic<size_t> nextNode(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < std::min<int>(numThreads, genomes.size()); ++t)
+    {
+        threads.emplace_back([&]()
+                             {
+            size_t index;
+            while ((index = nextNode++) < genomes.size())
+            {
+                std::mt19937 decodeGenerator(seeds[index]);
+                individuals[index].node = space.decode(root, genomes[index], decodeGenerator);
+            } });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+
+    SmallVector<Node *, 2> nodes;
+    for (size_t i = 0; i < genomes.size(); ++i)
+    {
+        individuals[i].genome = genomes[i];
+        if (individuals[i].node != root)
+            nodes.push_back(individuals[i].node);
+    }
+    // Evaluate the population at once
+    evaluator->evaluateTransformations(nodes);
+    if (CostModel *costModel = CostModel::get())
+        costModel->update(nodes);
+    return individuals;
+}
+
+const EvolutionarySearch::Individual &EvolutionarySearch::select(const std::vector<Individual> &population)
+{
+    const Individual *winner = nullptr;
+    for (int i = 0; i < EVOLUTION_TOURNAMENT; ++i)
+    {
+        const Individual &candidate = population[std::uniform_int_distribution<size_t>(0, population.size() - 1)(generator)];
+        if (!winner || Measurement::getTime(candidate.node) < Measurement::getTime(winner->node))
+            winner = &candidate;
+    }
+    return *winner;
+}
+
+SearchSpace::Genome EvolutionarySearch::crossover(const Genome &first, const Genome &second)
+{
+    size_t boundaries = std::min(first.size(), second.size());
+    if (boundaries < 2)
+        return first;
+    size_t cut = std::uniform_int_distribution<size_t>(1, boundaries - 1)(generator);
+    Genome child(first.begin(), first.begin() + cut);
+    child.insert(child.end(), second.begin() + cut, second.end());
+    return child;
+}
+
+void EvolutionarySearch::mutate(Genome &genome)
+{
+    std::vector<std::pair<size_t, size_t>> tileSizes;
+    std::vector<size_t> interchanges;
+    for (size_t i = 0; i < genome.size(); ++i)
+    {
+        for (size_t loop = 0; loop < genome[i].tileSizes.size() && loop < genome[i].extents.size(); ++loop)
+            tileSizes.push_back(std::make_pair(i, loop));
+        if (genome[i].step == SearchSpace::Step::Tiling && genome[i].interchange.size() >= 2)
+            interchanges.push_back(i);
+    }
+
+    int mutation = std::uniform_int_distribution<int>(0, 2)(generator);
+    if (mutation == 0 && !tileSizes.empty())
+    {
+        // Nudge a tile size to the next smaller or larger divisor
+        std::pair<size_t, size_t> picked = tileSizes[std::uniform_int_distribution<size_t>(0, tileSizes.size() - 1)(generator)];
+        Gene &gene = genome[picked.first];
+        SmallVector<int64_t, 4> divisors = SearchSpace::getDivisors(gene.extents[picked.second], gene.step);
+        if (divisors.size() < 2)
+            return;
+        size_t index = SearchSpace::getNearestDivisor(gene.tileSizes[picked.second], divisors);
+        bool larger = index == 0 || (index + 1 < divisors.size() && std::bernoulli_distribution(0.5)(generator));
+        gene.tileSizes[picked.second] = divisors[larger ? index + 1 : index - 1];
+    }
+    else if (mutation == 1 && !interchanges.empty())
+    {
+        // Swap two loops of an interchange
+        Gene &gene = genome[interchanges[std::uniform_int_distribution<size_t>(0, interchanges.size() - 1)(generator)]];
+        size_t first = std::uniform_int_distribution<size_t>(0, gene.interchange.size() - 1)(generator);
+        size_t second = std::uniform_int_distribution<size_t>(0, gene.interchange.size() - 2)(generator);
+        if (second >= first)
+            ++second;
+        std::swap(gene.interchange[first], gene.interchange[second]);
+    }
+    else if (!genome.empty() && genome.back().step == SearchSpace::Step::Vectorization)
+        genome.pop_back();
+    else
+        genome.push_back({SearchSpace::Step::Vectorization, {}, {}, {}});
+}
+
+Node *EvolutionarySearch::runSearchMethod(Node *root)
+{
+    // Create an evaluator for transformation evaluations
+    std::unique_ptr<EvaluationByExecution> evaluator = EvaluationByExecution::create(this->functionName + "_logs_evolution.txt");
+
+    // Up to half of the first population comes from the previous runs
+    std::vector<Genome> genomes;
+    if (ScheduleDatabase *database = ScheduleDatabase::get())
+    {
+        std::vector<std::pair<std::string, Measurement>> schedules = database->getSchedules();
+        std::stable_sort(schedules.begin(), schedules.end(), [](const std::pair<std::string, Measurement> &a, const std::pair<std::string, Measurement> &b)
+                         { return !a.second.isFailed() && (b.second.isFailed() || a.second.getMedian() < b.second.getMedian()); });
+        for (const std::pair<std::string, Measurement> &schedule : schedules)
+        {
+            if ((int)genomes.size() >= populationSize / 2 || schedule.second.isFailed())
+                break;
+            Genome genome = SearchSpace::parseSchedule(schedule.first);
+            if (!genome.empty())
+                genomes.push_back(genome);
+        }
+        std::cout << "Evolution: " << genomes.size() << " schedules seeded from the database" << std::endl;
+    }
+    while ((int)genomes.size() < populationSize)
+    {
+        Genome genome;
+        for (int level = 0; level < space.getDepth(); ++level)
+            genome.push_back({space.getStep(level), {}, {}, {}});
+        genomes.push_back(genome);
+    }
+
+    Node *BestNode = root;
+    std::vector<Individual> population;
+    SmallVector<Node *, 2> evaluated;
+    for (int generation = 0; generation < generations; ++generation)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<Individual> offspring = evaluate(root, genomes, evaluator.get());
+        auto end = std::chrono::high_resolution_clock::now();
+        for (Individual &individual : offspring)
+            if (individual.node != root)
+                evaluated.push_back(individual.node);
+
+        // The elites of the previous generation compete with the offspring
+        population.resize(std::min<size_t>(population.size(), EVOLUTION_ELITES));
+        population.insert(population.end(), offspring.begin(), offspring.end());
+        std::stable_sort(population.begin(), population.end(), [](const Individual &a, const Individual &b)
+                         { return Measurement::getTime(a.node) < Measurement::getTime(b.node); });
+        if (Measurement::getTime(population.front().node) < Measurement::getTime(BestNode))
+            BestNode = population.front().node;
+        std::cout << "Generation " << generation << ": " << offspring.size() << " schedules, "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms, best "
+                  << Measurement::getTime(BestNode) << " s" << std::endl;
+
+        // Breed the offspring of the next generation
+        genomes.clear();
+        while ((int)genomes.size() + EVOLUTION_ELITES < populationSize)
+        {
+            const Individual &first = select(population);
+            Genome child = std::bernoulli_distribution(EVOLUTION_CROSSOVER)(generator) ? crossover(first.genome, select(population).genome)
+                                                                                      : first.genome;
+            mutate(child);
+            genomes.push_back(child);
+        }
+    }
+
+    // Set the children nodes of the root (for printing the schedules)
+    root->setChildrenNodes(evaluated);
+    return BestNode;
+}
@@ -0,0 +1,363 @@
+//===------------------- FeatureExtractor.cpp - FeatureExtractor -----------===//
+//
+///===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implmentation of the FeatureExtractor class, which
+/// contains the description of a transformed module as a fixed-width vector
+/// of numbers
+///
+//===----------------------------------------------------------------------===//
+
+#include "FeatureExtractor.h"
+#include "AnalyticalEvaluation.h"
+#include "RegionTiming.h"
+#include "Utils.h"
+
+#include "mlir/Dialect/Func/IR/FuncOps.h"
+#include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/Dialect/SCF/IR/SCF.h"
+#include "mlir/Dialect/Tensor/IR/Tensor.h"
+#include "mlir/Dialect/Utils/StaticValueUtils.h"
+#include "mlir/Dialect/Vector/IR/VectorOps.h"
+
+#include <algorithm>
+#include <cmath>
+
+static int64_t getDynamicSize()
+{
+    return std::max(getEnvInt("AS_HARNESS_DYNAMIC_SIZE", 128), 1);
+}
+
+static float logSize(double value)
+{
+    return std::log2(1 + std::max(value, 0.0));
+}
+
+static double getTripCount(std::optional<int64_t> lowerBound, std::optional<int64_t> upperBound, std::optional<int64_t> step)
+{
+    if (!lowerBound || !upperBound || !step || *step <= 0 || *upperBound <= *lowerBound)
+        return 1;
+    return (double)((*upperBound - *lowerBound + *step - 1) / *step);
+}
+
+llvm::SmallVector<FeatureExtractor::LoopLevel, 8> FeatureExtractor::getLoopLevels(mlir::Operation *op)
+{
+    // Collected from the innermost loop out, then reversed
+    llvm::SmallVector<LoopLevel, 8> levels;
+    for (Operation *parent = op->getParentOp(); parent != nullptr && !isa<func::FuncOp>(parent); parent = parent->getParentOp())
+    {
+        if (scf::ForallOp forall = dyn_cast<scf::ForallOp>(parent))
+        {
+            SmallVector<OpFoldResult> lowerBounds = forall.getMixedLowerBound();
+            SmallVector<OpFoldResult> upperBounds = forall.getMixedUpperBound();
+            SmallVector<OpFoldResult> steps = forall.getMixedStep();
+            for (int i = forall.getRank() - 1; i >= 0; --i)
+                levels.push_back({true, getTripCount(getConstantIntValue(lowerBounds[i]), getConstantIntValue(upperBounds[i]),
+                                                     getConstantIntValue(steps[i]))});
+        }
+        else if (scf::ForOp loop = dyn_cast<scf::ForOp>(parent))
+            levels.push_back({false, getTripCount(getConstantIntValue(loop.getLowerBound()), getConstantIntValue(loop.getUpperBound()),
+                                                  getConstantIntValue(loop.getStep()))});
+    }
+    std::reverse(levels.begin(), levels.end());
+    return levels;
+}
+
+llvm::SmallVector<int64_t> FeatureExtractor::getLoopExtents(mlir::linalg::LinalgOp linalgOp)
+{
+    SmallVector<int64_t> extents = linalgOp.getStaticLoopRanges();
+    for (int64_t &extent : extents)
+        if (ShapedType::isDynamic(extent) || extent <= 0)
+            extent = getDynamicSize();
+    return extents;
+}
+
+double FeatureExtractor::getElementBits(mlir::Type type)
+{
+    if (ShapedType shaped = dyn_cast<ShapedType>(type))
+        type = shaped.getElementType();
+    if (type.isIntOrFloat())
+        return std::max<double>(type.getIntOrFloatBitWidth(), 8);
+    return 64;
+}
+
+double FeatureExtractor::getOperandFootprint(mlir::linalg::LinalgOp linalgOp, mlir::OpOperand &operand,
+                                             llvm::ArrayRef<int64_t> extents)
+{
+    if (!isa<ShapedType>(operand.get().getType()))
+        return 0;
+    AffineMap map = linalgOp.getMatchingIndexingMap(&operand);
+    SmallVector<int64_t> lastIndices;
+    for (int64_t extent : extents)
+        lastIndices.push_back(extent - 1);
+    // The indexing maps are increasing in the loop indices, the last indices
+    // give the extent of each dimension of the operand
+    double elements = 1;
+    for (int64_t last : map.compose(lastIndices))
+        elements *= last + 1;
+    return elements * getElementBits(operand.get().getType()) / 8;
+}
+
+/// Shape of the tensor or memref a tile is taken from, the tile itself when
+/// it is not a slice.
+static SmallVector<int64_t> getSourceShape(Value value)
+{
+    Type type = value.getType();
+    if (tensor::ExtractSliceOp slice = value.getDefiningOp<tensor::ExtractSliceOp>())
+        type = slice.getSourceType();
+    else if (memref::SubViewOp subview = value.getDefiningOp<memref::SubViewOp>())
+        type = subview.getSourceType();
+    SmallVector<int64_t> shape;
+    if (ShapedType shaped = dyn_cast<ShapedType>(type))
+        for (int64_t size : shaped.getShape())
+            shape.push_back(ShapedType::isDynamic(size) ? getDynamicSize() : size);
+    return shape;
+}
+
+/// Distance in elements between the accesses of two consecutive iterations of
+/// the innermost loop of the linalg operation.
+static double getInnermostStride(linalg::LinalgOp linalgOp, OpOperand &operand)
+{
+    if (!isa<ShapedType>(operand.get().getType()) || linalgOp.getNumLoops() == 0)
+        return 0;
+    AffineMap map = linalgOp.getMatchingIndexingMap(&operand);
+    SmallVector<int64_t> origin(linalgOp.getNumLoops(), 0), next(linalgOp.getNumLoops(), 0);
+    next.back() = 1;
+    SmallVector<int64_t> start = map.compose(origin), end = map.compose(next);
+    SmallVector<int64_t> shape = getSourceShape(operand.get());
+    double stride = 0, elements = 1;
+    for (int k = (int)start.size() - 1; k >= 0; --k)
+    {
+        stride += (end[k] - start[k]) * elements;
+        elements *= k < (int)shape.size() ? shape[k] : 1;
+    }
+    return std::fabs(stride);
+}
+
+/// Same as getInnermostStride for a vector read by a transfer, along the
+/// innermost dimension of the vector.
+static double getVectorStride(Value value)
+{
+    vector::TransferReadOp read = value.getDefiningOp<vector::TransferReadOp>();
+    if (!read || read.getVectorType().getRank() == 0)
+        return 1;
+    AffineExpr innermost = read.getPermutationMap().getResults().back();
+    AffineDimExpr dim = dyn_cast<AffineDimExpr>(innermost);
+    if (!dim)
+        return 0;
+    SmallVector<int64_t> shape = getSourceShape(read.getSource());
+    double stride = 1;
+    for (size_t k = dim.getPosition() + 1; k < shape.size(); ++k)
+        stride *= shape[k];
+    return stride;
+}
+
+/// The operation of the module with the most work and what the features
+/// describe of it.
+struct MainOperation {
+    Operation *op = nullptr;
+    double work = -1;
+    double executions = 1;
+    SmallVector<double> extents;
+    SmallVector<bool> reductions;
+    SmallVector<double> footprints;
+    SmallVector<double> strides;
+};
+
+std::vector<float> FeatureExtractor::extract(mlir::Operation *module)
+{
+    int numLinalg = 0, numVector = 0, numTransfers = 0, numForall = 0, numFor = 0;
+    int maxVectorRank = 0;
+    double largestVector = 0, largestVectorInnermost = 0;
+    MainOperation heaviest;
+
+    module->walk([&](Operation *op)
+                 {
+        if (op->hasAttr(TIMER_ATTR))
+            return;
+        if (isa<scf::ForallOp>(op))
+            ++numForall;
+        else if (isa<scf::ForOp>(op))
+            ++numFor;
+        else if (isa<vector::TransferReadOp, vector::TransferWriteOp>(op))
+            ++numTransfers;
+        for (Type type : op->getResultTypes())
+        {
+            VectorType vector = dyn_cast<VectorType>(type);
+            if (!vector || vector.getRank() == 0)
+                continue;
+            maxVectorRank = std::max<int>(maxVectorRank, vector.getRank());
+            if (vector.getNumElements() > largestVector)
+            {
+                largestVector = vector.getNumElements();
+                largestVectorInnermost = vector.getShape().back();
+            }
+        }
+
+        MainOperation candidate;
+        candidate.op = op;
+        double work = 0;
+        if (linalg::LinalgOp linalgOp = dyn_cast<linalg::LinalgOp>(op))
+        {
+            ++numLinalg;
+            SmallVector<int64_t> extents = getLoopExtents(linalgOp);
+            SmallVector<utils::IteratorType> iterators = linalgOp.getIteratorTypesArray();
+            work = std::max<double>(linalgOp.getBlock()->getOperations().size() - 1, 1);
+            for (size_t d = 0; d < extents.size(); ++d)
+            {
+                work *= extents[d];
+                candidate.extents.push_back(extents[d]);
+                candidate.reductions.push_back(iterators[d] == utils::IteratorType::reduction);
+            }
+            for (OpOperand &operand : op->getOpOperands())
+            {
+                candidate.footprints.push_back(getOperandFootprint(linalgOp, operand, extents));
+                candidate.strides.push_back(getInnermostStride(linalgOp, operand));
+            }
+        }
+        else if (vector::ContractionOp contraction = dyn_cast<vector::ContractionOp>(op))
+        {
+            ++numVector;
+            SmallVector<int64_t> bounds;
+            contraction.getIterationBounds(bounds);
+            SmallVector<vector::IteratorType> iterators = contraction.getIteratorTypesArray();
+            work = 2;
+            for (size_t d = 0; d < bounds.size(); ++d)
+            {
+                work *= bounds[d];
+                candidate.extents.push_back(bounds[d]);
+                candidate.reductions.push_back(iterators[d] == vector::IteratorType::reduction);
+            }
+            for (Value operand : op->getOperands())
+            {
+                candidate.footprints.push_back(isa<VectorType>(operand.getType())
+                                                   ? cast<VectorType>(operand.getType()).getNumElements() * getElementBits(operand.getType()) / 8
+                                                   : 0);
+                candidate.strides.push_back(getVectorStride(operand));
+            }
+        }
+        else if (op->getNumResults() == 1 && isa<VectorType>(op->getResult(0).getType()) &&
+                 (op->getDialect()->getNamespace() == "arith" || op->getDialect()->getNamespace() == "math" || isa<vector::FMAOp>(op)))
+        {
+            ++numVector;
+            VectorType type = cast<VectorType>(op->getResult(0).getType());
+            work = type.getNumElements();
+            for (int64_t size : type.getShape())
+            {
+                candidate.extents.push_back(size);
+                candidate.reductions.push_back(false);
+            }
+            for (Value operand : op->getOperands())
+            {
+                candidate.footprints.push_back(type.getNumElements() * getElementBits(operand.getType()) / 8);
+                candidate.strides.push_back(getVectorStride(operand));
+            }
+        }
+        else
+            return;
+
+        for (const LoopLevel &level : getLoopLevels(op))
+            candidate.executions *= level.tripCount;
+        candidate.work = work * candidate.executions;
+        if (candidate.work > heaviest.work)
+            heaviest = std::move(candidate); });
+
+    std::vector<float> features;
+    features.reserve(getNames().size());
+    features.push_back(logSize(numLinalg));
+    features.push_back(logSize(numVector));
+    features.push_back(logSize(numTransfers));
+    features.push_back(logSize(numForall));
+    features.push_back(logSize(numFor));
+
+    AnalyticalEvaluation::Estimate estimate = AnalyticalEvaluation::estimate(module);
+    features.push_back(logSize(estimate.scalarFlops + estimate.vectorFlops));
+    features.push_back(logSize(estimate.bytes));
+    features.push_back(logSize(estimate.parallelIterations));
+    features.push_back(logSize(estimate.seconds * 1e9));
+    features.push_back(estimate.vectorFlops > 0 ? 1 : 0);
+
+    // Producers fused into the loop nest of the main operation are the other
+    // linalg operations under its outermost loop
+    int fusedProducers = 0;
+    Operation *outermostLoop = nullptr;
+    if (heaviest.op != nullptr)
+        for (Operation *parent = heaviest.op->getParentOp(); parent != nullptr && !isa<func::FuncOp>(parent); parent = parent->getParentOp())
+            if (isa<scf::ForallOp, scf::ForOp>(parent))
+                outermostLoop = parent;
+    if (outermostLoop != nullptr)
+        outermostLoop->walk([&](linalg::LinalgOp linalgOp)
+                            {
+            if (linalgOp.getOperation() != heaviest.op)
+                ++fusedProducers; });
+    int numReductions = std::count(heaviest.reductions.begin(), heaviest.reductions.end(), true);
+    double iterations = 1;
+    for (double extent : heaviest.extents)
+        iterations *= extent;
+    features.push_back(logSize(fusedProducers));
+    features.push_back(logSize(heaviest.extents.size() - numReductions));
+    features.push_back(logSize(numReductions));
+    features.push_back(logSize(heaviest.op != nullptr ? iterations : 0));
+    features.push_back(logSize(heaviest.op != nullptr ? heaviest.executions : 0));
+
+    SmallVector<LoopLevel, 8> levels;
+    if (heaviest.op != nullptr)
+        levels = getLoopLevels(heaviest.op);
+    for (int l = 0; l < FEATURE_LOOP_LEVELS; ++l)
+    {
+        bool present = l < (int)levels.size();
+        features.push_back(present ? 1 : 0);
+        features.push_back(present && levels[l].parallel ? 1 : 0);
+        features.push_back(present ? logSize(levels[l].tripCount) : 0);
+    }
+    for (int d = 0; d < FEATURE_DIMS; ++d)
+    {
+        bool present = d < (int)heaviest.extents.size();
+        features.push_back(present ? logSize(heaviest.extents[d]) : 0);
+        features.push_back(present && heaviest.reductions[d] ? 1 : 0);
+    }
+    for (int o = 0; o < FEATURE_OPERANDS; ++o)
+    {
+        bool present = o < (int)heaviest.footprints.size();
+        features.push_back(present ? logSize(heaviest.footprints[o]) : 0);
+        features.push_back(present ? logSize(heaviest.strides[o]) : 0);
+    }
+
+    features.push_back(maxVectorRank);
+    features.push_back(logSize(largestVector));
+    features.push_back(logSize(largestVectorInnermost));
+    return features;
+}
+
+const std::vector<std::string> &FeatureExtractor::getNames()
+{
+    static const std::vector<std::string> names = []()
+    {
+        std::vector<std::string> names = {"linalg_ops", "vector_ops", "transfer_ops", "forall_loops", "for_loops",
+                                          "estimated_flops", "estimated_bytes", "parallel_iterations", "estimated_ns",
+                                          "vectorized", "fused_producers", "parallel_dims", "reduction_dims",
+                                          "iterations", "executions"};
+        for (int l = 0; l < FEATURE_LOOP_LEVELS; ++l)
+        {
+            names.push_back("loop" + std::to_string(l) + "_present");
+            names.push_back("loop" + std::to_string(l) + "_forall");
+            names.push_back("loop" + std::to_string(l) + "_trip_count");
+        }
+        for (int d = 0; d < FEATURE_DIMS; ++d)
+        {
+            names.push_back("dim" + std::to_string(d) + "_extent");
+            names.push_back("dim" + std::to_string(d) + "_reduction");
+        }
+        for (int o = 0; o < FEATURE_OPERANDS; ++o)
+        {
+            names.push_back("operand" + std::to_string(o) + "_footprint");
+            names.push_back("operand" + std::to_string(o) + "_stride");
+        }
+        names.push_back("vector_rank");
+        names.push_back("vector_elements");
+        names.push_back("vector_innermost");
+        return names;
+    }();
+    return names;
+}
@@ -0,0 +1,373 @@
+//===------------------- HarnessGenerator.cpp - HarnessGenerator -----------===//
+//
+///===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implmentation of the HarnessGenerator class, which
+/// contains the synthesis of the benchmark harness of a bare kernel
+///
+//===----------------------------------------------------------------------===//
+
+#include "HarnessGenerator.h"
+#include "Measurement.h"
+#include "RegionTiming.h"
+#include "Utils.h"
+
+#include "mlir/Dialect/Arith/IR/Arith.h"
+#include "mlir/Dialect/Linalg/IR/Linalg.h"
+#include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/Dialect/SCF/IR/SCF.h"
+#include "mlir/Dialect/Tensor/IR/Tensor.h"
+#include "mlir/IR/Builders.h"
+#include "mlir/IR/PatternMatch.h"
+#include "mlir/Interfaces/DestinationStyleOpInterface.h"
+#include "mlir/Transforms/GreedyPatternRewriteDriver.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+/// Initial values cycle through 0 .. HARNESS_INIT_MODULO - 1, small integers
+/// that every element type represents exactly.
+#define HARNESS_INIT_MODULO 17
+
+static bool isSupportedElementType(Type type)
+{
+    return type.isIntOrIndexOrFloat();
+}
+
+/// Returns the value of the element at the given indices.
+static Value getInitialValue(OpBuilder &builder, Location loc, ValueRange indices, Type elementType)
+{
+    Value sum = builder.create<arith::ConstantIndexOp>(loc, 0);
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        Value weight = builder.create<arith::ConstantIndexOp>(loc, i + 1);
+        sum = builder.create<arith::AddIOp>(loc, sum, builder.create<arith::MulIOp>(loc, indices[i], weight));
+    }
+    Value modulo = builder.create<arith::ConstantIndexOp>(loc, HARNESS_INIT_MODULO);
+    Value index = builder.create<arith::RemUIOp>(loc, sum, modulo);
+    if (elementType.isIndex())
+        return index;
+    if (elementType.isIntOrIndex())
+        return builder.create<arith::IndexCastOp>(loc, elementType, index);
+    Value integer = builder.create<arith::IndexCastOp>(loc, builder.getI64Type(), index);
+    return builder.create<arith::SIToFPOp>(loc, elementType, integer);
+}
+
+/// Stores the initial values in the elements of the buffer.
+static void initializeBuffer(OpBuilder &builder, Location loc, Value buffer, MemRefType memrefType)
+{
+    SmallVector<Value> lowerBounds, upperBounds, steps;
+    for (int64_t dim : memrefType.getShape())
+    {
+        lowerBounds.push_back(builder.create<arith::ConstantIndexOp>(loc, 0));
+        upperBounds.push_back(builder.create<arith::ConstantIndexOp>(loc, dim));
+        steps.push_back(builder.create<arith::ConstantIndexOp>(loc, 1));
+    }
+    scf::buildLoopNest(builder, loc, lowerBounds, upperBounds, steps,
+                       [&](OpBuilder &nested, Location nestedLoc, ValueRange indices)
+                       {
+                           Value value = getInitialValue(nested, nestedLoc, indices, memrefType.getElementType());
+                           nested.create<memref::StoreOp>(nestedLoc, value, buffer, indices);
+                       });
+}
+
+/// Creates an initialized value of the given argument type, or a null value
+/// if the type is not supported. The shapes are static (see
+/// specializeKernel).
+static Value createInput(OpBuilder &builder, Location loc, Type type)
+{
+    if (RankedTensorType tensorType = dyn_cast<RankedTensorType>(type))
+    {
+        if (!isSupportedElementType(tensorType.getElementType()) || !tensorType.hasStaticShape())
+            return nullptr;
+        return builder.create<tensor::GenerateOp>(
+            loc, tensorType, ValueRange{},
+            [&](OpBuilder &nested, Location nestedLoc, ValueRange indices)
+            {
+                nested.create<tensor::YieldOp>(nestedLoc, getInitialValue(nested, nestedLoc, indices, tensorType.getElementType()));
+            });
+    }
+    if (MemRefType memrefType = dyn_cast<MemRefType>(type))
+    {
+        if (!isSupportedElementType(memrefType.getElementType()) || !memrefType.getLayout().isIdentity() ||
+            !memrefType.hasStaticShape())
+            return nullptr;
+        Value buffer = builder.create<memref::AllocOp>(loc, memrefType);
+        initializeBuffer(builder, loc, buffer, memrefType);
+        return buffer;
+    }
+    if (type.isIntOrIndex())
+        return builder.create<arith::ConstantOp>(loc, builder.getIntegerAttr(type, 1));
+    if (FloatType floatType = dyn_cast<FloatType>(type))
+        return builder.create<arith::ConstantOp>(loc, builder.getFloatAttr(floatType, 1.0));
+    return nullptr;
+}
+
+/// Gives the dynamic dimensions of the arguments of the kernel the size
+/// AS_HARNESS_DYNAMIC_SIZE, so that the transformations see static extents.
+/// The arguments are cast back to their original types at the start of the
+/// kernel and the casts are folded into their users.
+static void specializeKernel(func::FuncOp kernel)
+{
+    int64_t dynamicSize = getEnvInt("AS_HARNESS_DYNAMIC_SIZE", 128);
+    MLIRContext *context = kernel.getContext();
+    OpBuilder builder(context);
+    builder.setInsertionPointToStart(&kernel.front());
+    bool specialized = false;
+    SmallVector<Type> inputs;
+    for (BlockArgument argument : kernel.getArguments())
+    {
+        Type type = argument.getType();
+        ShapedType shapedType = dyn_cast<ShapedType>(type);
+        MemRefType memrefType = dyn_cast<MemRefType>(type);
+        if (!shapedType || !shapedType.hasRank() || shapedType.hasStaticShape() ||
+            (memrefType && !memrefType.getLayout().isIdentity()))
+        {
+            inputs.push_back(type);
+            continue;
+        }
+        SmallVector<int64_t> shape;
+        for (int64_t dim : shapedType.getShape())
+            shape.push_back(ShapedType::isDynamic(dim) ? dynamicSize : dim);
+        Value original;
+        if (memrefType)
+        {
+            argument.setType(MemRefType::get(shape, memrefType.getElementType(), memrefType.getLayout(), memrefType.getMemorySpace()));
+            original = builder.create<memref::CastOp>(kernel.getLoc(), type, argument);
+        }
+        else
+        {
+            RankedTensorType tensorType = cast<RankedTensorType>(type);
+            argument.setType(RankedTensorType::get(shape, tensorType.getElementType(), tensorType.getEncoding()));
+            original = builder.create<tensor::CastOp>(kernel.getLoc(), type, argument);
+        }
+        argument.replaceAllUsesExcept(original, original.getDefiningOp());
+        inputs.push_back(argument.getType());
+        specialized = true;
+    }
+    if (!specialized)
+        return;
+    kernel.setFunctionType(builder.getFunctionType(inputs, kernel.getFunctionType().getResults()));
+
+    RewritePatternSet patterns(context);
+    for (Dialect *dialect : context->getLoadedDialects())
+        dialect->getCanonicalizationPatterns(patterns);
+    for (RegisteredOperationName op : context->getRegisteredOperations())
+        op.getCanonicalizationPatterns(patterns, context);
+    (void)applyPatternsAndFoldGreedily(kernel, std::move(patterns));
+}
+
+/// True when the kernel may write the argument: a memref, or a tensor that
+/// reaches the init of a destination style operation. Its content then
+/// changes from one call to the next.
+static bool isWrittenByKernel(Value argument)
+{
+    if (isa<MemRefType>(argument.getType()))
+        return true;
+    SmallVector<Value> values = {argument};
+    while (!values.empty())
+    {
+        Value value = values.pop_back_val();
+        for (OpOperand &use : value.getUses())
+        {
+            Operation *user = use.getOwner();
+            if (DestinationStyleOpInterface destinationOp = dyn_cast<DestinationStyleOpInterface>(user))
+                if (destinationOp.isDpsInit(&use))
+                    return true;
+            if (isa<tensor::CastOp, tensor::ExtractSliceOp, tensor::ExpandShapeOp, tensor::CollapseShapeOp>(user))
+                values.append(user->result_begin(), user->result_end());
+        }
+    }
+    return false;
+}
+
+/// Returns the element of the result that goes in the checksum as an f64, or
+/// a null value when the result is not kept.
+static Value getChecksumElement(OpBuilder &builder, Location loc, Value result)
+{
+    Value element = result;
+    Type type = result.getType();
+    if (ShapedType shapedType = dyn_cast<ShapedType>(type))
+    {
+        if (!shapedType.hasRank() || !isSupportedElementType(shapedType.getElementType()))
+            return nullptr;
+        SmallVector<Value> zeros(shapedType.getRank(), builder.create<arith::ConstantIndexOp>(loc, 0));
+        if (isa<RankedTensorType>(shapedType))
+            element = builder.create<tensor::ExtractOp>(loc, result, zeros);
+        else
+            element = builder.create<memref::LoadOp>(loc, result, zeros);
+        type = shapedType.getElementType();
+    }
+    else if (!isSupportedElementType(type))
+        return nullptr;
+    if (type.isIndex())
+        element = builder.create<arith::IndexCastOp>(loc, builder.getI64Type(), element);
+    if (type.isIntOrIndex())
+        return builder.create<arith::SIToFPOp>(loc, builder.getF64Type(), element);
+    if (type.getIntOrFloatBitWidth() < 64)
+        return builder.create<arith::ExtFOp>(loc, builder.getF64Type(), element);
+    if (type.getIntOrFloatBitWidth() > 64)
+        return builder.create<arith::TruncFOp>(loc, builder.getF64Type(), element);
+    return element;
+}
+
+/// Returns the function of the runner utils with the given name, declares it
+/// when the module does not have it.
+static func::FuncOp getOrDeclareUtility(ModuleOp module, llvm::StringRef name, FunctionType type)
+{
+    if (func::FuncOp function = module.lookupSymbol<func::FuncOp>(name))
+        return function;
+    OpBuilder builder(module.getBodyRegion());
+    builder.setInsertionPointToStart(module.getBody());
+    func::FuncOp function = builder.create<func::FuncOp>(module.getLoc(), name, type);
+    function.setPrivate();
+    return function;
+}
+
+bool HarnessGenerator::needsHarness(mlir::ModuleOp module)
+{
+    return !module.lookupSymbol<func::FuncOp>("main");
+}
+
+mlir::func::FuncOp HarnessGenerator::findKernel(mlir::ModuleOp module)
+{
+    if (std::getenv("AS_KERNEL") != nullptr)
+        return module.lookupSymbol<func::FuncOp>(std::getenv("AS_KERNEL"));
+    for (func::FuncOp function : module.getOps<func::FuncOp>())
+    {
+        if (function.isExternal() || function.getName() == "main")
+            continue;
+        bool hasLinalgOps = false;
+        function.walk([&](linalg::LinalgOp)
+                      { hasLinalgOps = true; });
+        if (hasLinalgOps)
+            return function;
+    }
+    return nullptr;
+}
+
+mlir::LogicalResult HarnessGenerator::generate(mlir::ModuleOp module, mlir::func::FuncOp kernel)
+{
+    MLIRContext *context = module.getContext();
+    context->getOrLoadDialect<arith::ArithDialect>();
+    context->getOrLoadDialect<memref::MemRefDialect>();
+    context->getOrLoadDialect<scf::SCFDialect>();
+    context->getOrLoadDialect<tensor::TensorDialect>();
+
+    specializeKernel(kernel);
+    func::FuncOp nanoTime, printFlops;
+    declareTimerFunctions(module, nanoTime, printFlops);
+    OpBuilder builder(context);
+    func::FuncOp printF64 = getOrDeclareUtility(module, "printF64", builder.getFunctionType({builder.getF64Type()}, {}));
+    func::FuncOp printNewline = getOrDeclareUtility(module, "printNewline", builder.getFunctionType({}, {}));
+
+    builder.setInsertionPointToEnd(module.getBody());
+    Location loc = kernel.getLoc();
+    func::FuncOp main = builder.create<func::FuncOp>(loc, "main", builder.getFunctionType({}, {}));
+    builder.setInsertionPointToStart(main.addEntryBlock());
+
+    // Inputs are built once, before the warm-up and out of the timed region
+    SmallVector<Value> arguments;
+    SmallVector<bool> written;
+    for (BlockArgument kernelArgument : kernel.getArguments())
+    {
+        Value argument = createInput(builder, loc, kernelArgument.getType());
+        if (!argument)
+        {
+            main.erase();
+            return kernel.emitError("no harness input for an argument of type ") << kernelArgument.getType();
+        }
+        arguments.push_back(argument);
+        written.push_back(isWrittenByKernel(kernelArgument));
+    }
+    // An element of the results of every call is summed in a checksum printed
+    // at the end, so that the calls are not removed
+    MemRefType checksumType = MemRefType::get({}, builder.getF64Type());
+    Value checksum = builder.create<memref::AllocOp>(loc, checksumType);
+    builder.create<memref::StoreOp>(loc, builder.create<arith::ConstantOp>(loc, builder.getF64FloatAttr(0)), checksum, ValueRange{});
+
+    // Calls the kernel count times, the time of the calls is added to elapsed
+    // when it is given. The arguments the kernel writes are initialized again
+    // before each call, out of the timed interval, so that every call sees the
+    // same inputs
+    auto callKernel = [&](int count, Value elapsed)
+    {
+        Value lowerBound = builder.create<arith::ConstantIndexOp>(loc, 0);
+        Value upperBound = builder.create<arith::ConstantIndexOp>(loc, count);
+        Value step = builder.create<arith::ConstantIndexOp>(loc, 1);
+        builder.create<scf::ForOp>(loc, lowerBound, upperBound, step, ValueRange{},
+                                   [&](OpBuilder &nested, Location nestedLoc, Value, ValueRange)
+                                   {
+                                       SmallVector<Value> callArguments = arguments;
+                                       for (size_t i = 0; i < arguments.size(); ++i)
+                                       {
+                                           if (!written[i])
+                                               continue;
+                                           if (MemRefType memrefType = dyn_cast<MemRefType>(arguments[i].getType()))
+                                               initializeBuffer(nested, nestedLoc, arguments[i], memrefType);
+                                           else
+                                               callArguments[i] = createInput(nested, nestedLoc, arguments[i].getType());
+                                       }
+                                       // Cold runs time a call on inputs evicted from the caches
+                                       if (elapsed && Measurement::getMode() == "cold")
+                                           insertCacheFlush(nested, nestedLoc);
+                                       func::CallOp start;
+                                       if (elapsed)
+                                           start = nested.create<func::CallOp>(nestedLoc, nanoTime);
+                                       func::CallOp call = nested.create<func::CallOp>(nestedLoc, kernel, callArguments);
+                                       if (elapsed)
+                                       {
+                                           func::CallOp end = nested.create<func::CallOp>(nestedLoc, nanoTime);
+                                           arith::SubIOp delta = nested.create<arith::SubIOp>(nestedLoc, end.getResult(0), start.getResult(0));
+                                           memref::LoadOp total = nested.create<memref::LoadOp>(nestedLoc, elapsed, ValueRange{});
+                                           arith::AddIOp sum = nested.create<arith::AddIOp>(nestedLoc, total, delta);
+                                           memref::StoreOp store = nested.create<memref::StoreOp>(nestedLoc, sum, elapsed, ValueRange{});
+                                           // A timed region picked later replaces these timers
+                                           for (Operation *timer : {start.getOperation(), end.getOperation(), delta.getOperation(),
+                                                                    total.getOperation(), sum.getOperation(), store.getOperation()})
+                                               timer->setAttr(TIMER_ATTR, nested.getUnitAttr());
+                                           insertCounterHooks(start, end);
+                                       }
+                                       for (Value result : call.getResults())
+                                       {
+                                           Value element = getChecksumElement(nested, nestedLoc, result);
+                                           if (!element)
+                                               continue;
+                                           Value current = nested.create<memref::LoadOp>(nestedLoc, checksum, ValueRange{});
+                                           Value updated = nested.create<arith::AddFOp>(nestedLoc, current, element);
+                                           nested.create<memref::StoreOp>(nestedLoc, updated, checksum, ValueRange{});
+                                       }
+                                       nested.create<scf::YieldOp>(nestedLoc);
+                                   });
+    };
+
+    callKernel(std::max(getEnvInt("AS_HARNESS_WARMUP", 1), 0), nullptr);
+
+    // Cold runs time a single call, the evaluator repeats the runs
+    int repetitions = std::max(getEnvInt("AS_HARNESS_REPETITIONS", 1), 1);
+    if (Measurement::getMode() == "cold")
+        repetitions = 1;
+    memref::AllocOp elapsed = builder.create<memref::AllocOp>(loc, MemRefType::get({}, builder.getI64Type()));
+    arith::ConstantIntOp zero = builder.create<arith::ConstantIntOp>(loc, 0, 64);
+    memref::StoreOp reset = builder.create<memref::StoreOp>(loc, zero, elapsed, ValueRange{});
+    callKernel(repetitions, elapsed);
+    memref::LoadOp total = builder.create<memref::LoadOp>(loc, elapsed, ValueRange{});
+    arith::UIToFPOp nanoseconds = builder.create<arith::UIToFPOp>(loc, builder.getF64Type(), total);
+    Value count = builder.create<arith::ConstantOp>(loc, builder.getF64FloatAttr(repetitions));
+    arith::DivFOp perCall = builder.create<arith::DivFOp>(loc, nanoseconds, count);
+    func::CallOp print = builder.create<func::CallOp>(loc, printFlops, ValueRange{perCall});
+    memref::DeallocOp release = builder.create<memref::DeallocOp>(loc, elapsed);
+    for (Operation *timer : {elapsed.getOperation(), zero.getOperation(), reset.getOperation(), total.getOperation(),
+                             nanoseconds.getOperation(), perCall.getOperation(), print.getOperation(), release.getOperation()})
+        timer->setAttr(TIMER_ATTR, builder.getUnitAttr());
+
+    // The checksum is printed after printFlops, the evaluators read the time
+    // before the last GFLOPS
+    Value sum = builder.create<memref::LoadOp>(loc, checksum, ValueRange{});
+    builder.create<func::CallOp>(loc, printF64, ValueRange{sum});
+    builder.create<func::CallOp>(loc, printNewline);
+    builder.create<memref::DeallocOp>(loc, checksum);
+    builder.create<func::ReturnOp>(loc);
+    return success();
+}
@@ -0,0 +1,201 @@
+//===------------------- LoweringPipeline.cpp - LoweringPipeline -----------===//
+//
+///===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implmentation of the LoweringPipeline class, which
+/// contains the lowering of the candidates down to the LLVM dialect, built
+/// once and reused for every candidate
+///
+//===----------------------------------------------------------------------===//
+
+#include "LoweringPipeline.h"
+#include "CustomPasses/Passes.h"
+#include "Utils.h"
+
+#include "mlir/Dialect/Transform/Transforms/TransformInterpreterUtils.h"
+#include "mlir/InitAllDialects.h"
+#include "mlir/InitAllPasses.h"
+#include "mlir/Parser/Parser.h"
+#include "mlir/Pass/PassManager.h"
+
+#include <cstdlib>
+
+/// Vector lowerings applied by the transform interpreter before the passes.
+static const char *TransformLibrary = "module attributes {transform.with_named_sequence} { \n transform.named_sequence @__transform_main(%variant_op: !transform.any_op {transform.readonly})  { %f = transform.structured.match ops{[\"func.func\"]} in %variant_op : (!transform.any_op) -> !transform.any_op \n transform.apply_patterns to %f {  \n transform.apply_patterns.vector.lower_contraction lowering_strategy = \"outerproduct\" \n transform.apply_patterns.vector.transfer_permutation_patterns \n transform.apply_patterns.vector.lower_multi_reduction lowering_strategy = \"innerparallel\" \n transform.apply_patterns.vector.split_transfer_full_partial split_transfer_strategy = \"vector-transfer\" \n transform.apply_patterns.vector.transfer_to_scf max_transfer_rank = 1 full_unroll = true \n transform.apply_patterns.vector.lower_transfer max_transfer_rank = 1 \n transform.apply_patterns.vector.lower_shape_cast \n transform.apply_patterns.vector.lower_transpose lowering_strategy = \"shuffle_1d\" \n transform.apply_patterns.canonicalization} \n : !transform.any_op \n transform.yield}}";
+
+LoweringPipeline::LoweringPipeline(const std::string &name) : name(name)
+{
+}
+
+std::vector<std::string> LoweringPipeline::getNames()
+{
+    return {"default", "sequential"};
+}
+
+LoweringPipeline *LoweringPipeline::get(const std::string &name)
+{
+    static LoweringPipeline defaultPipeline("default");
+    static LoweringPipeline sequentialPipeline("sequential");
+    if (name == "default")
+        return &defaultPipeline;
+    if (name == "sequential")
+        return &sequentialPipeline;
+    return nullptr;
+}
+
+LoweringPipeline *LoweringPipeline::getDefault()
+{
+    LoweringPipeline *pipeline = nullptr;
+    if (std::getenv("AS_LOWERING_PIPELINE") != nullptr)
+        pipeline = get(std::getenv("AS_LOWERING_PIPELINE"));
+    return pipeline != nullptr ? pipeline : get("default");
+}
+
+const std::string &LoweringPipeline::getName() const
+{
+    return name;
+}
+
+void LoweringPipeline::releaseContext(mlir::MLIRContext *context)
+{
+    for (const std::string &name : getNames())
+    {
+        LoweringPipeline *pipeline = get(name);
+        std::lock_guard<std::mutex> lock(pipeline->mutex);
+        pipeline->contexts.erase(context);
+    }
+}
+
+LoweringPipeline::ContextState &LoweringPipeline::getContextState(mlir::MLIRContext *context)
+{
+    // Called with the mutex held
+    ContextState &state = contexts[context];
+    if (!state.library)
+    {
+        state.library = parseSourceString<mlir::ModuleOp>(TransformLibrary, context);
+        if (state.library)
+            state.entryPoint = transform::detail::findTransformEntryPoint(*state.library, *state.library, "__transform_main");
+    }
+    return state;
+}
+
+std::unique_ptr<LoweringPipeline::Instance> LoweringPipeline::createInstance(mlir::MLIRContext *context)
+{
+    std::unique_ptr<Instance> instance = std::make_unique<Instance>();
+    instance->passManager = std::make_unique<mlir::PassManager>(context, mlir::ModuleOp::getOperationName());
+    mlir::PassManager &pm = *instance->passManager;
+    const std::chrono::steady_clock::time_point *deadline = &instance->deadline;
+
+    // Apply any generic pass manager command line options and run the pipeline.
+    applyPassManagerCLOptions(pm);
+
+    bufferization::OneShotBufferizationOptions options;
+    //options.allowReturnAllocs = true;
+    options.bufferizeFunctionBoundaries = true;
+    //options.createDeallocs = true;
+    options.setFunctionBoundaryTypeConversion(mlir::bufferization::LayoutMapOption::IdentityLayoutMap);
+
+    pm.addPass(mlir::createLoopInvariantCodeMotionPass());
+    pm.addPass(mlir::createCSEPass());
+    pm.addPass(mlir::createCanonicalizerPass());
+    pm.addPass(mlir::createCSEPass());
+
+    pm.addPass(mlir::bufferization::createEmptyTensorEliminationPass());
+    pm.addPass(mlir::bufferization::createEmptyTensorToAllocTensorPass());
+
+    pm.addPass(mlir::bufferization::createOneShotBufferizePass(options));
+    pm.addPass(mlir::createLoweringDeadline(deadline));
+
+    mlir::OpPassManager &optPM = pm.nest<mlir::func::FuncOp>();
+
+    optPM.addPass(mlir::bufferization::createBufferDeallocationPass());
+
+    optPM.addPass(mlir::createConvertLinalgToLoopsPass());
+    optPM.addPass(mlir::createForEachThreadLowering());
+    pm.addPass(mlir::createConvertVectorToSCFPass());
+    // The sequential variant lowers the parallel loops to plain loops
+    if (name != "sequential")
+        pm.addPass(mlir::createConvertSCFToOpenMPPass());
+    pm.addPass(mlir::createLoweringDeadline(deadline));
+    pm.addPass(mlir::createCanonicalizerPass());
+    optPM.addPass(mlir::createLowerAffinePass());
+    optPM.addPass(memref::createExpandStridedMetadataPass());
+    pm.addPass(mlir::createFinalizeMemRefToLLVMConversionPass());
+    pm.addPass(mlir::createConvertSCFToCFPass());
+    pm.addPass(mlir::createLowerAffinePass());
+    optPM.addPass(mlir::createArithToLLVMConversionPass());
+
+    pm.addPass(createConvertOpenMPToLLVMPass());
+    pm.addPass(createConvertVectorToLLVMPass());
+    pm.addPass(createConvertControlFlowToLLVMPass());
+    pm.addPass(mlir::createConvertFuncToLLVMPass());
+    pm.addPass(mlir::createReconcileUnrealizedCastsPass());
+
+    // The first run of a pass manager loads the dialects its passes depend
+    // on, they are loaded here so that the concurrent runs never do it
+    {
+        std::lock_guard<std::mutex> lock(getContextMutex());
+        mlir::DialectRegistry dependentDialects;
+        pm.getDependentDialects(dependentDialects);
+        context->appendDialectRegistry(dependentDialects);
+        for (llvm::StringRef dialectName : dependentDialects.getDialectNames())
+            context->getOrLoadDialect(dialectName);
+    }
+    return instance;
+}
+
+mlir::LogicalResult LoweringPipeline::run(mlir::Operation *op, double timeoutSeconds, bool *timedOut)
+{
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                        std::chrono::duration<double>(timeoutSeconds));
+    if (timedOut != nullptr)
+        *timedOut = false;
+
+    mlir::MLIRContext *context = op->getContext();
+    mlir::Operation *entryPoint;
+    mlir::ModuleOp library;
+    std::unique_ptr<Instance> instance;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ContextState &state = getContextState(context);
+        entryPoint = state.entryPoint;
+        library = *state.library;
+        if (!state.idleInstances.empty())
+        {
+            instance = std::move(state.idleInstances.back());
+            state.idleInstances.pop_back();
+        }
+    }
+    if (entryPoint == nullptr)
+        return mlir::failure();
+    if (!instance)
+        instance = createInstance(context);
+
+    // The library is only read by the interpreter, the runs share it
+    mlir::transform::TransformOptions transformOptions;
+    mlir::LogicalResult result = transform::applyTransformNamedSequence(
+        op, entryPoint, library,
+        transformOptions.enableExpensiveChecks(false));
+
+    if (std::chrono::steady_clock::now() > deadline)
+    {
+        result = mlir::failure();
+        if (timedOut != nullptr)
+            *timedOut = true;
+    }
+    else if (mlir::succeeded(result))
+    {
+        instance->deadline = deadline;
+        result = instance->passManager->run(op);
+        if (mlir::failed(result) && timedOut != nullptr)
+            *timedOut = std::chrono::steady_clock::now() > deadline;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        contexts[context].idleInstances.push_back(std::move(instance));
+    }
+    return result;
+}
@@ -0,0 +1,160 @@
+//===------------------- MachineCalibration.cpp - MachineCalibration -------===//
+//
+///===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implmentation of the MachineCalibration class, which
+/// contains the tracking of the speed of the machine during the tuning
+///
+//===----------------------------------------------------------------------===//
+
+#include "MachineCalibration.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+/// Runs of the reference kernel per check.
+#define CALIBRATION_RUNS 3
+
+/// Returns the first line of a sysfs file, empty if it cannot be read.
+static std::string readSysfs(const std::string &path)
+{
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+/// Fixed compute bound kernel, a dependent chain of multiply-adds on data
+/// that stays in L1, its time follows the frequency of the core.
+static double runReferenceKernel()
+{
+    static volatile double sink;
+    std::vector<double> data(1024, 1.0);
+    auto start = std::chrono::steady_clock::now();
+    double accumulator = 0;
+    for (int repetition = 0; repetition < 10000; ++repetition)
+        for (double value : data)
+            accumulator = accumulator * 0.999999 + value;
+    auto end = std::chrono::steady_clock::now();
+    sink = accumulator;
+    return std::chrono::duration<double>(end - start).count();
+}
+
+double MachineCalibration::timeReference(const std::vector<int> &cores)
+{
+    cpu_set_t previous;
+    bool pinned = false;
+    if (!cores.empty() && pthread_getaffinity_np(pthread_self(), sizeof(previous), &previous) == 0)
+    {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        for (int cpu : cores)
+            CPU_SET(cpu, &cpuSet);
+        pinned = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0;
+    }
+    // A first run warms the core up
+    runReferenceKernel();
+    std::vector<double> times;
+    for (int i = 0; i < CALIBRATION_RUNS; ++i)
+        times.push_back(runReferenceKernel());
+    if (pinned)
+        pthread_setaffinity_np(pthread_self(), sizeof(previous), &previous);
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+MachineCalibration::MachineCalibration()
+    : baselineTime(0), drift(1), minDrift(1), maxDrift(1), numChecks(0), numRemeasured(0)
+{
+    governor = readSysfs("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor");
+    std::string noTurbo = readSysfs("/sys/devices/system/cpu/intel_pstate/no_turbo");
+    std::string boost = readSysfs("/sys/devices/system/cpu/cpufreq/boost");
+    if (!noTurbo.empty())
+        turbo = noTurbo == "0" ? "on" : "off";
+    else if (!boost.empty())
+        turbo = boost == "1" ? "on" : "off";
+    if (!governor.empty() && governor != "performance")
+        std::cerr << "Warning: the cpufreq governor is " << governor << ", measurements may drift" << std::endl;
+    if (turbo == "on")
+        std::cerr << "Warning: turbo is enabled, measurements may drift" << std::endl;
+}
+
+MachineCalibration *MachineCalibration::get()
+{
+    static MachineCalibration *calibration = nullptr;
+    static std::once_flag once;
+    std::call_once(once, []()
+                   {
+        if (std::getenv("AS_CALIBRATION") == nullptr || std::string(std::getenv("AS_CALIBRATION")) != "1")
+            return;
+        calibration = new MachineCalibration(); });
+    return calibration;
+}
+
+double MachineCalibration::check(const std::vector<int> &cores)
+{
+    double time = timeReference(cores);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (baselineTime <= 0)
+        baselineTime = time;
+    drift = baselineTime > 0 ? time / baselineTime : 1;
+    minDrift = std::min(minDrift, drift);
+    maxDrift = std::max(maxDrift, drift);
+    ++numChecks;
+    lastCheck = std::chrono::steady_clock::now();
+    return drift;
+}
+
+double MachineCalibration::update(const std::vector<int> &cores)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - lastCheck).count();
+        if (numChecks > 0 && elapsed < getEnvDouble("AS_CALIBRATION_INTERVAL_S", 60))
+            return drift;
+    }
+    return check(cores);
+}
+
+double MachineCalibration::getDrift()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return drift;
+}
+
+bool MachineCalibration::hasShifted(double before, double after)
+{
+    return std::fabs(after / before - 1) > getEnvDouble("AS_DRIFT_TOLERANCE", 0.05);
+}
+
+void MachineCalibration::normalize(Measurement &measurement, double drift)
+{
+    if (drift > 0 && drift != 1)
+        measurement.scale(1 / drift);
+}
+
+void MachineCalibration::addRemeasured()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    ++numRemeasured;
+}
+
+std::string MachineCalibration::summary()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ostringstream out;
+    out << "Calibration: reference " << baselineTime * 1000 << " ms, " << numChecks << " checks, drift "
+        << minDrift << " .. " << maxDrift << " (last " << drift << "), " << numRemeasured << " batches measured again"
+        << ", governor " << (governor.empty() ? "unknown" : governor) << ", turbo " << (turbo.empty() ? "unknown" : turbo);
+    return out.str();
+}
@@ -0,0 +1,391 @@
+//===------------------------- Measurement.cpp - Measurement ---------------===//
+//
+///===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implmentation of the Measurement class, which
+/// contains the execution times collected for one candidate and their
+/// statistics
+///
+//===----------------------------------------------------------------------===//
+
+#include "Measurement.h"
+#include "PerfCounters.h"
+#include "Node.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+/// Student's t critical values for 1 to 10 degrees of freedom, then 15, 20,
+/// 30 and infinity.
+static const double TwoSided95[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228, 2.131, 2.086, 2.042, 1.960};
+static const double OneSided95[] = {6.314, 2.920, 2.353, 2.132, 2.015, 1.943, 1.895, 1.860, 1.833, 1.812, 1.753, 1.725, 1.697, 1.645};
+
+static double studentT(const double *table, int degreesOfFreedom)
+{
+    if (degreesOfFreedom <= 10)
+        return table[std::max(degreesOfFreedom, 1) - 1];
+    if (degreesOfFreedom <= 15)
+        return table[10];
+    if (degreesOfFreedom <= 20)
+        return table[11];
+    if (degreesOfFreedom <= 30)
+        return table[12];
+    return table[13];
+}
+
+Measurement::Measurement() : status(ResultStatus::Ok)
+{
+}
+
+Measurement::Measurement(ResultStatus status) : status(status)
+{
+}
+
+ResultStatus Measurement::getStatus() const
+{
+    return status;
+}
+
+void Measurement::setStatus(ResultStatus status)
+{
+    this->status = status;
+}
+
+void Measurement::addSample(double seconds)
+{
+    samples.push_back(seconds);
+}
+
+void Measurement::scale(double factor)
+{
+    for (double &sample : samples)
+        sample *= factor;
+}
+
+const std::vector<double> &Measurement::getSamples() const
+{
+    return samples;
+}
+
+int Measurement::getNumSamples() const
+{
+    return samples.size();
+}
+
+void Measurement::addCounter(uint64_t value)
+{
+    counters.push_back(value);
+}
+
+const std::vector<uint64_t> &Measurement::getCounters() const
+{
+    return counters;
+}
+
+bool Measurement::isFailed() const
+{
+    return status != ResultStatus::Ok || samples.empty();
+}
+
+double Measurement::getMedian() const
+{
+    if (samples.empty())
+        return 0;
+    std::vector<double> sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+    size_t middle = sorted.size() / 2;
+    if (sorted.size() % 2 == 0)
+        return (sorted[middle - 1] + sorted[middle]) / 2;
+    return sorted[middle];
+}
+
+double Measurement::getMin() const
+{
+    if (samples.empty())
+        return 0;
+    return *std::min_element(samples.begin(), samples.end());
+}
+
+double Measurement::getMean() const
+{
+    if (samples.empty())
+        return 0;
+    double sum = 0;
+    for (double sample : samples)
+        sum += sample;
+    return sum / samples.size();
+}
+
+double Measurement::getStdDev() const
+{
+    if (samples.size() < 2)
+        return 0;
+    double mean = getMean();
+    double sum = 0;
+    for (double sample : samples)
+        sum += (sample - mean) * (sample - mean);
+    return std::sqrt(sum / (samples.size() - 1));
+}
+
+double Measurement::getSpread() const
+{
+    double median = getMedian();
+    if (median <= 0)
+        return 0;
+    return (*std::max_element(samples.begin(), samples.end()) - getMin()) / median;
+}
+
+double Measurement::getRelativeConfidence() const
+{
+    double mean = getMean();
+    if (samples.size() < 2 || mean <= 0)
+        return INFINITY;
+    double halfWidth = studentT(TwoSided95, samples.size() - 1) * getStdDev() / std::sqrt((double)samples.size());
+    return halfWidth / mean;
+}
+
+std::string Measurement::toEvaluation() const
+{
+    if (isFailed())
+        return "9000000000000000000";
+    // Same representation as the value printed by printFlops
+    return std::to_string(getMedian());
+}
+
+std::string Measurement::summary() const
+{
+    if (isFailed())
+    {
+        switch (status)
+        {
+        case ResultStatus::LoweringFailed:
+            return "failed (lowering)";
+        case ResultStatus::NoTiming:
+            return "failed (no printFlops)";
+        case ResultStatus::Crashed:
+            return "failed (crashed)";
+        case ResultStatus::TimedOut:
+            return "failed (timeout)";
+        case ResultStatus::Censored:
+            return "stopped at cutoff (> " + std::to_string(samples.empty() ? 0 : samples[0]) + " s)";
+        default:
+            return "failed (run)";
+        }
+    }
+    std::ostringstream out;
+    out << "median " << getMedian() << " s, min " << getMin() << " s, spread " << getSpread() * 100
+        << " %, " << samples.size() << " repetitions";
+    if (!counters.empty())
+        out << "; " << PerfCounters::summary(counters);
+    return out.str();
+}
+
+ResultRecord Measurement::toRecord() const
+{
+    ResultRecord record;
+    std::memset(&record, 0, sizeof(record));
+    record.magic = RESULT_RECORD_MAGIC;
+    record.status = status;
+    record.numSamples = std::min<size_t>(samples.size(), RESULT_RECORD_MAX_SAMPLES);
+    std::copy(samples.begin(), samples.begin() + record.numSamples, record.samples);
+    record.numCounters = std::min<size_t>(counters.size(), RESULT_RECORD_MAX_COUNTERS);
+    std::copy(counters.begin(), counters.begin() + record.numCounters, record.counters);
+    return record;
+}
+
+Measurement Measurement::fromRecord(const ResultRecord &record)
+{
+    if (record.magic != RESULT_RECORD_MAGIC || record.numSamples > RESULT_RECORD_MAX_SAMPLES ||
+        record.numCounters > RESULT_RECORD_MAX_COUNTERS)
+        return Measurement(ResultStatus::Crashed);
+    Measurement measurement(record.status);
+    measurement.samples.assign(record.samples, record.samples + record.numSamples);
+    measurement.counters.assign(record.counters, record.counters + record.numCounters);
+    return measurement;
+}
+
+Measurement Measurement::measure(const std::function<double()> &runOnce, double cutoffSeconds)
+{
+    double ciTarget = getEnvDouble("AS_CI_TARGET", 0.02);
+    double budgetSeconds = getTimeBudget();
+    int minRepetitions = getEnvDouble("AS_MIN_REPETITIONS", 3);
+    int maxRepetitions = std::min<int>(getEnvDouble("AS_MAX_REPETITIONS", 50), RESULT_RECORD_MAX_SAMPLES);
+
+    Measurement measurement;
+    auto start = std::chrono::steady_clock::now();
+    while (measurement.getNumSamples() < std::max(maxRepetitions, 1))
+    {
+        double seconds = runOnce();
+        if (seconds < 0)
+        {
+            // A kernel that fails once is not trusted anymore
+            return Measurement(ResultStatus::RunFailed);
+        }
+        if (cutoffSeconds > 0 && seconds > cutoffSeconds)
+        {
+            // Hopeless candidate, no need to repeat it
+            Measurement censored(ResultStatus::Censored);
+            censored.addSample(seconds);
+            return censored;
+        }
+        measurement.addSample(seconds);
+
+        int repetitions = measurement.getNumSamples();
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (repetitions >= minRepetitions && measurement.getRelativeConfidence() <= ciTarget)
+            break;
+        // Stop before a run that would go over the budget, expensive kernels
+        // get fewer repetitions than cheap ones
+        if (elapsed + elapsed / repetitions > budgetSeconds)
+            break;
+    }
+    return measurement;
+}
+
+/// Numeric record kept for each evaluated node, the time is stored next to
+/// the samples so that comparisons do not recompute the median.
+struct NodeRecord {
+    Measurement measurement;
+    double time;
+};
+
+static std::mutex registryMutex;
+static std::unordered_map<Node *, NodeRecord> registry;
+static std::unordered_set<Node *> reducedNodes;
+static double bestTime = INFINITY;
+
+void Measurement::record(Node *node, const Measurement &measurement)
+{
+    double time = measurement.isFailed() ? INFINITY : measurement.getMedian();
+    std::lock_guard<std::mutex> lock(registryMutex);
+    registry[node] = NodeRecord{measurement, time};
+    if (!reducedNodes.count(node))
+        bestTime = std::min(bestTime, time);
+}
+
+void Measurement::markReduced(Node *node)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    reducedNodes.insert(node);
+}
+
+void Measurement::forget(Node *node)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    registry.erase(node);
+    reducedNodes.erase(node);
+}
+
+void Measurement::resetBestTime()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    bestTime = INFINITY;
+}
+
+double Measurement::getRunCutoff()
+{
+    double cutoff = getEnvDouble("AS_RUN_TIMEOUT_MS", 60000) / 1000;
+    double factor = getEnvDouble("AS_CUTOFF_FACTOR", 10);
+    std::lock_guard<std::mutex> lock(registryMutex);
+    if (factor > 0 && std::isfinite(bestTime))
+        cutoff = std::min(cutoff, factor * bestTime);
+    return cutoff;
+}
+
+double Measurement::getTimeBudget()
+{
+    return getEnvDouble("AS_TIME_BUDGET_MS", 1000) / 1000;
+}
+
+std::string Measurement::getMode()
+{
+    std::string mode = std::getenv("AS_MEASUREMENT_MODE") != nullptr ? std::getenv("AS_MEASUREMENT_MODE") : "warm";
+    return mode == "cold" ? "cold" : "warm";
+}
+
+int Measurement::getWarmupRuns()
+{
+    return std::max<int>(getEnvDouble("AS_WARMUP_RUNS", 1), 0);
+}
+
+double Measurement::getLoweringTimeout()
+{
+    return getEnvDouble("AS_LOWERING_TIMEOUT_MS", 60000) / 1000;
+}
+
+bool Measurement::lookup(Node *node, Measurement &measurement)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto it = registry.find(node);
+    if (it == registry.end())
+        return false;
+    measurement = it->second.measurement;
+    return true;
+}
+
+double Measurement::getTime(Node *node)
+{
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        auto it = registry.find(node);
+        if (it != registry.end())
+            return it->second.time;
+    }
+    std::string evaluation = node->getEvaluation();
+    if (evaluation.empty() || evaluation == "9000000000000000000")
+        return INFINITY;
+    return std::stod(evaluation);
+}
+
+void Measurement::sortByTime(llvm::MutableArrayRef<Node *> nodes)
+{
+    // The times are looked up once, not at every comparison
+    std::vector<std::pair<double, Node *>> keyed;
+    for (Node *node : nodes)
+        keyed.push_back(std::make_pair(getTime(node), node));
+    std::stable_sort(keyed.begin(), keyed.end(), [](const std::pair<double, Node *> &a, const std::pair<double, Node *> &b)
+                     { return a.first < b.first; });
+    for (size_t i = 0; i < keyed.size(); ++i)
+        nodes[i] = keyed[i].second;
+}
+
+bool Measurement::isSignificantlyFaster(const Measurement &candidate, const Measurement &best)
+{
+    if (candidate.isFailed())
+        return false;
+    if (best.isFailed())
+        return true;
+    if (candidate.getNumSamples() < 2 || best.getNumSamples() < 2)
+        return candidate.getMedian() < best.getMedian();
+
+    double difference = best.getMean() - candidate.getMean();
+    if (difference <= 0)
+        return false;
+    double candidateVariance = candidate.getStdDev() * candidate.getStdDev() / candidate.getNumSamples();
+    double bestVariance = best.getStdDev() * best.getStdDev() / best.getNumSamples();
+    double standardError = std::sqrt(candidateVariance + bestVariance);
+    if (standardError == 0)
+        return true;
+    // Welch-Satterthwaite degrees of freedom
+    double degreesOfFreedom = (candidateVariance + bestVariance) * (candidateVariance + bestVariance) /
+                              (candidateVariance * candidateVariance / (candidate.getNumSamples() - 1) +
+                               bestVariance * bestVariance / (best.getNumSamples() - 1));
+    return difference / standardError > studentT(OneSided95, (int)degreesOfFreedom);
+}
+
+bool Measurement::isSignificantlyFaster(Node *candidate, Node *best)
+{
+    Measurement candidateMeasurement, bestMeasurement;
+    if (lookup(candidate, candidateMeasurement) && lookup(best, bestMeasurement))
+        return isSignificantlyFaster(candidateMeasurement, bestMeasurement);
+    return getTime(best) > getTime(candidate);
+}
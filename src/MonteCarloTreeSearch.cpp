@@ -0,0 +1,304 @@
+//===------------------------- MonteCarloTreeSearch.cpp - MCTS -------------===//
+//
+///===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implmentation of the MonteCarloTreeSearch class,
+/// which contains the implmentation of the Monte Carlo tree search method
+///
+//===----------------------------------------------------------------------===//
+
+#include "MonteCarloTreeSearch.h"
+#include "CostModel.h"
+#include "MLIRCodeIR.h"
+#include "Measurement.h"
+
+#include "llvm/ADT/DenseSet.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+/// Reward of a time, failed candidates get none.
+static double getReward(double time)
+{
+    return std::isfinite(time) && time > 0 ? 1 / time : 0;
+}
+
+MonteCarloTreeSearch::MonteCarloTreeSearch(mlir::MLIRContext *context, std::string functionName, int iterations, int depth,
+                                           int numWorkers, std::string rollout, double exploration)
+    : space(context, depth), generator(42)
+{
+    this->context = context;
+    this->functionName = functionName;
+    this->iterations = std::max(iterations, 1);
+    this->numWorkers = numWorkers > 0 ? numWorkers : std::max(1u, std::thread::hardware_concurrency());
+    this->rollout = rollout;
+    this->exploration = exploration;
+}
+
+double MonteCarloTreeSearch::getScore(Node *child, Node *parent)
+{
+    const Statistics &childStats = tree.find(child)->second;
+    int visits = childStats.visits + childStats.virtualLoss;
+    if (visits == 0)
+        return INFINITY;
+    const Statistics &parentStats = tree.find(parent)->second;
+    double bestReward = tree.find(root)->second.bestReward;
+    // The pending descents count as visits without reward
+    double exploitation = bestReward > 0 ? childStats.bestReward / bestReward * childStats.visits / visits : 0;
+    int parentVisits = std::max(parentStats.visits + parentStats.virtualLoss, 1);
+    return exploitation + exploration * std::sqrt(std::log(parentVisits) / visits);
+}
+
+Node *MonteCarloTreeSearch::selectChild(Node *node)
+{
+    Node *selected = nullptr;
+    double bestScore = -INFINITY;
+    for (Node *child : tree[node].children)
+    {
+        double score = getScore(child, node);
+        if (score > bestScore)
+        {
+            bestScore = score;
+            selected = child;
+        }
+    }
+    return selected;
+}
+
+SmallVector<Node *, 8> MonteCarloTreeSearch::descend()
+{
+    SmallVector<Node *, 8> path = {root};
+    Node *node = root;
+    while (tree[node].visits > 0 && tree[node].expanded && !tree[node].children.empty())
+    {
+        node = selectChild(node);
+        path.push_back(node);
+    }
+    for (Node *visited : path)
+        ++tree[visited].virtualLoss;
+    return path;
+}
+
+SmallVector<Node *, 2> MonteCarloTreeSearch::expand(Node *node, int &level)
+{
+    // A step that does not apply to the node (nothing left to tile) is
+    // skipped instead of ending the schedule
+    for (; level < space.getDepth(); ++level)
+    {
+        SmallVector<Node *, 2> children = space.expand(node, level);
+        if (!children.empty())
+        {
+            ++level;
+            return children;
+        }
+    }
+    return {};
+}
+
+Node *MonteCarloTreeSearch::playout(Node *node, int level, unsigned seed, bool useModel)
+{
+    std::mt19937 playoutGenerator(seed);
+    Node *current = node;
+    SmallVector<Node *, 2> children;
+    while (!(children = expand(current, level)).empty())
+    {
+        Node *next = children[std::uniform_int_distribution<size_t>(0, children.size() - 1)(playoutGenerator)];
+        if (useModel)
+        {
+            float bestPrediction = INFINITY;
+            for (Node *child : children)
+            {
+                float prediction = CostModel::get()->predict(child);
+                if (prediction < bestPrediction)
+                {
+                    bestPrediction = prediction;
+                    next = child;
+                }
+            }
+        }
+        // Only the path of the playout is kept
+        for (Node *child : children)
+            if (child != next)
+                SearchSpace::eraseNode(child);
+        if (current != node)
+            SearchSpace::eraseNode(current);
+        current = next;
+    }
+    return current;
+}
+
+void MonteCarloTreeSearch::updateChildrenNodes(Node *node)
+{
+    const Statistics &stats = tree[node];
+    SmallVector<Node *, 2> childrenNodes(stats.children.begin(), stats.children.end());
+    childrenNodes.append(stats.playouts.begin(), stats.playouts.end());
+    node->setChildrenNodes(childrenNodes);
+}
+
+Node *MonteCarloTreeSearch::runSearchMethod(Node *root)
+{
+    // Create an evaluator for transformation evaluations
+    std::unique_ptr<EvaluationByExecution> evaluator = EvaluationByExecution::create(this->functionName + "_logs_mcts.txt");
+    CostModel *costModel = CostModel::get();
+
+    this->root = root;
+    tree.clear();
+    tree[root].visits = 1;
+    tree[root].bestReward = getReward(Measurement::getTime(root));
+    Node *BestNode = root;
+
+    for (int done = 0, round = 0; done < iterations; ++round)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        // The descents of the round are done one after the other, the virtual
+        // loss of the previous ones sends each descent to a different node
+        int numDescents = std::min(numWorkers, iterations - done);
+        std::vector<SmallVector<Node *, 8>> paths;
+        for (int i = 0; i < numDescents; ++i)
+            paths.push_back(descend());
+
+        // Visited nodes reached by a descent are expanded, in parallel
+        std::vector<Node *> toExpand;
+        llvm::DenseSet<Node *> toExpandSet;
+        for (SmallVector<Node *, 8> &path : paths)
+        {
+            Node *node = path.back();
+            if (tree[node].visits > 0 && !tree[node].expanded && toExpandSet.insert(node).second)
+                toExpand.push_back(node);
+        }
+        std::vector<SmallVector<Node *, 2>> expanded(toExpand.size());
+        std::vector<int> levels(toExpand.size());
+        for (size_t i = 0; i < toExpand.size(); ++i)
+            levels[i] = tree[toExpand[i]].level;
+        std::atomic<size_t> nextNode(0);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < std::min<int>(numWorkers, toExpand.size()); ++t)
+        {
+            threads.emplace_back([&]()
+                                 {
+                size_t index;
+                while ((index = nextNode++) < toExpand.size())
+                    expanded[index] = expand(toExpand[index], levels[index]); });
+        }
+        for (std::thread &thread : threads)
+            thread.join();
+        for (size_t i = 0; i < toExpand.size(); ++i)
+        {
+            for (Node *child : expanded[i])
+                tree[child].level = levels[i];
+            tree[toExpand[i]].expanded = true;
+            tree[toExpand[i]].children = expanded[i];
+            updateChildrenNodes(toExpand[i]);
+        }
+
+        // The descents that expanded a node go on to one of its new children
+        for (SmallVector<Node *, 8> &path : paths)
+        {
+            Node *node = path.back();
+            if (!toExpandSet.count(node) || tree[node].children.empty())
+                continue;
+            Node *selected = selectChild(node);
+            ++tree[selected].virtualLoss;
+            path.push_back(selected);
+        }
+
+        // The new nodes are measured and played out to the end of the space
+        std::vector<Node *> leaves;
+        llvm::DenseSet<Node *> leafSet;
+        for (SmallVector<Node *, 8> &path : paths)
+            if (tree[path.back()].visits == 0 && leafSet.insert(path.back()).second)
+                leaves.push_back(path.back());
+        bool useModel = rollout == "model" && costModel != nullptr && costModel->isWarm();
+        std::vector<Node *> playouts(leaves.size());
+        std::vector<int> leafLevels(leaves.size());
+        std::vector<unsigned> seeds(leaves.size());
+        for (size_t i = 0; i < leaves.size(); ++i)
+        {
+            leafLevels[i] = tree[leaves[i]].level;
+            seeds[i] = generator();
+        }
+        nextNode = 0;
+        threads.clear();
+        for (int t = 0; t < std::min<int>(numWorkers, leaves.size()); ++t)
+        {
+            threads.emplace_back([&]()
+                                 {
+                size_t index;
+                while ((index = nextNode++) < leaves.size())
+                    playouts[index] = playout(leaves[index], leafLevels[index], seeds[index], useModel); });
+        }
+        for (std::thread &thread : threads)
+            thread.join();
+
+        SmallVector<Node *, 2> candidates(leaves.begin(), leaves.end());
+        if (!useModel)
+            for (size_t i = 0; i < leaves.size(); ++i)
+                if (playouts[i] != leaves[i])
+                    candidates.push_back(playouts[i]);
+        auto expandedTime = std::chrono::high_resolution_clock::now();
+        evaluator->evaluateTransformations(candidates);
+        if (costModel)
+            costModel->update(candidates);
+        for (Node *candidate : candidates)
+            if (Measurement::getTime(candidate) < Measurement::getTime(BestNode))
+                BestNode = candidate;
+
+        // The best reward of the node and of its playout goes up to the root
+        llvm::DenseMap<Node *, double> rewards;
+        for (size_t i = 0; i < leaves.size(); ++i)
+        {
+            double reward = getReward(Measurement::getTime(leaves[i]));
+            if (playouts[i] != leaves[i])
+            {
+                double playoutTime = useModel ? std::exp(costModel->predict(playouts[i])) : Measurement::getTime(playouts[i]);
+                reward = std::max(reward, getReward(playoutTime));
+                if (useModel)
+                    SearchSpace::eraseNode(playouts[i]);
+                else
+                {
+                    // The measured playout may be the best node, it is kept
+                    // under its leaf to be printed
+                    tree[leaves[i]].playouts.push_back(playouts[i]);
+                    updateChildrenNodes(leaves[i]);
+                }
+            }
+            rewards[leaves[i]] = reward;
+        }
+        for (SmallVector<Node *, 8> &path : paths)
+        {
+            double reward = rewards.count(path.back()) ? rewards[path.back()] : tree[path.back()].bestReward;
+            for (Node *node : path)
+            {
+                Statistics &stats = tree[node];
+                --stats.virtualLoss;
+                ++stats.visits;
+                stats.bestReward = std::max(stats.bestReward, reward);
+            }
+        }
+        done += numDescents;
+
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << "Round " << round << ": " << numDescents << " descents, " << candidates.size() << " candidates, expansion "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(expandedTime - start).count() << " ms, evaluation "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - expandedTime).count() << " ms, best "
+                  << Measurement::getTime(BestNode) << " s" << std::endl;
+
+        // Every schedule of the space was measured
+        if (toExpand.empty() && leaves.empty() && tree[root].expanded)
+        {
+            bool exhausted = true;
+            for (auto &entry : tree)
+                if (entry.second.visits == 0 || !entry.second.expanded)
+                    exhausted = false;
+            if (exhausted)
+                break;
+        }
+    }
+
+    return BestNode;
+}
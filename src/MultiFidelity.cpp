@@ -0,0 +1,222 @@
+//===--------------------- MultiFidelity.cpp - MultiFidelity ---------------===//
+//
+///===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implmentation of the MultiFidelity class, which
+/// contains the screening of the candidates on a reduced problem
+///
+//===----------------------------------------------------------------------===//
+
+#include "MultiFidelity.h"
+#include "CostModel.h"
+#include "MLIRCodeIR.h"
+#include "Measurement.h"
+#include "RegionTiming.h"
+#include "SearchSpace.h"
+#include "Utils.h"
+
+#include "mlir/Dialect/Arith/IR/Arith.h"
+#include "mlir/Dialect/Linalg/IR/Linalg.h"
+#include "mlir/Dialect/SCF/IR/SCF.h"
+#include "mlir/Dialect/Utils/StaticValueUtils.h"
+#include "mlir/Dialect/Vector/IR/VectorOps.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <thread>
+
+MultiFidelity::MultiFidelity(double fraction, double promoted)
+    : fraction(fraction), promoted(promoted), numScreened(0), numPromoted(0)
+{
+}
+
+MultiFidelity *MultiFidelity::get()
+{
+    static MultiFidelity *fidelity = []() -> MultiFidelity *
+    {
+        double fraction = getEnvDouble("AS_FIDELITY", 1);
+        double promoted = getEnvDouble("AS_FIDELITY_PROMOTE", 0.25);
+        if (fraction <= 0 || fraction >= 1)
+            return nullptr;
+        return new MultiFidelity(fraction, std::min(std::max(promoted, 0.0), 1.0));
+    }();
+    return fidelity;
+}
+
+/// Iterations of the loop, 0 when its bounds are not constant.
+static int64_t getTripCount(int64_t lowerBound, int64_t upperBound, int64_t step)
+{
+    if (ShapedType::isDynamic(lowerBound) || ShapedType::isDynamic(upperBound) || ShapedType::isDynamic(step) ||
+        step <= 0 || upperBound <= lowerBound)
+        return 0;
+    return (upperBound - lowerBound + step - 1) / step;
+}
+
+/// Shortens the first dimension of the parallel loop that has more than one
+/// iteration, the loop keeps at least one iteration per core.
+static bool reduceForall(scf::ForallOp forall, double fraction, int64_t cores)
+{
+    SmallVector<int64_t> lowerBounds(forall.getStaticLowerBound()), upperBounds(forall.getStaticUpperBound()),
+        steps(forall.getStaticStep());
+    SmallVector<int64_t> trips;
+    int64_t total = 1;
+    for (size_t d = 0; d < upperBounds.size(); ++d)
+    {
+        trips.push_back(getTripCount(lowerBounds[d], upperBounds[d], steps[d]));
+        total *= trips.back();
+    }
+    if (total <= 1)
+        return false;
+    int64_t target = std::max<int64_t>(std::ceil(total * fraction), std::min(total, cores));
+    for (size_t d = 0; d < trips.size(); ++d)
+    {
+        if (trips[d] <= 1)
+            continue;
+        int64_t others = total / trips[d];
+        int64_t kept = std::min<int64_t>(std::max<int64_t>((target + others - 1) / others, 1), trips[d]);
+        if (kept == trips[d])
+            return false;
+        upperBounds[d] = lowerBounds[d] + kept * steps[d];
+        forall.setStaticUpperBound(upperBounds);
+        return true;
+    }
+    return false;
+}
+
+static bool reduceFor(scf::ForOp loop, double fraction)
+{
+    std::optional<int64_t> lowerBound = getConstantIntValue(loop.getLowerBound());
+    std::optional<int64_t> upperBound = getConstantIntValue(loop.getUpperBound());
+    std::optional<int64_t> step = getConstantIntValue(loop.getStep());
+    if (!lowerBound || !upperBound || !step)
+        return false;
+    int64_t trips = getTripCount(*lowerBound, *upperBound, *step);
+    int64_t kept = std::max<int64_t>(std::ceil(trips * fraction), 1);
+    if (trips <= 1 || kept == trips)
+        return false;
+    OpBuilder builder(loop);
+    loop.setUpperBound(builder.create<arith::ConstantIndexOp>(loop.getLoc(), *lowerBound + kept * *step));
+    return true;
+}
+
+bool MultiFidelity::reduce(mlir::Operation *module, double fraction)
+{
+    int64_t cores = getEnvInt("OMP_NUM_THREADS", std::thread::hardware_concurrency());
+    // The outermost loops of the tiled computations, the loops initializing
+    // the inputs or flushing the caches hold none
+    SmallVector<Operation *> loops;
+    module->walk([&](Operation *op)
+                 {
+        if (!isa<scf::ForallOp, scf::ForOp>(op) || op->hasAttr(TIMER_ATTR))
+            return;
+        for (Operation *parent = op->getParentOp(); parent != nullptr; parent = parent->getParentOp())
+            if (isa<scf::ForallOp, scf::ForOp>(parent))
+                return;
+        bool computes = false;
+        op->walk([&](Operation *nested)
+                 {
+            if (isa<linalg::LinalgOp, vector::ContractionOp>(nested))
+                computes = true; });
+        if (computes)
+            loops.push_back(op); });
+
+    bool reduced = false;
+    for (Operation *loop : loops)
+    {
+        if (scf::ForallOp forall = dyn_cast<scf::ForallOp>(loop))
+            reduced |= reduceForall(forall, fraction, std::max<int64_t>(cores, 1));
+        else
+            reduced |= reduceFor(cast<scf::ForOp>(loop), fraction);
+    }
+    return reduced;
+}
+
+llvm::SmallVector<Node *, 2> MultiFidelity::screen(llvm::ArrayRef<Node *> nodes, EvaluationByExecution *evaluator)
+{
+    llvm::SmallVector<Node *, 2> selected;
+    llvm::SmallVector<Node *, 2> screened;
+    llvm::SmallVector<Node *, 2> reducedNodes;
+    reducedTimes.clear();
+    for (Node *node : nodes)
+    {
+        MLIRCodeIR *reducedCode = (MLIRCodeIR *)((MLIRCodeIR *)node->getTransformedCodeIr())->cloneIr();
+        mlir::Operation *op = (mlir::Operation *)reducedCode->getIr();
+        if (!reduce(op, fraction))
+        {
+            op->erase();
+            selected.push_back(node);
+            continue;
+        }
+        // The copies carry no transformation, they stay out of the logs and
+        // of the schedule database
+        screened.push_back(node);
+        reducedNodes.push_back(new Node(reducedCode, node->getCurrentStage()));
+        Measurement::markReduced(reducedNodes.back());
+    }
+    if (screened.size() <= 1)
+    {
+        for (Node *reducedNode : reducedNodes)
+            SearchSpace::eraseNode(reducedNode);
+        selected.append(screened.begin(), screened.end());
+        return selected;
+    }
+
+    evaluator->evaluateTransformations(reducedNodes);
+
+    std::vector<size_t> order(screened.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+                     { return Measurement::getTime(reducedNodes[a]) < Measurement::getTime(reducedNodes[b]); });
+    size_t kept = std::max<size_t>(1, std::ceil(promoted * screened.size()));
+    for (size_t k = 0; k < order.size(); ++k)
+    {
+        Node *node = screened[order[k]];
+        double time = Measurement::getTime(reducedNodes[order[k]]);
+        if (k < kept && std::isfinite(time))
+        {
+            selected.push_back(node);
+            reducedTimes[node] = time;
+        }
+        else
+            node->setEvaluation("9000000000000000000");
+    }
+    for (Node *reducedNode : reducedNodes)
+        SearchSpace::eraseNode(reducedNode);
+    numScreened += screened.size();
+    numPromoted += reducedTimes.size();
+    std::cout << "Multi-fidelity: " << reducedTimes.size() << " of " << screened.size()
+              << " candidates promoted to the full problem" << std::endl;
+    return selected;
+}
+
+void MultiFidelity::update(llvm::ArrayRef<Node *> nodes)
+{
+    std::vector<double> reduced, full;
+    for (Node *node : nodes)
+    {
+        if (!reducedTimes.count(node) || !std::isfinite(Measurement::getTime(node)))
+            continue;
+        reduced.push_back(reducedTimes[node]);
+        full.push_back(Measurement::getTime(node));
+    }
+    reducedTimes.clear();
+    if (reduced.size() < 3)
+        return;
+    correlations.push_back(CostModel::getRankCorrelation(reduced, full));
+    std::cout << "Multi-fidelity: rank correlation " << correlations.back() << " between the reduced and full times of "
+              << reduced.size() << " candidates" << std::endl;
+}
+
+std::string MultiFidelity::summary()
+{
+    std::ostringstream out;
+    double mean = correlations.empty() ? 0 : std::accumulate(correlations.begin(), correlations.end(), 0.0) / correlations.size();
+    out << "Multi-fidelity: " << numPromoted << " of " << numScreened << " screened candidates promoted, mean rank correlation "
+        << mean << " over " << correlations.size() << " steps";
+    return out.str();
+}
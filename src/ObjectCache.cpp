@@ -0,0 +1,82 @@
+//===--------------------------- ObjectCache.cpp - ObjectCache -------------===//
+//
+///===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implmentation of the ObjectCache class, which
+/// contains an on-disk cache of the machine code generated by the JIT for the
+/// lowered candidates
+///
+//===----------------------------------------------------------------------===//
+
+#include "ObjectCache.h"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <unistd.h>
+
+ObjectCache::ObjectCache(const std::string &directory)
+{
+    this->directory = directory;
+    llvm::sys::fs::create_directories(directory);
+}
+
+ObjectCache *ObjectCache::get()
+{
+    static ObjectCache *cache = nullptr;
+    static std::once_flag once;
+    std::call_once(once, []()
+                   {
+        if (std::getenv("AS_OBJECT_CACHE") != nullptr)
+            cache = new ObjectCache(std::getenv("AS_OBJECT_CACHE")); });
+    return cache;
+}
+
+std::string ObjectCache::getKey(const std::string &loweredModule, const std::string &codegenOptions)
+{
+    llvm::SHA1 hasher;
+    hasher.update(codegenOptions);
+    hasher.update("\n");
+    hasher.update(loweredModule);
+    return llvm::toHex(hasher.final(), /*LowerCase=*/true);
+}
+
+std::string ObjectCache::getPath(const std::string &key)
+{
+    return directory + "/" + key + ".o";
+}
+
+std::unique_ptr<llvm::MemoryBuffer> ObjectCache::load(const std::string &key)
+{
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> object = llvm::MemoryBuffer::getFile(getPath(key));
+    if (!object)
+        return nullptr;
+    return std::move(*object);
+}
+
+void ObjectCache::store(const std::string &key, mlir::ExecutionEngine &engine)
+{
+    // Written under a temporary name and renamed, concurrent jobs never load
+    // a partial object
+    std::string tmpPath = getPath(key) + ".tmp." + std::to_string(getpid()) + "." +
+                          std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    engine.dumpToObjectFile(tmpPath);
+    // Nothing is written when the engine did not generate any code, an empty
+    // object would fail every later load
+    uint64_t size = 0;
+    if (llvm::sys::fs::file_size(tmpPath, size) || size == 0)
+    {
+        std::remove(tmpPath.c_str());
+        return;
+    }
+    if (std::rename(tmpPath.c_str(), getPath(key).c_str()) != 0)
+        std::remove(tmpPath.c_str());
+}
@@ -27,6 +27,7 @@ static LogicalResult FuseIntoContainingOperation(mlir::Operation *Target, std::s
 
   std::string transformDialectString = "module attributes {transform.with_named_sequence} { \n transform.named_sequence @__transform_main(%variant_op: !transform.any_op {transform.readonly})  { \n  %0 = transform.structured.match attributes{\"" + producerTag + "\"} in %variant_op : (!transform.any_op) -> !transform.any_op \n %1 = transform.structured.match attributes{\"" + consumerTag + "\"} in %variant_op : (!transform.any_op) -> !transform.any_op \n transform.structured.fuse_into_containing_op %0 into %1 : (!transform.any_op, !transform.any_op) -> (!transform.any_op, !transform.any_op) \n transform.yield}}";
   mlir::transform::TransformOptions options1;
+  std::lock_guard<std::mutex> lock(getContextMutex());
   mlir::OwningOpRef<mlir::ModuleOp> moduleFromFile = parseSourceString<mlir::ModuleOp>(transformDialectString, Target->getContext());
   llvm::StringRef entryPoint = "__transform_main";
   mlir::Operation *transformEntryPoint = transform::detail::findTransformEntryPoint(Target, *moduleFromFile, entryPoint);
@@ -123,8 +124,11 @@ DiagnosedSilenceableFailure FuseOps(Operation *f, SmallVector<mlir::Operation *,
   pm.addPass(mlir::bufferization::createEmptyTensorEliminationPass());
   pm.addPass(mlir::bufferization::createEmptyTensorToAllocTensorPass());
 
-  if (!mlir::failed(pm.run((f))))
-    int ClonedOpIndex = 0;
+  {
+    std::lock_guard<std::mutex> lock(getContextMutex());
+    if (!mlir::failed(pm.run((f))))
+      int ClonedOpIndex = 0;
+  }
   SmallVector<mlir::Operation *, 2> NewProducers;
   f->walk([&](mlir::Operation *op)
           {
@@ -335,7 +339,8 @@ void Parallelization::applyTransformation(CodeIR CodeIr)
 SmallVector<Node *, 2> Parallelization::createParallelizationCandidates(Node *node,
                                                                         mlir::MLIRContext *context,
                                                                         int CurrentStage,
-                                                                        SmallVector<mlir::linalg::LinalgOp, 4> LinalgOpStages)
+                                                                        SmallVector<mlir::linalg::LinalgOp, 4> LinalgOpStages,
+                                                                        SmallVector<SmallVector<int64_t, 4>, 4> TileCombinations)
 {
   // Set the maximum number of loops for parallelization (commented out)
   // int64_t maxNumberLoops = 4;
@@ -395,12 +400,16 @@ SmallVector<Node *, 2> Parallelization::createParallelizationCandidates(Node *no
       }
       possibleTileSizes.push_back(dividers);
     }
-    for (size_t NumberLoops = 2; NumberLoops <= iterationDomain.size() - 1; ++NumberLoops)
-    {
-      SmallVector<SmallVector<int64_t, 4>, 4> newCombinations =
-          generateTileForAllOpCombinations(NumberLoops, possibleTileSizes, upperBounds);
-      tileCombinations.insert(tileCombinations.end(), newCombinations.begin(), newCombinations.end());
-    }
+    // Given tile sizes replace the enumerated ones
+    if (!TileCombinations.empty())
+      tileCombinations = TileCombinations;
+    else
+      for (size_t NumberLoops = 2; NumberLoops <= iterationDomain.size() - 1; ++NumberLoops)
+      {
+        SmallVector<SmallVector<int64_t, 4>, 4> newCombinations =
+            generateTileForAllOpCombinations(NumberLoops, possibleTileSizes, upperBounds);
+        tileCombinations.insert(tileCombinations.end(), newCombinations.begin(), newCombinations.end());
+      }
 
     SmallVector<SmallVector<int64_t, 4>, 4> SelectedTileCombinations;
     // SelectedTileCombinations.push_back({2, 200});
@@ -501,8 +510,11 @@ SmallVector<Node *, 2> Parallelization::createParallelizationCandidates(Node *no
     pm.addPass(mlir::bufferization::createEmptyTensorEliminationPass());
     pm.addPass(mlir::bufferization::createEmptyTensorToAllocTensorPass());
 
-    if (!mlir::failed(pm.run((ClonedTarget))))
-      int ClonedOpIndex = 0;
+    {
+      std::lock_guard<std::mutex> lock(getContextMutex());
+      if (!mlir::failed(pm.run((ClonedTarget))))
+        int ClonedOpIndex = 0;
+    }
     /*ClonedTarget->walk([&](Operation *op)
                        {
 
@@ -0,0 +1,149 @@
+//===------------------------- PerfCounters.cpp - PerfCounters -------------===//
+//
+///===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implmentation of the PerfCounters class, which
+/// contains the hardware performance counters read around the timed region
+/// of a kernel
+///
+//===----------------------------------------------------------------------===//
+
+#include "PerfCounters.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sstream>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/// Opens one counter of the calling thread, disabled, for its user space
+/// code. The counts of inherited counters only reach the parent once the
+/// threads exit, which the OpenMP workers do not, so they are not inherited.
+static int openCounter(uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+static uint64_t getCacheConfig(uint64_t cache, uint64_t op, uint64_t result)
+{
+    return cache | (op << 8) | (result << 16);
+}
+
+PerfCounters::PerfCounters()
+{
+    fds[Cycles] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    fds[Instructions] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    fds[L1DMisses] = openCounter(PERF_TYPE_HW_CACHE, getCacheConfig(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                                                                    PERF_COUNT_HW_CACHE_RESULT_MISS));
+    fds[LLCMisses] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    fds[DTLBMisses] = openCounter(PERF_TYPE_HW_CACHE, getCacheConfig(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ,
+                                                                     PERF_COUNT_HW_CACHE_RESULT_MISS));
+    fds[VectorInstructions] = -1;
+    if (std::getenv("AS_PERF_VECTOR_EVENT") != nullptr)
+        fds[VectorInstructions] = openCounter(PERF_TYPE_RAW, std::strtoull(std::getenv("AS_PERF_VECTOR_EVENT"), nullptr, 0));
+}
+
+PerfCounters::~PerfCounters()
+{
+    for (int fd : fds)
+        if (fd >= 0)
+            close(fd);
+}
+
+PerfCounters *PerfCounters::get()
+{
+    thread_local std::unique_ptr<PerfCounters> counters = []()
+    {
+        std::unique_ptr<PerfCounters> threadCounters;
+        if (std::getenv("AS_PERF_COUNTERS") != nullptr && std::string(std::getenv("AS_PERF_COUNTERS")) == "0")
+            return threadCounters;
+        threadCounters.reset(new PerfCounters());
+        bool opened = false;
+        for (int fd : threadCounters->fds)
+            opened = opened || fd >= 0;
+        if (!opened)
+            threadCounters.reset();
+        return threadCounters;
+    }();
+    return counters.get();
+}
+
+void PerfCounters::start()
+{
+    for (int fd : fds)
+    {
+        if (fd < 0)
+            continue;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+std::vector<uint64_t> PerfCounters::stop()
+{
+    for (int fd : fds)
+        if (fd >= 0)
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+
+    std::vector<uint64_t> values(NumCounters, PERF_COUNTER_UNAVAILABLE);
+    for (int i = 0; i < NumCounters; ++i)
+    {
+        // value, time enabled, time running
+        uint64_t data[3];
+        if (fds[i] < 0 || read(fds[i], data, sizeof(data)) != sizeof(data) || data[2] == 0)
+            continue;
+        values[i] = data[2] < data[1] ? (uint64_t)((double)data[0] * data[1] / data[2]) : data[0];
+    }
+    return values;
+}
+
+const char *PerfCounters::getName(int counter)
+{
+    switch (counter)
+    {
+    case Cycles:
+        return "cycles";
+    case Instructions:
+        return "instructions";
+    case L1DMisses:
+        return "L1d misses";
+    case LLCMisses:
+        return "LLC misses";
+    case DTLBMisses:
+        return "dTLB misses";
+    case VectorInstructions:
+        return "vector instructions";
+    default:
+        return "counter";
+    }
+}
+
+std::string PerfCounters::summary(const std::vector<uint64_t> &counters)
+{
+    std::ostringstream out;
+    for (size_t i = 0; i < counters.size() && i < NumCounters; ++i)
+    {
+        if (counters[i] == PERF_COUNTER_UNAVAILABLE)
+            continue;
+        out << (out.tellp() > 0 ? ", " : "") << getName(i) << " " << counters[i];
+    }
+    if (counters.size() > Instructions && counters[Cycles] != PERF_COUNTER_UNAVAILABLE &&
+        counters[Instructions] != PERF_COUNTER_UNAVAILABLE && counters[Cycles] > 0)
+        out << ", IPC " << (double)counters[Instructions] / counters[Cycles];
+    return out.str();
+}
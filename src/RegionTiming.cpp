@@ -0,0 +1,241 @@
+//===------------------------- RegionTiming.cpp - RegionTiming -------------===//
+//
+///===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implmentation of the timing instrumentation of the
+/// tuned code
+///
+//===----------------------------------------------------------------------===//
+
+#include "RegionTiming.h"
+#include "Measurement.h"
+#include "Utils.h"
+
+#include "mlir/Dialect/Arith/IR/Arith.h"
+#include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/Dialect/SCF/IR/SCF.h"
+#include "mlir/IR/Builders.h"
+#include "mlir/IR/BuiltinOps.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include <unistd.h>
+
+using namespace mlir;
+
+std::string getTimedRegionMode()
+{
+    return std::getenv("AS_TIMED_REGION") != nullptr ? std::getenv("AS_TIMED_REGION") : "";
+}
+
+/// Returns the function of the module with the given name, declares it when
+/// the module does not have it.
+static func::FuncOp getOrDeclare(ModuleOp module, llvm::StringRef name, FunctionType type, bool cInterface)
+{
+    if (func::FuncOp function = module.lookupSymbol<func::FuncOp>(name))
+        return function;
+    OpBuilder builder(module.getBodyRegion());
+    builder.setInsertionPointToStart(module.getBody());
+    func::FuncOp function = builder.create<func::FuncOp>(module.getLoc(), name, type);
+    function.setPrivate();
+    if (cInterface)
+        function->setAttr("llvm.emit_c_interface", builder.getUnitAttr());
+    return function;
+}
+
+void declareTimerFunctions(mlir::ModuleOp module, mlir::func::FuncOp &nanoTime, mlir::func::FuncOp &printFlops)
+{
+    Builder builder(module.getContext());
+    nanoTime = getOrDeclare(module, "nanoTime", builder.getFunctionType({}, {builder.getI64Type()}), true);
+    printFlops = getOrDeclare(module, "printFlops", builder.getFunctionType({builder.getF64Type()}, {}), false);
+}
+
+/// Defines the counter hook with the given name as an empty function.
+static void defineCounterHook(ModuleOp module, llvm::StringRef name)
+{
+    if (module.lookupSymbol<func::FuncOp>(name))
+        return;
+    OpBuilder builder(module.getBodyRegion());
+    builder.setInsertionPointToStart(module.getBody());
+    func::FuncOp hook = builder.create<func::FuncOp>(module.getLoc(), name, builder.getFunctionType({}, {}));
+    builder.setInsertionPointToStart(hook.addEntryBlock());
+    builder.create<func::ReturnOp>(module.getLoc());
+}
+
+void insertCounterHooks(mlir::func::CallOp start, mlir::func::CallOp end)
+{
+    ModuleOp module = start->getParentOfType<ModuleOp>();
+    defineCounterHook(module, COUNTERS_START);
+    defineCounterHook(module, COUNTERS_STOP);
+    // The counters are started and read out of the timed interval
+    OpBuilder builder(start);
+    func::CallOp startHook = builder.create<func::CallOp>(start.getLoc(), COUNTERS_START, TypeRange{});
+    builder.setInsertionPointAfter(end);
+    func::CallOp stopHook = builder.create<func::CallOp>(end.getLoc(), COUNTERS_STOP, TypeRange{});
+    startHook->setAttr(TIMER_ATTR, builder.getUnitAttr());
+    stopHook->setAttr(TIMER_ATTR, builder.getUnitAttr());
+}
+
+/// Returns the nanoTime calls that start the regions timed by the module with
+/// the calls that end them.
+static SmallVector<std::pair<func::CallOp, func::CallOp>> getTimerPairs(mlir::Operation *module)
+{
+    // A region starts with the nanoTime call subtracted from the one ending it
+    SmallVector<std::pair<func::CallOp, func::CallOp>> pairs;
+    module->walk([&](arith::SubIOp delta)
+                 {
+        func::CallOp start = dyn_cast_or_null<func::CallOp>(delta.getRhs().getDefiningOp());
+        func::CallOp end = dyn_cast_or_null<func::CallOp>(delta.getLhs().getDefiningOp());
+        if (start && end && start.getCallee() == "nanoTime" && end.getCallee() == "nanoTime")
+            pairs.push_back(std::make_pair(start, end)); });
+    return pairs;
+}
+
+void hookInputTimers(mlir::Operation *module)
+{
+    for (std::pair<func::CallOp, func::CallOp> &timers : getTimerPairs(module))
+        if (!timers.first->hasAttr(TIMER_ATTR))
+            insertCounterHooks(timers.first, timers.second);
+}
+
+/// Returns the size of the cache flush buffer in bytes.
+static int64_t getFlushBytes()
+{
+    if (std::getenv("AS_FLUSH_BYTES") != nullptr)
+        return std::max<int64_t>(std::atoll(std::getenv("AS_FLUSH_BYTES")), 64);
+    long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    return 2 * (llc > 0 ? llc : 32 << 20);
+}
+
+void insertCacheFlush(mlir::OpBuilder &builder, mlir::Location loc)
+{
+    ModuleOp module = builder.getInsertionBlock()->getParentOp()->getParentOfType<ModuleOp>();
+    // A global buffer, the stores to a freed buffer could be removed by LLVM
+    MemRefType type = MemRefType::get({getFlushBytes() / 8}, builder.getI64Type());
+    memref::GlobalOp global = module.lookupSymbol<memref::GlobalOp>(FLUSH_BUFFER);
+    if (!global)
+    {
+        OpBuilder::InsertionGuard guard(builder);
+        builder.setInsertionPointToStart(module.getBody());
+        global = builder.create<memref::GlobalOp>(loc, FLUSH_BUFFER, builder.getStringAttr("private"), type,
+                                                  builder.getUnitAttr(), /*constant=*/false, IntegerAttr());
+    }
+    type = global.getType();
+
+    // One store per cache line
+    Value buffer = builder.create<memref::GetGlobalOp>(loc, type, FLUSH_BUFFER);
+    Value lowerBound = builder.create<arith::ConstantIndexOp>(loc, 0);
+    Value upperBound = builder.create<arith::ConstantIndexOp>(loc, type.getNumElements());
+    Value step = builder.create<arith::ConstantIndexOp>(loc, 8);
+    scf::ForOp loop = builder.create<scf::ForOp>(loc, lowerBound, upperBound, step, ValueRange{},
+                                                 [&](OpBuilder &nested, Location nestedLoc, Value index, ValueRange)
+                                                 {
+                                                     Value value = nested.create<arith::IndexCastOp>(nestedLoc, nested.getI64Type(), index);
+                                                     nested.create<memref::StoreOp>(nestedLoc, value, buffer, index);
+                                                     nested.create<scf::YieldOp>(nestedLoc);
+                                                 });
+    for (Value flushValue : {buffer, lowerBound, upperBound, step})
+        flushValue.getDefiningOp()->setAttr(TIMER_ATTR, builder.getUnitAttr());
+    loop->setAttr(TIMER_ATTR, builder.getUnitAttr());
+}
+
+void flushBeforeTimers(mlir::Operation *module)
+{
+    if (Measurement::getMode() != "cold")
+        return;
+    for (std::pair<func::CallOp, func::CallOp> &timers : getTimerPairs(module))
+    {
+        OpBuilder builder(timers.first);
+        insertCacheFlush(builder, timers.first.getLoc());
+    }
+}
+
+mlir::LogicalResult timeRegion(mlir::Operation *op)
+{
+    // The whole loop nest the operation was tiled into is timed
+    Operation *region = op;
+    while (region->getParentOp() != nullptr && !isa<func::FuncOp>(region->getParentOp()))
+        region = region->getParentOp();
+    ModuleOp module = region->getParentOfType<ModuleOp>();
+    if (region->getParentOp() == nullptr || !module)
+        return failure();
+
+    // Only the last printFlops is kept by the evaluators, the ones of the
+    // input module and of the previous region are removed. The nanoTime calls
+    // of the input module are replaced by zeros, their differences may still
+    // be printed or stored by the benchmark but nothing is timed around the
+    // region anymore
+    SmallVector<Operation *> stale;
+    SmallVector<func::CallOp> inputTimers;
+    module.walk([&](Operation *nested)
+                {
+        nested->removeAttr(TIMED_REGION_ATTR);
+        if (nested->hasAttr(TIMER_ATTR))
+            stale.push_back(nested);
+        else if (func::CallOp call = dyn_cast<func::CallOp>(nested))
+        {
+            if (call.getCallee() == "printFlops")
+                stale.push_back(nested);
+            else if (call.getCallee() == "nanoTime")
+                inputTimers.push_back(call);
+        } });
+    for (Operation *staleOp : llvm::reverse(stale))
+        staleOp->erase();
+    for (func::CallOp timer : inputTimers)
+    {
+        OpBuilder timerBuilder(timer);
+        Value zero = timerBuilder.create<arith::ConstantIntOp>(timer.getLoc(), 0, 64);
+        timer.getResult(0).replaceAllUsesWith(zero);
+        timer.erase();
+    }
+
+    OpBuilder builder(region);
+    Location loc = region->getLoc();
+    func::FuncOp nanoTime, printFlops;
+    declareTimerFunctions(module, nanoTime, printFlops);
+
+    builder.setInsertionPoint(region);
+    if (Measurement::getMode() == "cold")
+        insertCacheFlush(builder, loc);
+    func::CallOp start = builder.create<func::CallOp>(loc, nanoTime);
+    builder.setInsertionPointAfter(region);
+    func::CallOp end = builder.create<func::CallOp>(loc, nanoTime);
+    arith::SubIOp delta = builder.create<arith::SubIOp>(loc, end.getResult(0), start.getResult(0));
+    arith::UIToFPOp nanoseconds = builder.create<arith::UIToFPOp>(loc, builder.getF64Type(), delta);
+    func::CallOp print = builder.create<func::CallOp>(loc, printFlops, ValueRange{nanoseconds});
+    for (Operation *timer : {start.getOperation(), end.getOperation(), delta.getOperation(),
+                             nanoseconds.getOperation(), print.getOperation()})
+        timer->setAttr(TIMER_ATTR, builder.getUnitAttr());
+    insertCounterHooks(start, end);
+    op->setAttr(TIMED_REGION_ATTR, builder.getUnitAttr());
+    return success();
+}
+
+bool isTimedRegion(mlir::Operation *op)
+{
+    return op->hasAttr(TIMED_REGION_ATTR);
+}
+
+bool instrumentTimedRegion(mlir::Operation *module, int stage)
+{
+    std::string mode = getTimedRegionMode();
+    llvm::SmallVector<mlir::linalg::LinalgOp, 4> linalgOps = getLinalgOps(module);
+    Operation *target = nullptr;
+    if (mode == "stage")
+        target = stage < (int)linalgOps.size() ? linalgOps[stage].getOperation() : nullptr;
+    else if (!mode.empty())
+    {
+        int index = std::atoi(mode.c_str());
+        target = index >= 0 && index < (int)linalgOps.size() ? linalgOps[index].getOperation() : nullptr;
+    }
+    else
+    {
+        module->walk([&](Operation *nested)
+                     {
+            if (target == nullptr && isTimedRegion(nested))
+                target = nested; });
+    }
+    return target != nullptr && succeeded(timeRegion(target));
+}
@@ -0,0 +1,441 @@
+//===------------------------- RunnerPool.cpp - RunnerPool -----------------===//
+//
+///===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implmentation of the RunnerPool class, which
+/// contains a pool of long-lived runner worker processes
+///
+//===----------------------------------------------------------------------===//
+
+#include "RunnerPool.h"
+#include "EvaluationByJIT.h"
+#include "LoweringPipeline.h"
+
+#include "mlir/Parser/Parser.h"
+
+#include <chrono>
+#include <iostream>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/// Writes the whole buffer, retrying on partial writes and interruptions.
+static bool writeAll(int fd, const void *data, size_t size)
+{
+    const char *ptr = (const char *)data;
+    while (size > 0)
+    {
+        ssize_t written = write(fd, ptr, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        ptr += written;
+        size -= written;
+    }
+    return true;
+}
+
+/// Reads exactly size bytes, fails on end of file or error.
+static bool readAll(int fd, void *data, size_t size)
+{
+    char *ptr = (char *)data;
+    while (size > 0)
+    {
+        ssize_t bytes_read = read(fd, ptr, size);
+        if (bytes_read < 0 && errno == EINTR)
+            continue;
+        if (bytes_read <= 0)
+            return false;
+        ptr += bytes_read;
+        size -= bytes_read;
+    }
+    return true;
+}
+
+/// Same as readAll, fails once the deadline is reached.
+static bool readAllUntil(int fd, void *data, size_t size, std::chrono::steady_clock::time_point deadline)
+{
+    char *ptr = (char *)data;
+    while (size > 0)
+    {
+        int remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0)
+            return false;
+        struct pollfd pfd = {fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, remaining);
+        if (ready < 0 && errno == EINTR)
+            continue;
+        if (ready <= 0)
+            return false;
+        ssize_t bytes_read = read(fd, ptr, size);
+        if (bytes_read < 0 && errno == EINTR)
+            continue;
+        if (bytes_read <= 0)
+            return false;
+        ptr += bytes_read;
+        size -= bytes_read;
+    }
+    return true;
+}
+
+/// Requests are sent as their kind and cutoff followed by the module, a 64
+/// bits length and the text. Results come back as a ResultRecord, followed by
+/// the lowered module in the same form after a successful lowering.
+static bool writeMessage(int fd, const std::string &message)
+{
+    uint64_t size = message.size();
+    return writeAll(fd, &size, sizeof(size)) && writeAll(fd, message.data(), message.size());
+}
+
+static bool readMessage(int fd, std::string &message)
+{
+    uint64_t size;
+    if (!readAll(fd, &size, sizeof(size)))
+        return false;
+    message.resize(size);
+    return readAll(fd, &message[0], size);
+}
+
+RunnerPool::RunnerPool(int numWorkers) : RunnerPool(std::vector<std::vector<int>>(std::max(numWorkers, 1)))
+{
+}
+
+RunnerPool::RunnerPool(const std::vector<std::vector<int>> &slots)
+{
+    // A worker dying while we write to it must not kill the tuner
+    signal(SIGPIPE, SIG_IGN);
+
+    // Workers that fail to start are retried when they are picked by run()
+    workers.resize(std::max<size_t>(slots.size(), 1));
+    for (size_t i = 0; i < workers.size(); ++i)
+    {
+        if (i < slots.size())
+            workers[i].cpus = slots[i];
+        spawnWorker(i);
+        idleWorkers.push_back(i);
+    }
+}
+
+RunnerPool::~RunnerPool()
+{
+    for (size_t i = 0; i < workers.size(); ++i)
+    {
+        // Closing the pipe makes the worker leave its loop
+        if (workers[i].toWorker >= 0)
+            close(workers[i].toWorker);
+        if (workers[i].fromWorker >= 0)
+            close(workers[i].fromWorker);
+        if (workers[i].pid > 0)
+            waitpid(workers[i].pid, NULL, 0);
+    }
+}
+
+int RunnerPool::getNumWorkers()
+{
+    return workers.size();
+}
+
+bool RunnerPool::spawnWorker(int index)
+{
+    // Everything the child needs is prepared before the fork, only
+    // async-signal-safe calls are done between fork and exec
+    char executable[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", executable, sizeof(executable) - 1);
+    if (length < 0)
+        return false;
+    executable[length] = '\0';
+
+    // The pipes are close-on-exec so that workers do not keep each other's
+    // pipes open, the child only keeps its own two ends
+    int p_request[2], p_result[2];
+    if (pipe2(p_request, O_CLOEXEC) != 0)
+        return false;
+    if (pipe2(p_result, O_CLOEXEC) != 0)
+    {
+        close(p_request[READ]);
+        close(p_request[WRITE]);
+        return false;
+    }
+    std::string readFd = std::to_string(p_request[READ]);
+    std::string writeFd = std::to_string(p_result[WRITE]);
+
+    // Pinned workers get the cores of their slot and an OpenMP runtime
+    // restricted to them
+    const std::vector<int> &cpus = workers[index].cpus;
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    std::vector<std::string> envStrings;
+    for (char **env = environ; *env != NULL; ++env)
+    {
+        llvm::StringRef var(*env);
+        if (!cpus.empty() && (var.starts_with("OMP_NUM_THREADS=") || var.starts_with("OMP_PLACES=") || var.starts_with("OMP_PROC_BIND=")))
+            continue;
+        envStrings.push_back(*env);
+    }
+    if (!cpus.empty())
+    {
+        std::string places = "";
+        for (int cpu : cpus)
+        {
+            CPU_SET(cpu, &cpuSet);
+            places += (places.empty() ? "{" : ",{") + std::to_string(cpu) + "}";
+        }
+        envStrings.push_back("OMP_NUM_THREADS=" + std::to_string(cpus.size()));
+        envStrings.push_back("OMP_PLACES=" + places);
+        envStrings.push_back("OMP_PROC_BIND=close");
+    }
+    std::vector<char *> envp;
+    for (std::string &var : envStrings)
+        envp.push_back(&var[0]);
+    envp.push_back(NULL);
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(p_request[READ]);
+        close(p_request[WRITE]);
+        close(p_result[READ]);
+        close(p_result[WRITE]);
+        return false;
+    }
+    else if (pid == 0)
+    {
+        fcntl(p_request[READ], F_SETFD, 0);
+        fcntl(p_result[WRITE], F_SETFD, 0);
+        if (!cpus.empty())
+            sched_setaffinity(0, sizeof(cpuSet), &cpuSet);
+        execle(executable, "AutoSchedulerML", RUNNER_WORKER_FLAG, readFd.c_str(), writeFd.c_str(), NULL, envp.data());
+        perror("execle");
+        _exit(1);
+    }
+
+    // Parent process
+    close(p_request[READ]);
+    close(p_result[WRITE]);
+    workers[index].pid = pid;
+    workers[index].toWorker = p_request[WRITE];
+    workers[index].fromWorker = p_result[READ];
+    return true;
+}
+
+void RunnerPool::killWorker(int index)
+{
+    Worker &worker = workers[index];
+    if (worker.toWorker >= 0)
+        close(worker.toWorker);
+    if (worker.fromWorker >= 0)
+        close(worker.fromWorker);
+    if (worker.pid > 0)
+    {
+        kill(worker.pid, SIGKILL);
+        int status;
+        waitpid(worker.pid, &status, 0);
+    }
+    worker.pid = -1;
+    worker.toWorker = -1;
+    worker.fromWorker = -1;
+}
+
+Measurement RunnerPool::request(RequestKind kind, double cutoff, const std::string &module, double timeout,
+                                std::string *reply)
+{
+    int index;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        workerAvailable.wait(lock, [&]()
+                             { return !idleWorkers.empty(); });
+        index = idleWorkers.back();
+        idleWorkers.pop_back();
+    }
+
+    Measurement result(ResultStatus::Crashed);
+    uint32_t header = (uint32_t)kind;
+    // A worker that died while idle is replaced and the candidate resent once
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        if (workers[index].pid < 0 && !spawnWorker(index))
+            break;
+        if (!writeAll(workers[index].toWorker, &header, sizeof(header)) ||
+            !writeAll(workers[index].toWorker, &cutoff, sizeof(cutoff)) || !writeMessage(workers[index].toWorker, module))
+        {
+            killWorker(index);
+            continue;
+        }
+        auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timeout));
+        ResultRecord record;
+        uint64_t size = 0;
+        bool received = readAllUntil(workers[index].fromWorker, &record, sizeof(record), deadline);
+        // The lowered module follows the record of a successful lowering
+        if (received && reply != nullptr && record.magic == RESULT_RECORD_MAGIC && record.status == ResultStatus::Ok)
+        {
+            received = readAllUntil(workers[index].fromWorker, &size, sizeof(size), deadline);
+            reply->resize(received ? size : 0);
+            received = received && readAllUntil(workers[index].fromWorker, &(*reply)[0], size, deadline);
+        }
+        if (!received)
+        {
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                printf("Cpu Runner Child process timed out.\n");
+                result = Measurement(ResultStatus::TimedOut);
+            }
+            else
+            {
+                // The candidate crashed the worker
+                printf("Cpu Runner Child process did not exit normally.\n");
+                result = Measurement(ResultStatus::Crashed);
+            }
+            killWorker(index);
+            spawnWorker(index);
+        }
+        else
+        {
+            result = Measurement::fromRecord(record);
+            // The watchdog of the worker exits after writing its record, the
+            // worker is waited for before it is replaced so that the next
+            // candidate never goes to the dying one
+            if (record.magic == RESULT_RECORD_MAGIC && record.exiting)
+            {
+                waitpid(workers[index].pid, NULL, 0);
+                workers[index].pid = -1;
+                killWorker(index);
+                spawnWorker(index);
+            }
+        }
+        break;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        idleWorkers.push_back(index);
+    }
+    workerAvailable.notify_one();
+    return result;
+}
+
+Measurement RunnerPool::run(const std::string &loweredModule)
+{
+    // The worker stops a run at the cutoff itself, the deadline here bounds
+    // the JIT compilation and the repetitions
+    double cutoff = Measurement::getRunCutoff();
+    double timeout = Measurement::getLoweringTimeout() + std::max(Measurement::getTimeBudget(), cutoff) + cutoff + 1;
+    return request(RequestKind::Run, cutoff, loweredModule, timeout, nullptr);
+}
+
+ResultStatus RunnerPool::lower(const std::string &transformedModule, std::string &loweredModule)
+{
+    // The watchdog of the worker stops the lowering at its timeout, the
+    // deadline here only catches a worker that stopped answering
+    loweredModule = "";
+    Measurement result = request(RequestKind::Lower, 0, transformedModule, Measurement::getLoweringTimeout() + 1,
+                                 &loweredModule);
+    return result.getStatus();
+}
+
+/// Result pipe of the worker and the records the watchdog sends on it: the
+/// run stopped at the cutoff, or the lowering stopped at its timeout.
+static int WatchdogFd = -1;
+static ResultRecord CensoredRecord;
+static ResultRecord TimedOutRecord;
+static const ResultRecord *WatchdogRecord = &CensoredRecord;
+
+/// Called when a run or a lowering goes past its time, it cannot be
+/// interrupted so the worker reports it and exits (write and _exit are
+/// async-signal-safe, the record is smaller than PIPE_BUF so it is written at
+/// once).
+static void onWatchdog(int)
+{
+    ssize_t written = write(WatchdogFd, WatchdogRecord, sizeof(ResultRecord));
+    (void)written;
+    _exit(0);
+}
+
+/// Arms the watchdog for the given number of seconds, 0 disarms it.
+static void setWatchdogTimer(double seconds)
+{
+    struct itimerval timer = {};
+    timer.it_value.tv_sec = (time_t)seconds;
+    timer.it_value.tv_usec = (suseconds_t)((seconds - (time_t)seconds) * 1e6);
+    if (seconds > 0 && timer.it_value.tv_sec == 0 && timer.it_value.tv_usec == 0)
+        timer.it_value.tv_usec = 1;
+    setitimer(ITIMER_REAL, &timer, NULL);
+}
+
+/// Arms the watchdog of a run, the censored record carries the cutoff.
+static void armWatchdog(double seconds)
+{
+    if (seconds > 0)
+        CensoredRecord.samples[0] = seconds;
+    setWatchdogTimer(seconds);
+}
+
+/// Lowers the transformed module with the watchdog armed for the lowering
+/// timeout, the transform library and the passes are both covered.
+static ResultStatus lowerModule(mlir::MLIRContext &context, const std::string &transformedModule, std::string &loweredModule)
+{
+    mlir::OwningOpRef<mlir::ModuleOp> module = mlir::parseSourceString<mlir::ModuleOp>(transformedModule, &context);
+    if (!module)
+        return ResultStatus::LoweringFailed;
+    double timeout = Measurement::getLoweringTimeout();
+    WatchdogRecord = &TimedOutRecord;
+    setWatchdogTimer(timeout);
+    bool timedOut = false;
+    mlir::LogicalResult lowered = LoweringPipeline::getDefault()->run(module->getOperation(), timeout, &timedOut);
+    setWatchdogTimer(0);
+    WatchdogRecord = &CensoredRecord;
+    if (mlir::failed(lowered))
+        return timedOut ? ResultStatus::TimedOut : ResultStatus::LoweringFailed;
+    llvm::raw_string_ostream output(loweredModule);
+    module->print(output);
+    output.flush();
+    return ResultStatus::Ok;
+}
+
+int RunnerPool::runWorker(mlir::MLIRContext &context, int readFd, int writeFd)
+{
+    Measurement censored(ResultStatus::Censored);
+    censored.addSample(0);
+    CensoredRecord = censored.toRecord();
+    CensoredRecord.exiting = 1;
+    TimedOutRecord = Measurement(ResultStatus::TimedOut).toRecord();
+    TimedOutRecord.exiting = 1;
+    WatchdogFd = writeFd;
+    signal(SIGALRM, onWatchdog);
+
+    uint32_t kind;
+    double cutoff;
+    std::string module;
+    while (readAll(readFd, &kind, sizeof(kind)) && readAll(readFd, &cutoff, sizeof(cutoff)) && readMessage(readFd, module))
+    {
+        // The result goes back as a fixed size record on the result pipe, the
+        // kernel's own output stays on stdout and stderr
+        if (kind == (uint32_t)RequestKind::Lower)
+        {
+            std::string loweredModule;
+            ResultRecord record = Measurement(lowerModule(context, module, loweredModule)).toRecord();
+            if (!writeAll(writeFd, &record, sizeof(record)) ||
+                (record.status == ResultStatus::Ok && !writeMessage(writeFd, loweredModule)))
+                break;
+            continue;
+        }
+        Measurement result(ResultStatus::RunFailed);
+        mlir::OwningOpRef<mlir::ModuleOp> parsed = mlir::parseSourceString<mlir::ModuleOp>(module, &context);
+        if (parsed)
+            result = EvaluationByJIT::runMain(*parsed, cutoff, armWatchdog);
+        ResultRecord record = result.toRecord();
+        if (!writeAll(writeFd, &record, sizeof(record)))
+            break;
+    }
+    return 0;
+}
@@ -0,0 +1,577 @@
+//===----------------- ScheduleDatabase.cpp - ScheduleDatabase -------------===//
+//
+///===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implmentation of the ScheduleDatabase class, which
+/// contains a persistent database of the evaluated schedules shared by the
+/// tuning runs of a machine
+///
+//===----------------------------------------------------------------------===//
+
+#include "ScheduleDatabase.h"
+#include "Node.h"
+
+#include "mlir/Dialect/Linalg/IR/Linalg.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <thread>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DATA_MAGIC "ASSCHDB1"
+#define INDEX_MAGIC "ASSCHIX1"
+#define RECORD_MAGIC 0x41534452
+#define INITIAL_CAPACITY 4096
+#define KEY_SIZE 20
+
+/// Header of the log file, followed by the records.
+struct DataHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+/// Header of a record, followed by the samples and the schedule.
+struct RecordHeader {
+    uint32_t magic;
+    /// Size of the record including this header.
+    uint32_t size;
+    uint8_t key[KEY_SIZE];
+    uint8_t problem[KEY_SIZE];
+    uint32_t status;
+    uint32_t numSamples;
+    uint32_t scheduleLength;
+    uint32_t reserved;
+};
+
+/// Header of the index file, followed by capacity slots.
+struct IndexHeader {
+    char magic[8];
+    uint64_t capacity;
+    uint64_t count;
+    /// Size of the log file covered by the index.
+    uint64_t indexedSize;
+};
+
+/// Slot of the open addressing table, an offset of 0 marks an empty slot.
+struct IndexSlot {
+    uint8_t key[KEY_SIZE];
+    uint32_t reserved;
+    uint64_t offset;
+};
+
+static std::string sha1(const std::string &data)
+{
+    std::array<uint8_t, 20> hash = llvm::SHA1::hash(
+        llvm::ArrayRef<uint8_t>((const uint8_t *)data.data(), data.size()));
+    return std::string(hash.begin(), hash.end());
+}
+
+static uint64_t getSlotIndex(const std::string &key, uint64_t capacity)
+{
+    uint64_t hash;
+    std::memcpy(&hash, key.data(), sizeof(hash));
+    return hash % capacity;
+}
+
+static IndexSlot *getSlots(char *index)
+{
+    return (IndexSlot *)(index + sizeof(IndexHeader));
+}
+
+/// Inserts in a table that has room for the key.
+static bool probeInsert(char *index, const std::string &key, uint64_t offset)
+{
+    IndexHeader *header = (IndexHeader *)index;
+    IndexSlot *slots = getSlots(index);
+    uint64_t slot = getSlotIndex(key, header->capacity);
+    while (slots[slot].offset != 0 && std::memcmp(slots[slot].key, key.data(), KEY_SIZE) != 0)
+        slot = (slot + 1) % header->capacity;
+    bool isNew = slots[slot].offset == 0;
+    std::memcpy(slots[slot].key, key.data(), KEY_SIZE);
+    slots[slot].offset = offset;
+    if (isNew)
+        header->count++;
+    return isNew;
+}
+
+static bool preadAll(int fd, void *data, size_t size, off_t offset)
+{
+    char *ptr = (char *)data;
+    while (size > 0)
+    {
+        ssize_t bytes_read = pread(fd, ptr, size, offset);
+        if (bytes_read < 0 && errno == EINTR)
+            continue;
+        if (bytes_read <= 0)
+            return false;
+        ptr += bytes_read;
+        size -= bytes_read;
+        offset += bytes_read;
+    }
+    return true;
+}
+
+static bool pwriteAll(int fd, const void *data, size_t size, off_t offset)
+{
+    const char *ptr = (const char *)data;
+    while (size > 0)
+    {
+        ssize_t written = pwrite(fd, ptr, size, offset);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        ptr += written;
+        size -= written;
+        offset += written;
+    }
+    return true;
+}
+
+ScheduleDatabase::ScheduleDatabase(const std::string &path)
+{
+    this->path = path;
+    this->indexPath = path + ".index";
+    this->indexFd = -1;
+    this->index = nullptr;
+    this->indexSize = 0;
+    this->indexInode = 0;
+    setProblem("");
+
+    this->dataFd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (dataFd < 0)
+    {
+        perror("Failed to open the schedule database");
+        return;
+    }
+
+    lock(true);
+    struct stat st;
+    fstat(dataFd, &st);
+    DataHeader header;
+    if (st.st_size == 0)
+    {
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, DATA_MAGIC, sizeof(header.magic));
+        header.version = 1;
+        pwriteAll(dataFd, &header, sizeof(header), 0);
+    }
+    else if (!preadAll(dataFd, &header, sizeof(header), 0) || std::memcmp(header.magic, DATA_MAGIC, sizeof(header.magic)) != 0)
+    {
+        std::cerr << "Not a schedule database: " << path << std::endl;
+        unlock();
+        close(dataFd);
+        dataFd = -1;
+        return;
+    }
+    if (!mapIndex(true) || !refreshIndex(true))
+    {
+        std::cerr << "Failed to open the index of the schedule database: " << indexPath << std::endl;
+        unmapIndex();
+    }
+    unlock();
+}
+
+ScheduleDatabase::~ScheduleDatabase()
+{
+    unmapIndex();
+    if (dataFd >= 0)
+        close(dataFd);
+}
+
+ScheduleDatabase *ScheduleDatabase::get()
+{
+    static ScheduleDatabase *database = nullptr;
+    static std::once_flag once;
+    std::call_once(once, []()
+                   {
+        if (std::getenv("AS_SCHEDULE_DB") == nullptr)
+            return;
+        database = new ScheduleDatabase(std::getenv("AS_SCHEDULE_DB"));
+        if (database->dataFd < 0 || database->index == nullptr)
+        {
+            delete database;
+            database = nullptr;
+        } });
+    return database;
+}
+
+std::string ScheduleDatabase::getHardwareFingerprint()
+{
+    std::string fingerprint = "";
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line))
+    {
+        if (line.rfind("model name", 0) == 0)
+        {
+            fingerprint += line.substr(line.find(':') + 1);
+            break;
+        }
+    }
+    fingerprint += ";cpus=" + std::to_string(std::thread::hardware_concurrency());
+    fingerprint += ";l1d=" + std::to_string(sysconf(_SC_LEVEL1_DCACHE_SIZE));
+    fingerprint += ";l2=" + std::to_string(sysconf(_SC_LEVEL2_CACHE_SIZE));
+    fingerprint += ";l3=" + std::to_string(sysconf(_SC_LEVEL3_CACHE_SIZE));
+    return fingerprint;
+}
+
+std::string ScheduleDatabase::getProblemSignature(mlir::Operation *module)
+{
+    std::string signature;
+    llvm::raw_string_ostream output(signature);
+    module->walk([&](mlir::linalg::LinalgOp linalgOp)
+                 {
+        output << linalgOp->getName() << "(";
+        llvm::interleaveComma(linalgOp->getOperandTypes(), output);
+        output << ");"; });
+    output.flush();
+    return signature;
+}
+
+std::string ScheduleDatabase::getSchedule(Node *node)
+{
+    std::string schedule = "";
+    if (node->getTransformation() != NULL)
+    {
+        for (const auto &transformation : node->getTransformationList())
+            schedule += transformation->printTransformation();
+    }
+    return schedule;
+}
+
+std::string ScheduleDatabase::getEvaluationConfiguration()
+{
+    std::string configuration = "";
+    for (const char *name : {"AS_EVALUATOR", "AS_EVAL_SLOTS", "AS_RUNNER_WORKERS", "AS_COMPILE_THREADS", "OMP_NUM_THREADS"})
+        configuration += std::string(name) + "=" + (std::getenv(name) != nullptr ? std::getenv(name) : "") + ";";
+    return configuration;
+}
+
+bool ScheduleDatabase::isTransient(const Measurement &measurement)
+{
+    ResultStatus status = measurement.getStatus();
+    return status == ResultStatus::Crashed || status == ResultStatus::TimedOut || status == ResultStatus::Censored;
+}
+
+void ScheduleDatabase::setProblem(const std::string &problemSignature)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    problemKey = sha1(getHardwareFingerprint() + "\nmode=" + Measurement::getMode() + "\n" + getEvaluationConfiguration() + "\n" +
+                      problemSignature);
+}
+
+std::string ScheduleDatabase::getRecordKey(const std::string &candidateKey)
+{
+    return sha1(problemKey + candidateKey);
+}
+
+bool ScheduleDatabase::lock(bool exclusive)
+{
+    while (flock(dataFd, exclusive ? LOCK_EX : LOCK_SH) != 0)
+    {
+        if (errno != EINTR)
+            return false;
+    }
+    return true;
+}
+
+void ScheduleDatabase::unlock()
+{
+    flock(dataFd, LOCK_UN);
+}
+
+bool ScheduleDatabase::mapIndex(bool exclusive)
+{
+    indexFd = open(indexPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (indexFd < 0)
+        return false;
+    struct stat st;
+    fstat(indexFd, &st);
+
+    IndexHeader header;
+    bool valid = (size_t)st.st_size >= sizeof(IndexHeader) && preadAll(indexFd, &header, sizeof(header), 0) &&
+                 std::memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) == 0 &&
+                 (size_t)st.st_size == sizeof(IndexHeader) + header.capacity * sizeof(IndexSlot);
+    if (!valid)
+    {
+        // Missing or damaged index, it is rebuilt from the log file
+        if (!exclusive)
+        {
+            close(indexFd);
+            indexFd = -1;
+            return false;
+        }
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+        header.capacity = INITIAL_CAPACITY;
+        header.indexedSize = sizeof(DataHeader);
+        if (ftruncate(indexFd, 0) != 0 || ftruncate(indexFd, sizeof(IndexHeader) + header.capacity * sizeof(IndexSlot)) != 0 ||
+            !pwriteAll(indexFd, &header, sizeof(header), 0))
+        {
+            close(indexFd);
+            indexFd = -1;
+            return false;
+        }
+        fstat(indexFd, &st);
+    }
+
+    indexSize = st.st_size;
+    indexInode = st.st_ino;
+    void *mapping = mmap(NULL, indexSize, PROT_READ | PROT_WRITE, MAP_SHARED, indexFd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        close(indexFd);
+        indexFd = -1;
+        return false;
+    }
+    index = (char *)mapping;
+    return true;
+}
+
+void ScheduleDatabase::unmapIndex()
+{
+    if (index != nullptr)
+        munmap(index, indexSize);
+    if (indexFd >= 0)
+        close(indexFd);
+    index = nullptr;
+    indexFd = -1;
+}
+
+bool ScheduleDatabase::refreshIndex(bool exclusive)
+{
+    // Another job may have replaced the index while growing it
+    struct stat st;
+    if (index == nullptr || stat(indexPath.c_str(), &st) != 0 || st.st_ino != indexInode)
+    {
+        unmapIndex();
+        if (!mapIndex(exclusive))
+            return false;
+    }
+
+    struct stat dataStat;
+    fstat(dataFd, &dataStat);
+    uint64_t dataSize = dataStat.st_size;
+    if (((IndexHeader *)index)->indexedSize == dataSize)
+        return true;
+    if (!exclusive)
+        return false;
+
+    // Index the records appended without being indexed (rebuilt index, or a
+    // job killed between the two writes)
+    uint64_t offset = ((IndexHeader *)index)->indexedSize;
+    while (offset + sizeof(RecordHeader) <= dataSize)
+    {
+        RecordHeader record;
+        if (!preadAll(dataFd, &record, sizeof(record), offset) || record.magic != RECORD_MAGIC ||
+            record.size < sizeof(RecordHeader) || offset + record.size > dataSize)
+            break;
+        if (!insertSlot(std::string((const char *)record.key, KEY_SIZE), offset))
+            return false;
+        offset += record.size;
+    }
+    // A torn record at the end is dropped
+    if (offset != dataSize && ftruncate(dataFd, offset) != 0)
+        return false;
+    ((IndexHeader *)index)->indexedSize = offset;
+    return true;
+}
+
+bool ScheduleDatabase::growIndex(uint64_t capacity)
+{
+    std::string tmpPath = indexPath + ".tmp." + std::to_string(getpid());
+    int tmpFd = open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (tmpFd < 0)
+        return false;
+    size_t tmpSize = sizeof(IndexHeader) + capacity * sizeof(IndexSlot);
+    void *mapping = MAP_FAILED;
+    if (ftruncate(tmpFd, tmpSize) == 0)
+        mapping = mmap(NULL, tmpSize, PROT_READ | PROT_WRITE, MAP_SHARED, tmpFd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        close(tmpFd);
+        unlink(tmpPath.c_str());
+        return false;
+    }
+
+    char *tmpIndex = (char *)mapping;
+    IndexHeader *oldHeader = (IndexHeader *)index;
+    IndexHeader *newHeader = (IndexHeader *)tmpIndex;
+    std::memcpy(newHeader->magic, INDEX_MAGIC, sizeof(newHeader->magic));
+    newHeader->capacity = capacity;
+    newHeader->count = 0;
+    newHeader->indexedSize = oldHeader->indexedSize;
+    IndexSlot *oldSlots = getSlots(index);
+    for (uint64_t slot = 0; slot < oldHeader->capacity; ++slot)
+    {
+        if (oldSlots[slot].offset != 0)
+            probeInsert(tmpIndex, std::string((const char *)oldSlots[slot].key, KEY_SIZE), oldSlots[slot].offset);
+    }
+    msync(tmpIndex, tmpSize, MS_SYNC);
+    munmap(tmpIndex, tmpSize);
+    close(tmpFd);
+
+    // The other jobs notice the new inode the next time they take the lock
+    if (rename(tmpPath.c_str(), indexPath.c_str()) != 0)
+    {
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    unmapIndex();
+    return mapIndex(true);
+}
+
+bool ScheduleDatabase::findSlot(const std::string &key, uint64_t &offset)
+{
+    IndexHeader *header = (IndexHeader *)index;
+    IndexSlot *slots = getSlots(index);
+    uint64_t slot = getSlotIndex(key, header->capacity);
+    while (slots[slot].offset != 0)
+    {
+        if (std::memcmp(slots[slot].key, key.data(), KEY_SIZE) == 0)
+        {
+            offset = slots[slot].offset;
+            return true;
+        }
+        slot = (slot + 1) % header->capacity;
+    }
+    return false;
+}
+
+bool ScheduleDatabase::insertSlot(const std::string &key, uint64_t offset)
+{
+    // Keep the load factor under 70% so that the probes stay short
+    IndexHeader *header = (IndexHeader *)index;
+    if ((header->count + 1) * 10 > header->capacity * 7)
+    {
+        uint64_t capacity = header->capacity;
+        if (!growIndex(capacity * 2) && (index == nullptr || ((IndexHeader *)index)->count + 1 >= capacity))
+            return false;
+    }
+    probeInsert(index, key, offset);
+    return true;
+}
+
+bool ScheduleDatabase::readRecord(uint64_t offset, std::string &problem, std::string &schedule, Measurement &measurement)
+{
+    RecordHeader record;
+    if (!preadAll(dataFd, &record, sizeof(record), offset) || record.magic != RECORD_MAGIC ||
+        record.size != sizeof(RecordHeader) + record.numSamples * sizeof(double) + record.scheduleLength)
+        return false;
+    std::vector<double> samples(record.numSamples);
+    schedule.resize(record.scheduleLength);
+    if (!preadAll(dataFd, samples.data(), samples.size() * sizeof(double), offset + sizeof(RecordHeader)) ||
+        !preadAll(dataFd, &schedule[0], schedule.size(), offset + sizeof(RecordHeader) + samples.size() * sizeof(double)))
+        return false;
+
+    problem = std::string((const char *)record.problem, KEY_SIZE);
+    measurement = Measurement((ResultStatus)record.status);
+    for (double sample : samples)
+        measurement.addSample(sample);
+    return true;
+}
+
+bool ScheduleDatabase::lookup(const std::string &candidateKey, Measurement &measurement)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    std::string key = getRecordKey(candidateKey);
+    bool exclusive = false;
+    lock(exclusive);
+    if (!refreshIndex(exclusive))
+    {
+        unlock();
+        exclusive = true;
+        lock(exclusive);
+        if (!refreshIndex(exclusive))
+        {
+            unlock();
+            return false;
+        }
+    }
+
+    uint64_t offset;
+    std::string problem, schedule;
+    bool found = findSlot(key, offset) && readRecord(offset, problem, schedule, measurement);
+    unlock();
+    // Records written before the transient outcomes were left out
+    return found && !isTransient(measurement);
+}
+
+void ScheduleDatabase::insert(const std::string &candidateKey, const std::string &schedule, const Measurement &measurement)
+{
+    // A crash, a timeout or a cutoff says nothing of the next run of the
+    // candidate, it is measured again by the next jobs
+    if (isTransient(measurement))
+        return;
+    std::lock_guard<std::mutex> guard(mutex);
+    std::string key = getRecordKey(candidateKey);
+
+    RecordHeader record;
+    std::memset(&record, 0, sizeof(record));
+    record.magic = RECORD_MAGIC;
+    std::memcpy(record.key, key.data(), KEY_SIZE);
+    std::memcpy(record.problem, problemKey.data(), KEY_SIZE);
+    record.status = (uint32_t)measurement.getStatus();
+    record.numSamples = measurement.getNumSamples();
+    record.scheduleLength = schedule.size();
+    record.size = sizeof(RecordHeader) + record.numSamples * sizeof(double) + record.scheduleLength;
+    std::string buffer((const char *)&record, sizeof(record));
+    buffer.append((const char *)measurement.getSamples().data(), record.numSamples * sizeof(double));
+    buffer += schedule;
+
+    lock(true);
+    if (refreshIndex(true))
+    {
+        struct stat st;
+        fstat(dataFd, &st);
+        uint64_t offset = st.st_size;
+        // The record is indexed by the next refresh if the index cannot take it
+        if (pwriteAll(dataFd, buffer.data(), buffer.size(), offset) && insertSlot(key, offset))
+            ((IndexHeader *)index)->indexedSize = offset + buffer.size();
+    }
+    unlock();
+}
+
+std::vector<std::pair<std::string, Measurement>> ScheduleDatabase::getSchedules()
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    // The latest record of each schedule wins
+    std::map<std::string, std::pair<std::string, Measurement>> schedules;
+    lock(false);
+    struct stat st;
+    fstat(dataFd, &st);
+    uint64_t offset = sizeof(DataHeader);
+    while (offset + sizeof(RecordHeader) <= (uint64_t)st.st_size)
+    {
+        RecordHeader record;
+        if (!preadAll(dataFd, &record, sizeof(record), offset) || record.magic != RECORD_MAGIC || record.size < sizeof(RecordHeader))
+            break;
+        std::string problem, schedule;
+        Measurement measurement;
+        if (std::memcmp(record.problem, problemKey.data(), KEY_SIZE) == 0 &&
+            readRecord(offset, problem, schedule, measurement) && !schedule.empty() && !isTransient(measurement))
+            schedules[schedule] = std::make_pair(schedule, measurement);
+        offset += record.size;
+    }
+    unlock();
+
+    std::vector<std::pair<std::string, Measurement>> result;
+    for (auto &entry : schedules)
+        result.push_back(entry.second);
+    return result;
+}
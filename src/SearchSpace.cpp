@@ -0,0 +1,295 @@
+//===------------------------ SearchSpace.cpp - SearchSpace ----------------===//
+//
+///===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implmentation of the SearchSpace class, which
+/// contains the sequence of transformation steps the search methods explore
+///
+//===----------------------------------------------------------------------===//
+
+#include "SearchSpace.h"
+#include "Measurement.h"
+
+#include "mlir/Dialect/SCF/IR/SCF.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <numeric>
+
+static bool isPermutation(const std::vector<unsigned> &interchange, size_t size)
+{
+    std::vector<unsigned> sorted = interchange;
+    std::sort(sorted.begin(), sorted.end());
+    for (size_t i = 0; i < sorted.size(); ++i)
+        if (sorted[i] != i)
+            return false;
+    return sorted.size() == size;
+}
+
+/// Values of the list that starts after the parenthesis at pos.
+static std::vector<int64_t> parseValues(const std::string &schedule, size_t pos)
+{
+    std::vector<int64_t> values;
+    size_t end = schedule.find(')', pos);
+    std::string list = schedule.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+    size_t start = 0;
+    while (start < list.size())
+    {
+        size_t comma = list.find(',', start);
+        std::string value = list.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        if (value.find_first_of("0123456789") != std::string::npos)
+            values.push_back(std::stoll(value.substr(value.find_first_of("0123456789"))));
+        if (comma == std::string::npos)
+            break;
+        start = comma + 1;
+    }
+    return values;
+}
+
+SearchSpace::SearchSpace(mlir::MLIRContext *context, int depth)
+{
+    this->context = context;
+    // The nodes are expanded by several threads sharing the context
+    preloadDialects(context);
+    if (depth >= 2)
+        steps.push_back(Step::Parallelization);
+    for (int level = 2; level < depth; ++level)
+        steps.push_back(Step::Tiling);
+    if (depth >= 1)
+        steps.push_back(Step::Vectorization);
+}
+
+int SearchSpace::getDepth()
+{
+    return steps.size();
+}
+
+SearchSpace::Step SearchSpace::getStep(int level)
+{
+    return steps[level];
+}
+
+std::string SearchSpace::getStepName(Step step)
+{
+    switch (step)
+    {
+    case Step::Parallelization:
+        return "Parallelization";
+    case Step::Tiling:
+        return "Tiling";
+    case Step::Vectorization:
+        return "Vectorization";
+    }
+    return "";
+}
+
+/// Index in getLinalgOps of the first operation not yet in an scf.for, -1 if
+/// every operation is tiled.
+static int getUntiledStage(const SmallVector<mlir::linalg::LinalgOp, 4> &linalgOps)
+{
+    for (size_t stage = 0; stage < linalgOps.size(); ++stage)
+        if (!linalgOps[stage]->getParentOfType<scf::ForOp>())
+            return stage;
+    return -1;
+}
+
+mlir::Operation *SearchSpace::getTarget(Node *node, Step step, int &stage)
+{
+    mlir::Operation *target = (mlir::Operation *)((MLIRCodeIR *)node->getTransformedCodeIr())->getIr();
+    SmallVector<mlir::linalg::LinalgOp, 4> linalgOps = getLinalgOps(target);
+    if (linalgOps.empty())
+        return nullptr;
+
+    switch (step)
+    {
+    case Step::Parallelization:
+        // Parallelized operations are not tiled into a second scf.forall
+        stage = 0;
+        return linalgOps[0]->getParentOfType<scf::ForallOp>() ? nullptr : linalgOps[0].getOperation();
+    case Step::Tiling:
+        stage = getUntiledStage(linalgOps);
+        return stage < 0 ? nullptr : linalgOps[stage].getOperation();
+    case Step::Vectorization:
+        stage = 0;
+        return linalgOps[0].getOperation();
+    }
+    return nullptr;
+}
+
+llvm::SmallVector<Node *, 2> SearchSpace::expand(Node *node, int level)
+{
+    int stage;
+    if (!getTarget(node, getStep(level), stage))
+        return {};
+    mlir::Operation *target = (mlir::Operation *)((MLIRCodeIR *)node->getTransformedCodeIr())->getIr();
+
+    switch (getStep(level))
+    {
+    case Step::Parallelization:
+        return Parallelization::createParallelizationCandidates(node, context, stage, getLinalgOps(target));
+    case Step::Tiling:
+        return Tiling::createTilingCandidates(node, context, stage, getLinalgOps(target));
+    case Step::Vectorization:
+        return Vectorization::createVectorizationCandidates(node, context);
+    }
+    return {};
+}
+
+Node *SearchSpace::apply(Node *node, Step step, llvm::ArrayRef<int64_t> tileSizes, llvm::ArrayRef<unsigned> interchange)
+{
+    int stage;
+    if (!getTarget(node, step, stage))
+        return nullptr;
+    mlir::Operation *target = (mlir::Operation *)((MLIRCodeIR *)node->getTransformedCodeIr())->getIr();
+
+    SmallVector<Node *, 2> children;
+    switch (step)
+    {
+    case Step::Parallelization:
+        children = Parallelization::createParallelizationCandidates(node, context, stage, getLinalgOps(target),
+                                                                    {SmallVector<int64_t, 4>(tileSizes.begin(), tileSizes.end())});
+        break;
+    case Step::Tiling:
+        children = Tiling::createTilingCandidates(node, context, stage, getLinalgOps(target),
+                                                  SmallVector<int64_t, 4>(tileSizes.begin(), tileSizes.end()),
+                                                  std::vector<unsigned>(interchange.begin(), interchange.end()));
+        break;
+    case Step::Vectorization:
+        children = Vectorization::createVectorizationCandidates(node, context);
+        break;
+    }
+    return children.empty() ? nullptr : children.front();
+}
+
+SmallVector<int64_t, 4> SearchSpace::getDivisors(int64_t extent, Step step)
+{
+    int64_t limit = step == Step::Parallelization ? 100 : 50;
+    SmallVector<int64_t, 4> divisors;
+    for (int64_t i = 2; i < limit && i <= extent; ++i)
+        if (extent % i == 0)
+            divisors.push_back(i);
+    if (divisors.empty())
+        divisors.push_back(1);
+    return divisors;
+}
+
+size_t SearchSpace::getNearestDivisor(int64_t size, llvm::ArrayRef<int64_t> divisors)
+{
+    size_t nearest = 0;
+    for (size_t i = 1; i < divisors.size(); ++i)
+        if (std::abs(divisors[i] - size) < std::abs(divisors[nearest] - size))
+            nearest = i;
+    return nearest;
+}
+
+SearchSpace::Genome SearchSpace::parseSchedule(const std::string &schedule)
+{
+    // The transformations are printed as TP( sizes ), T( sizes )I( interchange )
+    // and V(  )
+    Genome genome;
+    for (size_t pos = 0; pos < schedule.size(); ++pos)
+    {
+        if (schedule.compare(pos, 3, "TP(") == 0)
+        {
+            std::vector<int64_t> sizes = parseValues(schedule, pos + 3);
+            genome.push_back({Step::Parallelization, SmallVector<int64_t, 4>(sizes.begin(), sizes.end()), {}, {}});
+            pos = schedule.find(')', pos);
+        }
+        else if (schedule.compare(pos, 2, "T(") == 0)
+        {
+            std::vector<int64_t> sizes = parseValues(schedule, pos + 2);
+            genome.push_back({Step::Tiling, SmallVector<int64_t, 4>(sizes.begin(), sizes.end()), {}, {}});
+            pos = schedule.find(')', pos);
+        }
+        else if (schedule.compare(pos, 2, "I(") == 0 && !genome.empty())
+        {
+            for (int64_t loop : parseValues(schedule, pos + 2))
+                genome.back().interchange.push_back(loop);
+            pos = schedule.find(')', pos);
+        }
+        else if (schedule.compare(pos, 2, "V(") == 0)
+        {
+            genome.push_back({Step::Vectorization, {}, {}, {}});
+            pos = schedule.find(')', pos);
+        }
+        if (pos == std::string::npos)
+            break;
+    }
+    return genome;
+}
+
+void SearchSpace::eraseNode(Node *node)
+{
+    ((mlir::Operation *)((MLIRCodeIR *)node->getTransformedCodeIr())->getIr())->erase();
+    Measurement::forget(node);
+    delete node;
+}
+
+Node *SearchSpace::decode(Node *root, Genome &genome, std::mt19937 &decodeGenerator)
+{
+    Node *node = root;
+    Genome applied;
+    for (Gene &gene : genome)
+    {
+        int stage;
+        mlir::Operation *target = getTarget(node, gene.step, stage);
+        if (!target)
+            continue;
+
+        if (gene.step != Step::Vectorization)
+        {
+            // The extents change with the genes applied before this one (the
+            // parallelization shrinks the operations it fuses)
+            gene.extents.clear();
+            for (int64_t extent : cast<linalg::LinalgOp>(target).getStaticLoopRanges())
+                gene.extents.push_back(extent);
+            if (gene.extents.empty())
+                continue;
+            // Like its candidates, the parallelization tiles 2 to rank - 1
+            // loops, the innermost loop stays out of the scf.forall
+            size_t minSizes = gene.step == Step::Parallelization ? 2 : gene.extents.size();
+            size_t numSizes = gene.step == Step::Parallelization ? gene.extents.size() - 1 : gene.extents.size();
+            if (numSizes < minSizes)
+                continue;
+            bool random = gene.tileSizes.empty();
+            if (random)
+            {
+                size_t numTiled = std::uniform_int_distribution<size_t>(minSizes, numSizes)(decodeGenerator);
+                for (size_t i = 0; i < numTiled; ++i)
+                {
+                    SmallVector<int64_t, 4> divisors = getDivisors(gene.extents[i], gene.step);
+                    gene.tileSizes.push_back(divisors[std::uniform_int_distribution<size_t>(0, divisors.size() - 1)(decodeGenerator)]);
+                }
+            }
+            if (gene.tileSizes.size() > numSizes)
+                gene.tileSizes.resize(numSizes);
+            while (gene.tileSizes.size() < minSizes)
+                gene.tileSizes.push_back(getDivisors(gene.extents[gene.tileSizes.size()], gene.step).back());
+            for (size_t i = 0; i < gene.tileSizes.size(); ++i)
+            {
+                SmallVector<int64_t, 4> divisors = getDivisors(gene.extents[i], gene.step);
+                gene.tileSizes[i] = divisors[getNearestDivisor(gene.tileSizes[i], divisors)];
+            }
+
+            if (gene.step == Step::Tiling && !isPermutation(gene.interchange, numSizes))
+            {
+                gene.interchange.resize(numSizes);
+                std::iota(gene.interchange.begin(), gene.interchange.end(), 0);
+                if (random)
+                    std::shuffle(gene.interchange.begin(), gene.interchange.end(), decodeGenerator);
+            }
+        }
+
+        Node *child = apply(node, gene.step, gene.tileSizes, gene.interchange);
+        if (!child)
+            continue;
+        // Only the last node of the genome is kept
+        if (node != root)
+            eraseNode(node);
+        node = child;
+        applied.push_back(gene);
+    }
+    genome = applied;
+    return node;
+}
@@ -140,7 +140,9 @@ void Tiling::applyTransformation(CodeIR CodeIr)
 SmallVector<Node *, 2> Tiling::createTilingCandidates(Node *node,
                                                       mlir::MLIRContext *context,
                                                       int CurrentStage,
-                                                      SmallVector<mlir::linalg::LinalgOp, 4> LinalgOpStages)
+                                                      SmallVector<mlir::linalg::LinalgOp, 4> LinalgOpStages,
+                                                      SmallVector<int64_t, 4> TileSizes,
+                                                      std::vector<unsigned> InterchangeVector)
 {
 
   // int64_t maxNumberLoops = 3;
@@ -177,13 +179,22 @@ SmallVector<Node *, 2> Tiling::createTilingCandidates(Node *node,
 
     /*for (int NumberLoops = 2; NumberLoops <= iterationDomain.size(); ++NumberLoops)
     {*/
-    SmallVector<SmallVector<int64_t, 4>, 4> newCombinations =
-        generateTileForOpCombinations(/*NumberLoops*/ iterationDomain.size(), iterationDomain);
-    tileCombinations.insert(tileCombinations.end(), newCombinations.begin(), newCombinations.end());
+    // Given tile sizes and interchange replace the sampled ones
+    if (!TileSizes.empty())
+      tileCombinations.push_back(TileSizes);
+    else
+    {
+      SmallVector<SmallVector<int64_t, 4>, 4> newCombinations =
+          generateTileForOpCombinations(/*NumberLoops*/ iterationDomain.size(), iterationDomain);
+      tileCombinations.insert(tileCombinations.end(), newCombinations.begin(), newCombinations.end());
+    }
     //}
 
-    std::vector<std::vector<unsigned>> values =
-        generateCandidates(loops.size(), 5);
+    std::vector<std::vector<unsigned>> values;
+    if (!InterchangeVector.empty())
+      values.push_back(InterchangeVector);
+    else
+      values = generateCandidates(loops.size(), 5);
     //SelectedTileCombinations.push_back({1, 8, 8, 32, 5, 5, 3});
     std::sample(
       tileCombinations.begin(),
@@ -0,0 +1,222 @@
+//===------------------------- TuningLogger.cpp - TuningLogger -------------===//
+//
+///===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implmentation of the TuningLogger class, which
+/// contains the background writer of the tuning logs
+///
+//===----------------------------------------------------------------------===//
+
+#include "TuningLogger.h"
+#include "FeatureExtractor.h"
+#include "PerfCounters.h"
+
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+
+/// Records kept in memory while the writer catches up.
+#define TUNING_LOGGER_QUEUE_CAPACITY 4096
+
+static const char *getStatusName(ResultStatus status)
+{
+    switch (status)
+    {
+    case ResultStatus::Ok:
+        return "ok";
+    case ResultStatus::LoweringFailed:
+        return "lowering_failed";
+    case ResultStatus::RunFailed:
+        return "run_failed";
+    case ResultStatus::NoTiming:
+        return "no_timing";
+    case ResultStatus::Crashed:
+        return "crashed";
+    case ResultStatus::TimedOut:
+        return "timed_out";
+    case ResultStatus::Censored:
+        return "censored";
+    }
+    return "unknown";
+}
+
+/// Quotes the argument for the shell, a quote inside it becomes '\''.
+static std::string quoteShellArgument(const std::string &argument)
+{
+    std::string quoted = "'";
+    for (char c : argument)
+    {
+        if (c == '\'')
+            quoted += "'\\''";
+        else
+            quoted += c;
+    }
+    return quoted + "'";
+}
+
+static std::string toLine(llvm::json::Object object)
+{
+    std::string line;
+    llvm::raw_string_ostream output(line);
+    output << llvm::json::Value(std::move(object)) << "\n";
+    output.flush();
+    return line;
+}
+
+TuningLogger::TuningLogger(const std::string &fileName)
+    : fileName(fileName), file(nullptr), compressed(false), queue(TUNING_LOGGER_QUEUE_CAPACITY), stopping(false),
+      dropped(0), bestTime(std::numeric_limits<double>::infinity())
+{
+    // Compressed logs are piped through gzip, appended gzip members still
+    // form a valid file
+    if (std::getenv("AS_LOG_COMPRESS") != nullptr && std::string(std::getenv("AS_LOG_COMPRESS")) == "1")
+    {
+        std::string command = "gzip -c >> " + quoteShellArgument(fileName + ".gz");
+        file = popen(command.c_str(), "w");
+        compressed = file != nullptr;
+    }
+    if (file == nullptr)
+        file = fopen(fileName.c_str(), "a");
+    if (file == nullptr)
+        perror("Failed to open the logs file");
+    // The evaluation records only carry the values of the features, their
+    // names are written once at the start of the file
+    llvm::json::Array names;
+    for (const std::string &name : FeatureExtractor::getNames())
+        names.push_back(name);
+    log(toLine(llvm::json::Object{{"event", "features"}, {"names", std::move(names)}}));
+    writer = std::thread([this]()
+                         { writeRecords(); });
+}
+
+TuningLogger::~TuningLogger()
+{
+    stopping = true;
+    if (writer.joinable())
+        writer.join();
+    if (file != nullptr)
+    {
+        if (dropped > 0)
+            fprintf(file, "{\"event\":\"dropped\",\"records\":%llu}\n", (unsigned long long)dropped.load());
+        if (compressed)
+            pclose(file);
+        else
+            fclose(file);
+    }
+}
+
+TuningLogger *TuningLogger::get(const std::string &fileName)
+{
+    if (std::getenv("AS_VERBOSE") == nullptr || std::string(std::getenv("AS_VERBOSE")) != "1")
+        return nullptr;
+    // The loggers live until the exit of the tuner, their destructors write
+    // the records still queued
+    static std::mutex mutex;
+    static std::map<std::string, std::unique_ptr<TuningLogger>> loggers;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<TuningLogger> &logger = loggers[fileName];
+    if (!logger)
+        logger.reset(new TuningLogger(fileName));
+    return logger.get();
+}
+
+TuningLogger::IRMode TuningLogger::getIRMode()
+{
+    std::string mode = std::getenv("AS_LOG_IR") != nullptr ? std::getenv("AS_LOG_IR") : "best";
+    if (mode == "none")
+        return IRMode::None;
+    if (mode == "all")
+        return IRMode::All;
+    return IRMode::Best;
+}
+
+void TuningLogger::log(std::string record)
+{
+    if (!queue.tryPush(std::move(record)))
+        ++dropped;
+}
+
+bool TuningLogger::isNewBest(double seconds)
+{
+    double best = bestTime.load();
+    while (seconds < best)
+    {
+        if (bestTime.compare_exchange_weak(best, seconds))
+            return true;
+    }
+    return false;
+}
+
+void TuningLogger::writeRecords()
+{
+    std::string record;
+    while (true)
+    {
+        bool wrote = false;
+        while (queue.tryPop(record))
+        {
+            if (file != nullptr)
+                fwrite(record.data(), 1, record.size(), file);
+            wrote = true;
+        }
+        if (wrote && file != nullptr)
+            fflush(file);
+        else if (stopping)
+            break;
+        else
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+std::string TuningLogger::getEvaluationRecord(const std::string &schedule, const Measurement &measurement,
+                                              bool best, const std::string &code,
+                                              const std::vector<float> &features)
+{
+    llvm::json::Object record{{"event", "evaluation"},
+                              {"schedule", schedule},
+                              {"status", getStatusName(measurement.getStatus())},
+                              {"mode", Measurement::getMode()},
+                              {"repetitions", measurement.getNumSamples()}};
+    if (!measurement.isFailed())
+    {
+        record["median"] = measurement.getMedian();
+        record["min"] = measurement.getMin();
+        record["spread"] = measurement.getSpread();
+    }
+    if (!measurement.getCounters().empty())
+    {
+        llvm::json::Array counters;
+        for (uint64_t counter : measurement.getCounters())
+            counters.push_back(counter == PERF_COUNTER_UNAVAILABLE ? llvm::json::Value(nullptr) : llvm::json::Value((int64_t)counter));
+        record["counters"] = std::move(counters);
+    }
+    if (!features.empty())
+    {
+        llvm::json::Array values;
+        for (float feature : features)
+            values.push_back((double)feature);
+        record["features"] = std::move(values);
+    }
+    if (best)
+        record["best"] = true;
+    if (!code.empty())
+        record["ir"] = code;
+    return toLine(std::move(record));
+}
+
+std::string TuningLogger::getCodeRecord(const std::string &schedule, const std::string &code)
+{
+    return toLine(llvm::json::Object{{"event", "candidate"}, {"schedule", schedule}, {"ir", code}});
+}
+
+uint64_t TuningLogger::getDropped() const
+{
+    return dropped;
+}
@@ -1,6 +1,8 @@
 
 #include "Utils.h"
 
+#include <cstdlib>
+
 
 // Function to generate tiling sizes that are multiples of the upperBounds.
 void generateForOpCombinations(const llvm::SmallVector<llvm::SmallVector<int64_t, 4>, 4> &tileSizes,
@@ -412,6 +414,7 @@ mlir::LogicalResult TagSCFForAll(mlir::Operation *Target, std::string tag)
 {
     std::string transformDialectString = "module attributes {transform.with_named_sequence} { \n transform.named_sequence @__transform_main(%variant_op: !transform.any_op {transform.readonly})  { \n  %1 = transform.structured.match ops{[\"scf.forall\"]}  in %variant_op : (!transform.any_op) -> !transform.any_op transform.annotate %1 \"" + tag + "\" : !transform.any_op transform.yield}}";
     mlir::transform::TransformOptions options1;
+    std::lock_guard<std::mutex> lock(getContextMutex());
     mlir::OwningOpRef<mlir::ModuleOp> moduleFromFile = mlir::parseSourceString<mlir::ModuleOp>(transformDialectString, Target->getContext());
     llvm::StringRef entryPoint = "__transform_main";
     mlir::Operation *transformEntryPoint = mlir::transform::detail::findTransformEntryPoint(Target, *moduleFromFile, entryPoint);
@@ -425,6 +428,7 @@ mlir::LogicalResult TagOperation(mlir::Operation *Target, std::string tag)
 {
     std::string transformDialectString = "module attributes {transform.with_named_sequence} { \n transform.named_sequence @__transform_main(%variant_op: !transform.any_op {transform.readonly})  { \n  %1 = transform.structured.match interface{LinalgOp}  in %variant_op : (!transform.any_op) -> !transform.any_op transform.annotate %1 \"" + tag + "\" : !transform.any_op transform.yield}}";
     mlir::transform::TransformOptions options1;
+    std::lock_guard<std::mutex> lock(getContextMutex());
     mlir::OwningOpRef<mlir::ModuleOp> moduleFromFile = mlir::parseSourceString<mlir::ModuleOp>(transformDialectString, Target->getContext());
     llvm::StringRef entryPoint = "__transform_main";
     mlir::Operation *transformEntryPoint = mlir::transform::detail::findTransformEntryPoint(Target, *moduleFromFile, entryPoint);
@@ -433,4 +437,26 @@ mlir::LogicalResult TagOperation(mlir::Operation *Target, std::string tag)
         Target, transformEntryPoint, *moduleFromFile,
         options1.enableExpensiveChecks(false));
     
-}
\ No newline at end of file
+}
+
+void preloadDialects(mlir::MLIRContext *context)
+{
+    std::lock_guard<std::mutex> lock(getContextMutex());
+    context->loadAllAvailableDialects();
+}
+
+std::mutex &getContextMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+double getEnvDouble(const char *name, double defaultValue)
+{
+  return std::getenv(name) != nullptr ? std::atof(std::getenv(name)) : defaultValue;
+}
+
+int getEnvInt(const char *name, int defaultValue)
+{
+  return std::getenv(name) != nullptr ? std::atoi(std::getenv(name)) : defaultValue;
+}
@@ -17,6 +17,7 @@ mlir::Operation *DecomposeConv2dOp(mlir::Operation *Target)
   // TODO: TYPE OF CONV
   std::string transformDialectString = "module attributes {transform.with_named_sequence} { \n transform.named_sequence @__transform_main(%variant_op: !transform.any_op {transform.readonly})  { \n   %conv = transform.structured.match ops{[\"linalg.conv_2d_nhwc_hwcf\"]} in %variant_op : (!transform.any_op) -> !transform.any_op %decomposed = transform.structured.decompose %conv: (!transform.any_op) -> !transform.any_op %pool = transform.structured.match ops{[\"linalg.pooling_nchw_max\"]} in %variant_op : (!transform.any_op) -> !transform.any_op %decomposed_pool = transform.structured.decompose %pool: (!transform.any_op) -> !transform.any_op transform.yield}}";
   mlir::transform::TransformOptions options1;
+  std::lock_guard<std::mutex> lock(getContextMutex());
   mlir::OwningOpRef<mlir::ModuleOp> moduleFromFile = parseSourceString<mlir::ModuleOp>(transformDialectString, Target->getContext());
   llvm::StringRef entryPoint = "__transform_main";
   mlir::Operation *transformEntryPoint = transform::detail::findTransformEntryPoint(Target, *moduleFromFile, entryPoint);
@@ -318,13 +319,16 @@ SmallVector<Node *, 2> Vectorization::createVectorizationCandidates(Node *node,
     std::cout << "START VECT\n";
 
     mlir::transform::TransformOptions options1;
-    mlir::OwningOpRef<mlir::ModuleOp> moduleFromFile = parseSourceString<mlir::ModuleOp>(transformDialectString, Target->getContext());
-    llvm::StringRef entryPoint = "__transform_main";
-    mlir::Operation *transformEntryPoint = transform::detail::findTransformEntryPoint(Target, *moduleFromFile, entryPoint);
-
-    transform::applyTransformNamedSequence(
-        Target, transformEntryPoint, *moduleFromFile,
-        options1.enableExpensiveChecks(false));
+    {
+      std::lock_guard<std::mutex> lock(getContextMutex());
+      mlir::OwningOpRef<mlir::ModuleOp> moduleFromFile = parseSourceString<mlir::ModuleOp>(transformDialectString, Target->getContext());
+      llvm::StringRef entryPoint = "__transform_main";
+      mlir::Operation *transformEntryPoint = transform::detail::findTransformEntryPoint(Target, *moduleFromFile, entryPoint);
+
+      transform::applyTransformNamedSequence(
+          Target, transformEntryPoint, *moduleFromFile,
+          options1.enableExpensiveChecks(false));
+    }
 
     MLIRCodeIR *ClonedCodeIr = (MLIRCodeIR *)CodeIr->setMLIRIR(Target);
     node->setTransformedCodeIr(ClonedCodeIr);